@@ -56,13 +56,13 @@ struct MyViewer : Viewer {
 	void update(double elapsedTime) override {
 		boneAngle = (float)elapsedTime;
 
-		leftMouseButtonPressed = glfwGetMouseButton(window, GLFW_MOUSE_BUTTON_LEFT) == GLFW_PRESS;
+		leftMouseButtonPressed = isMouseButtonPressed(GLFW_MOUSE_BUTTON_LEFT);
 
-		altKeyPressed = glfwGetKey(window, GLFW_KEY_LEFT_ALT) == GLFW_PRESS || glfwGetKey(window, GLFW_KEY_RIGHT_ALT) == GLFW_PRESS;
+		altKeyPressed = isKeyPressed(GLFW_KEY_LEFT_ALT) || isKeyPressed(GLFW_KEY_RIGHT_ALT);
 
 		double mouseX;
 		double mouseY;
-		glfwGetCursorPos(window, &mouseX, &mouseY);
+		getCursorPos(mouseX, mouseY);
 
 		mousePos = { float(mouseX), viewportHeight - float(mouseY) };
 
@@ -0,0 +1,345 @@
+#include "BarnesHut.h"
+
+#include <glm/common.hpp>
+#include <glm/geometric.hpp>
+#include <algorithm>
+#include <assert.h>
+#include <chrono>
+#include <math.h>
+
+namespace {
+	// Levels split serially before handing the subtrees to the pool: up to 64 tasks
+	constexpr int TASK_DEPTH = 2;
+	constexpr int RADIX_BITS = 10;
+	constexpr int MAX_STACK = 8 * BARNES_HUT_MAX_DEPTH + 8;
+
+	struct BodyRange {
+		int first;
+		int count;
+	};
+
+	struct SubtreeTask {
+		int nodeIndex;
+		int first;
+		int count;
+		int level;
+	};
+
+	// Spreads the low 10 bits of v two bits apart
+	uint32_t expandBits(uint32_t v) {
+		v = (v * 0x00010001u) & 0xFF0000FFu;
+		v = (v * 0x00000101u) & 0x0F00F00Fu;
+		v = (v * 0x00000011u) & 0xC30C30C3u;
+		v = (v * 0x00000005u) & 0x49249249u;
+		return v;
+	}
+
+	uint32_t mortonCode(float x, float y, float z, const glm::vec3& origin, float cellsPerUnit) {
+		const float maxCell = static_cast<float>((1 << BARNES_HUT_MAX_DEPTH) - 1);
+		const glm::vec3 cell = glm::clamp((glm::vec3(x, y, z) - origin) * cellsPerUnit, glm::vec3(0.f), glm::vec3(maxCell));
+		return (expandBits(static_cast<uint32_t>(cell.x)) << 2)
+			| (expandBits(static_cast<uint32_t>(cell.y)) << 1)
+			| expandBits(static_cast<uint32_t>(cell.z));
+	}
+
+	// LSD radix sort of the codes, carrying the body indices along
+	void sortByCode(BarnesHutTree& tree, int count) {
+		constexpr int bucketCount = 1 << RADIX_BITS;
+		std::vector<int> offsets(bucketCount);
+		for (int shift = 0; shift < 3 * BARNES_HUT_MAX_DEPTH; shift += RADIX_BITS) {
+			std::fill(offsets.begin(), offsets.end(), 0);
+			for (int i = 0; i < count; ++i) {
+				++offsets[(tree.codes[i] >> shift) & (bucketCount - 1)];
+			}
+			int sum = 0;
+			for (int& offset : offsets) {
+				const int bucketSize = offset;
+				offset = sum;
+				sum += bucketSize;
+			}
+			for (int i = 0; i < count; ++i) {
+				const int destination = offsets[(tree.codes[i] >> shift) & (bucketCount - 1)]++;
+				tree.codesScratch[destination] = tree.codes[i];
+				tree.orderScratch[destination] = tree.order[i];
+			}
+			tree.codes.swap(tree.codesScratch);
+			tree.order.swap(tree.orderScratch);
+		}
+	}
+
+	// Ranges of the non-empty octants of the cell at level holding [first, first + count)
+	int splitCell(const BarnesHutTree& tree, int first, int count, int level, BodyRange* pRanges) {
+		const int shift = 3 * (BARNES_HUT_MAX_DEPTH - 1 - level);
+		const uint32_t* pBegin = tree.codes.data() + first;
+		const uint32_t* pEnd = pBegin + count;
+		int rangeCount = 0;
+		const uint32_t* pRangeBegin = pBegin;
+		while (pRangeBegin != pEnd) {
+			// Codes share their prefix above this level, so the octant only grows
+			const uint32_t octant = (*pRangeBegin >> shift) & 7u;
+			const uint32_t* pRangeEnd = std::partition_point(pRangeBegin, pEnd, [shift, octant](uint32_t code) {
+				return ((code >> shift) & 7u) == octant;
+			});
+			pRanges[rangeCount++] = { static_cast<int>(pRangeBegin - tree.codes.data()), static_cast<int>(pRangeEnd - pRangeBegin) };
+			pRangeBegin = pRangeEnd;
+		}
+		return rangeCount;
+	}
+
+	void sumChildren(std::vector<BarnesHutNode>& nodes, int nodeIndex) {
+		BarnesHutNode& node = nodes[nodeIndex];
+		glm::vec3 weightedSum = glm::vec3(0.f);
+		float mass = 0.f;
+		for (int c = node.firstChild; c < node.firstChild + node.childCount; ++c) {
+			weightedSum += nodes[c].centerOfMass * nodes[c].mass;
+			mass += nodes[c].mass;
+		}
+		node.mass = mass;
+		node.centerOfMass = weightedSum / mass;
+	}
+
+	bool isLeaf(const BarnesHutTree& tree, int count, int level) {
+		return count <= tree.params.leafSize || level == BARNES_HUT_MAX_DEPTH;
+	}
+
+	void makeLeaf(const BarnesHutTree& tree, BarnesHutNode& node, int first, int count) {
+		glm::vec3 sum = glm::vec3(0.f);
+		for (int i = first; i < first + count; ++i) {
+			sum += glm::vec3(tree.bodyX[i], tree.bodyY[i], tree.bodyZ[i]);
+		}
+		node.centerOfMass = sum / static_cast<float>(count);
+		node.mass = count * tree.bodyMass;
+		node.firstChild = -1;
+		node.childCount = 0;
+		node.firstBody = first;
+		node.bodyCount = count;
+	}
+
+	// Fills nodes[nodeIndex] and its subtree, returns the deepest level reached
+	int buildNode(const BarnesHutTree& tree, std::vector<BarnesHutNode>& nodes, int nodeIndex, int first, int count, int level) {
+		nodes[nodeIndex].size = tree.cubeSize / static_cast<float>(1 << level);
+		if (isLeaf(tree, count, level)) {
+			makeLeaf(tree, nodes[nodeIndex], first, count);
+			return level;
+		}
+
+		BodyRange ranges[8];
+		const int childCount = splitCell(tree, first, count, level, ranges);
+		const int firstChild = static_cast<int>(nodes.size());
+		nodes.resize(nodes.size() + childCount);
+		nodes[nodeIndex].firstChild = firstChild;
+		nodes[nodeIndex].childCount = childCount;
+		nodes[nodeIndex].firstBody = first;
+		nodes[nodeIndex].bodyCount = count;
+
+		int depth = level;
+		for (int c = 0; c < childCount; ++c) {
+			depth = std::max(depth, buildNode(tree, nodes, firstChild + c, ranges[c].first, ranges[c].count, level + 1));
+		}
+		sumChildren(nodes, nodeIndex);
+		return depth;
+	}
+
+	// Splits the first levels serially and returns the remaining subtrees.
+	// Nodes split here are listed in splitNodes, parents before children.
+	void splitTopLevels(BarnesHutTree& tree, int nodeIndex, int first, int count, int level, std::vector<SubtreeTask>& tasks, std::vector<int>& splitNodes) {
+		if (level == TASK_DEPTH || isLeaf(tree, count, level)) {
+			tasks.push_back({ nodeIndex, first, count, level });
+			return;
+		}
+		BodyRange ranges[8];
+		const int childCount = splitCell(tree, first, count, level, ranges);
+		const int firstChild = static_cast<int>(tree.nodes.size());
+		tree.nodes.resize(tree.nodes.size() + childCount);
+		BarnesHutNode& node = tree.nodes[nodeIndex];
+		node.size = tree.cubeSize / static_cast<float>(1 << level);
+		node.firstChild = firstChild;
+		node.childCount = childCount;
+		node.firstBody = first;
+		node.bodyCount = count;
+		splitNodes.push_back(nodeIndex);
+		for (int c = 0; c < childCount; ++c) {
+			splitTopLevels(tree, firstChild + c, ranges[c].first, ranges[c].count, level + 1, tasks, splitNodes);
+		}
+	}
+
+	glm::vec3 accumulateGravity(const BarnesHutTree& tree, const glm::vec3& position, int& interactions) {
+		glm::vec3 acceleration = glm::vec3(0.f);
+		if (tree.nodes.empty()) {
+			return acceleration;
+		}
+		const float thetaSq = tree.params.theta * tree.params.theta;
+		const float softeningSq = tree.params.softening * tree.params.softening;
+
+		int stack[MAX_STACK];
+		int stackSize = 0;
+		stack[stackSize++] = 0;
+		while (stackSize > 0) {
+			const BarnesHutNode& node = tree.nodes[stack[--stackSize]];
+			if (node.firstChild < 0) {
+				for (int i = node.firstBody; i < node.firstBody + node.bodyCount; ++i) {
+					const glm::vec3 toBody = glm::vec3(tree.bodyX[i], tree.bodyY[i], tree.bodyZ[i]) - position;
+					const float inverseDistance = 1.f / sqrtf(glm::dot(toBody, toBody) + softeningSq);
+					acceleration += toBody * (tree.bodyMass * inverseDistance * inverseDistance * inverseDistance);
+				}
+				interactions += node.bodyCount;
+				continue;
+			}
+			const glm::vec3 toCenter = node.centerOfMass - position;
+			const float distanceSq = glm::dot(toCenter, toCenter);
+			if (node.size * node.size < thetaSq * distanceSq) {
+				const float inverseDistance = 1.f / sqrtf(distanceSq + softeningSq);
+				acceleration += toCenter * (node.mass * inverseDistance * inverseDistance * inverseDistance);
+				++interactions;
+				continue;
+			}
+			assert(stackSize + node.childCount <= MAX_STACK);
+			for (int c = node.firstChild; c < node.firstChild + node.childCount; ++c) {
+				stack[stackSize++] = c;
+			}
+		}
+		return acceleration;
+	}
+}
+
+void buildBarnesHutTree(BarnesHutTree& tree, const ParticleSystem& system, float cubeSize, ThreadPool& pool) {
+	const auto buildStart = std::chrono::steady_clock::now();
+	const int count = system.count;
+	tree.cubeSize = cubeSize;
+	tree.bodyMass = count > 0 ? tree.params.totalMass / count : 0.f;
+	tree.nodes.clear();
+	tree.depth = 0;
+	for (std::vector<float>* pArray : { &tree.bodyX, &tree.bodyY, &tree.bodyZ }) {
+		pArray->resize(count);
+	}
+	tree.codes.resize(count);
+	tree.codesScratch.resize(count);
+	tree.order.resize(count);
+	tree.orderScratch.resize(count);
+	if (count == 0) {
+		tree.lastBuildMs = 0.f;
+		return;
+	}
+
+	const glm::vec3 origin = glm::vec3(-0.5f * cubeSize, 0.f, -0.5f * cubeSize);
+	const float cellsPerUnit = (1 << BARNES_HUT_MAX_DEPTH) / cubeSize;
+	parallelFor(pool, count, 4096, [&](int begin, int end) {
+		for (int i = begin; i < end; ++i) {
+			tree.codes[i] = mortonCode(system.positionX[i], system.positionY[i], system.positionZ[i], origin, cellsPerUnit);
+			tree.order[i] = i;
+		}
+	});
+	sortByCode(tree, count);
+	parallelFor(pool, count, 4096, [&](int begin, int end) {
+		for (int i = begin; i < end; ++i) {
+			const int particle = tree.order[i];
+			tree.bodyX[i] = system.positionX[particle];
+			tree.bodyY[i] = system.positionY[particle];
+			tree.bodyZ[i] = system.positionZ[particle];
+		}
+	});
+
+	std::vector<SubtreeTask> tasks;
+	std::vector<int> splitNodes;
+	tree.nodes.resize(1);
+	splitTopLevels(tree, 0, 0, count, 0, tasks, splitNodes);
+
+	const int taskCount = static_cast<int>(tasks.size());
+	if (static_cast<int>(tree.subtreeNodes.size()) < taskCount) {
+		tree.subtreeNodes.resize(taskCount);
+	}
+	std::vector<int> taskDepths(taskCount);
+	parallelFor(pool, taskCount, 1, [&](int begin, int end) {
+		for (int t = begin; t < end; ++t) {
+			std::vector<BarnesHutNode>& nodes = tree.subtreeNodes[t];
+			nodes.resize(1);
+			taskDepths[t] = buildNode(tree, nodes, 0, tasks[t].first, tasks[t].count, tasks[t].level);
+		}
+	});
+
+	// Splice the subtrees in: their root replaces the placeholder, the rest is appended
+	for (int t = 0; t < taskCount; ++t) {
+		const std::vector<BarnesHutNode>& nodes = tree.subtreeNodes[t];
+		const int offset = static_cast<int>(tree.nodes.size()) - 1;
+		for (size_t i = 0; i < nodes.size(); ++i) {
+			BarnesHutNode node = nodes[i];
+			node.firstChild = node.firstChild < 0 ? -1 : node.firstChild + offset;
+			if (i == 0) {
+				tree.nodes[tasks[t].nodeIndex] = node;
+			}
+			else {
+				tree.nodes.push_back(node);
+			}
+		}
+		tree.depth = std::max(tree.depth, taskDepths[t]);
+	}
+	for (auto it = splitNodes.rbegin(); it != splitNodes.rend(); ++it) {
+		sumChildren(tree.nodes, *it);
+	}
+
+	tree.lastBuildMs = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - buildStart).count();
+}
+
+glm::vec3 barnesHutAcceleration(const BarnesHutTree& tree, const glm::vec3& position) {
+	int interactions = 0;
+	return accumulateGravity(tree, position, interactions);
+}
+
+glm::vec3 directNBodyAcceleration(const BarnesHutTree& tree, const glm::vec3& position) {
+	const float softeningSq = tree.params.softening * tree.params.softening;
+	glm::vec3 acceleration = glm::vec3(0.f);
+	for (size_t i = 0; i < tree.bodyX.size(); ++i) {
+		const glm::vec3 toBody = glm::vec3(tree.bodyX[i], tree.bodyY[i], tree.bodyZ[i]) - position;
+		const float inverseDistance = 1.f / sqrtf(glm::dot(toBody, toBody) + softeningSq);
+		acceleration += toBody * (tree.bodyMass * inverseDistance * inverseDistance * inverseDistance);
+	}
+	return acceleration;
+}
+
+std::vector<BarnesHutAccuracy> measureBarnesHutAccuracy(BarnesHutTree& tree, const std::vector<float>& thetas, int sampleCount, ThreadPool& pool) {
+	const int bodyCount = static_cast<int>(tree.bodyX.size());
+	sampleCount = std::min(sampleCount, bodyCount);
+	std::vector<glm::vec3> exact(sampleCount);
+	parallelFor(pool, sampleCount, 1, [&](int begin, int end) {
+		for (int s = begin; s < end; ++s) {
+			const int body = static_cast<int>(static_cast<long long>(s) * bodyCount / sampleCount);
+			exact[s] = directNBodyAcceleration(tree, glm::vec3(tree.bodyX[body], tree.bodyY[body], tree.bodyZ[body]));
+		}
+	});
+
+	const BarnesHutParams savedParams = tree.params;
+	std::vector<glm::vec3> accelerations(bodyCount);
+	std::vector<int> interactions(bodyCount);
+	std::vector<BarnesHutAccuracy> results;
+	for (float theta : thetas) {
+		tree.params.theta = theta;
+		const auto forceStart = std::chrono::steady_clock::now();
+		parallelFor(pool, bodyCount, 1024, [&](int begin, int end) {
+			for (int i = begin; i < end; ++i) {
+				interactions[i] = 0;
+				accelerations[i] = accumulateGravity(tree, glm::vec3(tree.bodyX[i], tree.bodyY[i], tree.bodyZ[i]), interactions[i]);
+			}
+		});
+
+		BarnesHutAccuracy accuracy;
+		accuracy.theta = theta;
+		accuracy.forceMs = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - forceStart).count();
+		long long interactionSum = 0;
+		for (int count : interactions) {
+			interactionSum += count;
+		}
+		accuracy.meanInteractions = bodyCount > 0 ? static_cast<float>(interactionSum) / bodyCount : 0.f;
+		double errorSum = 0.0;
+		for (int s = 0; s < sampleCount; ++s) {
+			const int body = static_cast<int>(static_cast<long long>(s) * bodyCount / sampleCount);
+			const float exactLength = glm::length(exact[s]);
+			const float error = exactLength > 0.f ? glm::length(accelerations[body] - exact[s]) / exactLength : 0.f;
+			errorSum += error;
+			accuracy.maxError = std::max(accuracy.maxError, error);
+		}
+		accuracy.meanError = sampleCount > 0 ? static_cast<float>(errorSum / sampleCount) : 0.f;
+		results.push_back(accuracy);
+	}
+	tree.params = savedParams;
+	return results;
+}
@@ -0,0 +1,81 @@
+#pragma once
+
+#include "../threadpool.h"
+#include "ParticleSystem.h"
+
+#include <glm/vec3.hpp>
+#include <stdint.h>
+#include <vector>
+
+constexpr int BARNES_HUT_MAX_DEPTH = 10; // 10 bits per axis in the Morton codes
+
+struct BarnesHutParams {
+	// A cell of edge size seen from distance d is used as a single body when
+	// size < theta * d. 0 is the exact sum.
+	float theta = 0.5f;
+	float softening = 0.05f;
+	// Split evenly between the bodies, so the field does not scale with the count
+	float totalMass = 10.f;
+	int leafSize = 8;
+};
+
+// Leaves own the bodies [firstBody, firstBody + bodyCount) of the tree.
+// Only the non-empty octants of a cell get a child node; they are stored
+// consecutively from firstChild.
+struct BarnesHutNode {
+	glm::vec3 centerOfMass;
+	float mass;
+	float size; // cell edge
+	int firstChild; // -1 for leaves
+	int childCount;
+	int firstBody;
+	int bodyCount;
+};
+
+// Octree over the particle cube, rebuilt from scratch every step. The bodies
+// are copies of the particle positions sorted along the Morton curve, so the
+// tree can be traversed while the particles are being integrated.
+struct BarnesHutTree {
+	BarnesHutParams params;
+	float cubeSize = 0.f;
+	float bodyMass = 0.f;
+
+	std::vector<BarnesHutNode> nodes; // root first
+	std::vector<float> bodyX;
+	std::vector<float> bodyY;
+	std::vector<float> bodyZ;
+
+	// Build scratch, kept between steps
+	std::vector<uint32_t> codes;
+	std::vector<uint32_t> codesScratch;
+	std::vector<int> order;
+	std::vector<int> orderScratch;
+	std::vector<std::vector<BarnesHutNode>> subtreeNodes;
+
+	// Stats
+	float lastBuildMs = 0.f;
+	int depth = 0;
+};
+
+// Subtrees below the first levels are built in parallel. The tree only
+// depends on the positions, not on the thread count.
+void buildBarnesHutTree(BarnesHutTree& tree, const ParticleSystem& system, float cubeSize, ThreadPool& pool);
+
+// Softened gravity of every body at position. Thread safe.
+glm::vec3 barnesHutAcceleration(const BarnesHutTree& tree, const glm::vec3& position);
+
+// O(bodies) reference for barnesHutAcceleration
+glm::vec3 directNBodyAcceleration(const BarnesHutTree& tree, const glm::vec3& position);
+
+struct BarnesHutAccuracy {
+	float theta = 0.f;
+	float forceMs = 0.f; // barnesHutAcceleration for every body
+	float meanInteractions = 0.f;
+	// Relative to the direct sum, over the sampled bodies
+	float meanError = 0.f;
+	float maxError = 0.f;
+};
+
+// Evaluates the tree at every body for each theta, and compares sampleCount
+// evenly spaced bodies against the direct sum. The tree params are restored.
+std::vector<BarnesHutAccuracy> measureBarnesHutAccuracy(BarnesHutTree& tree, const std::vector<float>& thetas, int sampleCount, ThreadPool& pool);
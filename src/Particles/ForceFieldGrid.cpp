@@ -0,0 +1,52 @@
+#include "ForceFieldGrid.h"
+
+#include <assert.h>
+#include <chrono>
+
+bool updateForceField(ForceFieldGrid& grid, const std::vector<Well*>& wells, float strength, float cubeSize, ThreadPool& pool) {
+	assert(grid.resolution >= 2);
+	const int nodeCount = grid.resolution * grid.resolution * grid.resolution;
+	const bool stale = grid.dirty
+		|| grid.cubeSize != cubeSize
+		|| grid.strength != strength
+		|| static_cast<int>(grid.nodes.size()) != nodeCount;
+	if (!stale) {
+		return false;
+	}
+
+	const auto bakeStart = std::chrono::steady_clock::now();
+	grid.cubeSize = cubeSize;
+	grid.strength = strength;
+	grid.nodes.resize(nodeCount);
+
+	// Well data copied once, out of the node loop
+	std::vector<Well> wellCopies;
+	wellCopies.reserve(wells.size());
+	for (const Well* pWell : wells) {
+		wellCopies.push_back(*pWell);
+	}
+
+	const int resolution = grid.resolution;
+	const float spacing = cubeSize / (resolution - 1);
+	const glm::vec3 origin = glm::vec3(-0.5f * cubeSize, 0.f, -0.5f * cubeSize);
+	parallelFor(pool, resolution, 1, [&](int begin, int end) {
+		for (int z = begin; z < end; ++z) {
+			for (int y = 0; y < resolution; ++y) {
+				glm::vec3* pRow = &grid.nodes[(z * resolution + y) * resolution];
+				for (int x = 0; x < resolution; ++x) {
+					const glm::vec3 position = origin + glm::vec3(x, y, z) * spacing;
+					glm::vec3 acceleration = glm::vec3(0.f);
+					for (Well& well : wellCopies) {
+						acceleration += well.GetPullVectorFromPosition(position);
+					}
+					pRow[x] = acceleration * strength;
+				}
+			}
+		}
+	});
+
+	grid.dirty = false;
+	++grid.bakeCount;
+	grid.lastBakeMs = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - bakeStart).count();
+	return true;
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include "../threadpool.h"
+#include "Well.h"
+
+#include <glm/common.hpp>
+#include <glm/vec3.hpp>
+#include <vector>
+
+// Combined well acceleration baked at resolution^3 nodes spanning the particle
+// cube [-cubeSize / 2, cubeSize / 2] x [0, cubeSize] x [-cubeSize / 2, cubeSize / 2].
+// Sampling costs the same whatever the well count; baking costs
+// nodes x wells and only happens when the wells change.
+struct ForceFieldGrid {
+	int resolution = 48;
+	std::vector<glm::vec3> nodes = std::vector<glm::vec3>(); // x fastest, then y, then z
+
+	// What the nodes were baked for
+	float cubeSize = 0.f;
+	float strength = 0.f;
+	bool dirty = true;
+
+	// Stats
+	int bakeCount = 0;
+	float lastBakeMs = 0.f;
+};
+
+// Call after adding, moving or resizing wells
+inline void markForceFieldDirty(ForceFieldGrid& grid) {
+	grid.dirty = true;
+}
+
+// Rebakes when marked dirty or when the cube, strength or resolution changed.
+// Returns true when it did.
+bool updateForceField(ForceFieldGrid& grid, const std::vector<Well*>& wells, float strength, float cubeSize, ThreadPool& pool);
+
+// Trilinear, positions outside the cube are clamped to it
+inline glm::vec3 sampleForceField(const ForceFieldGrid& grid, const glm::vec3& position) {
+	const int last = grid.resolution - 1;
+	const float nodesPerUnit = last / grid.cubeSize;
+	const glm::vec3 local = (position + glm::vec3(0.5f * grid.cubeSize, 0.f, 0.5f * grid.cubeSize)) * nodesPerUnit;
+	const glm::vec3 clamped = glm::clamp(local, glm::vec3(0.f), glm::vec3(static_cast<float>(last)));
+	const glm::ivec3 cell = glm::min(glm::ivec3(clamped), glm::ivec3(last - 1));
+	const glm::vec3 t = clamped - glm::vec3(cell);
+
+	const int strideY = grid.resolution;
+	const int strideZ = grid.resolution * grid.resolution;
+	const glm::vec3* pNode = &grid.nodes[cell.z * strideZ + cell.y * strideY + cell.x];
+	const glm::vec3 x00 = glm::mix(pNode[0], pNode[1], t.x);
+	const glm::vec3 x10 = glm::mix(pNode[strideY], pNode[strideY + 1], t.x);
+	const glm::vec3 x01 = glm::mix(pNode[strideZ], pNode[strideZ + 1], t.x);
+	const glm::vec3 x11 = glm::mix(pNode[strideZ + strideY], pNode[strideZ + strideY + 1], t.x);
+	return glm::mix(glm::mix(x00, x10, t.y), glm::mix(x01, x11, t.y), t.z);
+}
@@ -0,0 +1,151 @@
+#include "ParticleCollisions.h"
+
+#include <glm/common.hpp>
+#include <glm/geometric.hpp>
+#include <algorithm>
+#include <chrono>
+#include <math.h>
+
+namespace {
+	float millisecondsSince(std::chrono::steady_clock::time_point start) {
+		return std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+	}
+
+	// Cells and particle state sorted by cell
+	void buildCollisionGrid(ParticleCollisionGrid& grid, const ParticleSystem& system, float cubeSize, ThreadPool& pool) {
+		const int count = system.count;
+		const float diameter = 2.f * grid.params.radius;
+		grid.cellsPerAxis = glm::clamp(static_cast<int>(cubeSize / diameter), 1, PARTICLE_COLLISION_MAX_CELLS_PER_AXIS);
+		grid.cellSize = cubeSize / grid.cellsPerAxis;
+		const int cellsPerAxis = grid.cellsPerAxis;
+		const int cellCount = cellsPerAxis * cellsPerAxis * cellsPerAxis;
+
+		grid.cellOfParticle.resize(count);
+		grid.sortedParticle.resize(count);
+		for (std::vector<float>* pArray : { &grid.positionX, &grid.positionY, &grid.positionZ,
+			&grid.velocityX, &grid.velocityY, &grid.velocityZ }) {
+			pArray->resize(count);
+		}
+		grid.contactCounts.resize(count);
+		grid.cellStart.assign(cellCount + 1, 0);
+
+		const float cellsPerUnit = 1.f / grid.cellSize;
+		const float halfSize = 0.5f * cubeSize;
+		parallelFor(pool, count, 4096, [&](int begin, int end) {
+			for (int i = begin; i < end; ++i) {
+				const int x = glm::clamp(static_cast<int>((system.positionX[i] + halfSize) * cellsPerUnit), 0, cellsPerAxis - 1);
+				const int y = glm::clamp(static_cast<int>(system.positionY[i] * cellsPerUnit), 0, cellsPerAxis - 1);
+				const int z = glm::clamp(static_cast<int>((system.positionZ[i] + halfSize) * cellsPerUnit), 0, cellsPerAxis - 1);
+				grid.cellOfParticle[i] = (z * cellsPerAxis + y) * cellsPerAxis + x;
+			}
+		});
+
+		// Counting sort: histogram, exclusive prefix sum, scatter
+		for (int i = 0; i < count; ++i) {
+			++grid.cellStart[grid.cellOfParticle[i] + 1];
+		}
+		for (int c = 0; c < cellCount; ++c) {
+			grid.cellStart[c + 1] += grid.cellStart[c];
+		}
+		// Scatter with cellStart[c] as the write cursor of c, which leaves it at
+		// the start of c + 1; shifting back restores the starts
+		for (int i = 0; i < count; ++i) {
+			grid.sortedParticle[grid.cellStart[grid.cellOfParticle[i]]++] = i;
+		}
+		for (int c = cellCount; c > 0; --c) {
+			grid.cellStart[c] = grid.cellStart[c - 1];
+		}
+		grid.cellStart[0] = 0;
+
+		parallelFor(pool, count, 4096, [&](int begin, int end) {
+			for (int slot = begin; slot < end; ++slot) {
+				const int particle = grid.sortedParticle[slot];
+				grid.positionX[slot] = system.positionX[particle];
+				grid.positionY[slot] = system.positionY[particle];
+				grid.positionZ[slot] = system.positionZ[particle];
+				grid.velocityX[slot] = system.velocityX[particle];
+				grid.velocityY[slot] = system.velocityY[particle];
+				grid.velocityZ[slot] = system.velocityZ[particle];
+			}
+		});
+	}
+
+	void resolveContacts(ParticleCollisionGrid& grid, ParticleSystem& system, float cubeSize, int begin, int end) {
+		const int cellsPerAxis = grid.cellsPerAxis;
+		const float diameter = 2.f * grid.params.radius;
+		const float diameterSq = diameter * diameter;
+		const float restitution = grid.params.restitution;
+		const float halfSize = 0.5f * cubeSize;
+		for (int slot = begin; slot < end; ++slot) {
+			const glm::vec3 position = { grid.positionX[slot], grid.positionY[slot], grid.positionZ[slot] };
+			const glm::vec3 velocity = { grid.velocityX[slot], grid.velocityY[slot], grid.velocityZ[slot] };
+			const int particle = grid.sortedParticle[slot];
+			const int cell = grid.cellOfParticle[particle];
+			const int cellX = cell % cellsPerAxis;
+			const int cellY = (cell / cellsPerAxis) % cellsPerAxis;
+			const int cellZ = cell / (cellsPerAxis * cellsPerAxis);
+
+			glm::vec3 positionCorrection = glm::vec3(0.f);
+			glm::vec3 velocityCorrection = glm::vec3(0.f);
+			int contacts = 0;
+			for (int z = std::max(cellZ - 1, 0); z <= std::min(cellZ + 1, cellsPerAxis - 1); ++z) {
+				for (int y = std::max(cellY - 1, 0); y <= std::min(cellY + 1, cellsPerAxis - 1); ++y) {
+					// Cells x - 1 .. x + 1 of a row are contiguous in the sorted order
+					const int rowCell = (z * cellsPerAxis + y) * cellsPerAxis;
+					const int first = grid.cellStart[rowCell + std::max(cellX - 1, 0)];
+					const int last = grid.cellStart[rowCell + std::min(cellX + 1, cellsPerAxis - 1) + 1];
+					for (int other = first; other < last; ++other) {
+						const glm::vec3 offset = position - glm::vec3(grid.positionX[other], grid.positionY[other], grid.positionZ[other]);
+						const float distanceSq = glm::dot(offset, offset);
+						if (distanceSq >= diameterSq || other == slot) {
+							continue;
+						}
+						const float distance = sqrtf(distanceSq);
+						// Coincident particles separate along x, in opposite directions
+						const glm::vec3 normal = distance > 0.f
+							? offset / distance
+							: glm::vec3(slot < other ? 1.f : -1.f, 0.f, 0.f);
+						positionCorrection += normal * (0.5f * (diameter - distance));
+
+						const glm::vec3 otherVelocity = { grid.velocityX[other], grid.velocityY[other], grid.velocityZ[other] };
+						const float approach = glm::dot(velocity - otherVelocity, normal);
+						if (approach < 0.f) {
+							// Equal masses: each side takes half of the impulse
+							velocityCorrection -= normal * (0.5f * (1.f + restitution) * approach);
+						}
+						++contacts;
+					}
+				}
+			}
+
+			const glm::vec3 newPosition = glm::clamp(position + positionCorrection,
+				glm::vec3(-halfSize, 0.f, -halfSize), glm::vec3(halfSize, cubeSize, halfSize));
+			const glm::vec3 newVelocity = velocity + velocityCorrection;
+			system.positionX[particle] = newPosition.x;
+			system.positionY[particle] = newPosition.y;
+			system.positionZ[particle] = newPosition.z;
+			system.velocityX[particle] = newVelocity.x;
+			system.velocityY[particle] = newVelocity.y;
+			system.velocityZ[particle] = newVelocity.z;
+			grid.contactCounts[slot] = contacts;
+		}
+	}
+}
+
+void collideParticles(ParticleCollisionGrid& grid, ParticleSystem& system, float cubeSize, ThreadPool& pool) {
+	const auto broadphaseStart = std::chrono::steady_clock::now();
+	buildCollisionGrid(grid, system, cubeSize, pool);
+	grid.lastBroadphaseMs = millisecondsSince(broadphaseStart);
+
+	const auto narrowphaseStart = std::chrono::steady_clock::now();
+	parallelFor(pool, system.count, 1024, [&](int begin, int end) {
+		resolveContacts(grid, system, cubeSize, begin, end);
+	});
+	int contactSum = 0;
+	for (int contacts : grid.contactCounts) {
+		contactSum += contacts;
+	}
+	// Every contact was seen from both sides
+	grid.lastContactCount = contactSum / 2;
+	grid.lastNarrowphaseMs = millisecondsSince(narrowphaseStart);
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include "../threadpool.h"
+#include "ParticleSystem.h"
+
+#include <vector>
+
+constexpr int PARTICLE_COLLISION_MAX_CELLS_PER_AXIS = 128;
+
+struct ParticleCollisionParams {
+	float radius = 0.1f;
+	// Share of the approaching normal velocity kept after a contact
+	float restitution = 0.5f;
+};
+
+// Uniform grid over the particle cube with cells at least one particle
+// diameter wide, so contacts are only looked for in the 27 surrounding cells.
+// Particles are counting sorted by cell into copies of their state, which the
+// narrow phase reads while writing the resolved state back to the system.
+struct ParticleCollisionGrid {
+	ParticleCollisionParams params;
+	int cellsPerAxis = 0;
+	float cellSize = 0.f;
+
+	std::vector<int> cellOfParticle;
+	std::vector<int> cellStart; // sorted particles of cell c are [cellStart[c], cellStart[c + 1])
+	std::vector<int> sortedParticle; // particle of each sorted slot
+	std::vector<float> positionX;
+	std::vector<float> positionY;
+	std::vector<float> positionZ;
+	std::vector<float> velocityX;
+	std::vector<float> velocityY;
+	std::vector<float> velocityZ;
+	std::vector<int> contactCounts;
+
+	// Stats of the last call
+	float lastBroadphaseMs = 0.f;
+	float lastNarrowphaseMs = 0.f;
+	int lastContactCount = 0;
+};
+
+// One Jacobi pass: every particle is pushed out of the particles it overlaps
+// by half the overlap and loses the approaching part of its relative normal
+// velocity, all against the state at the start of the call. Contacts are
+// resolved on each particle independently, in parallel, and give the same
+// result whatever the thread count.
+void collideParticles(ParticleCollisionGrid& grid, ParticleSystem& system, float cubeSize, ThreadPool& pool);
@@ -0,0 +1,74 @@
+#include "ParticleEmitter.h"
+
+#include <glm/geometric.hpp>
+#include <algorithm>
+
+namespace {
+	// xorshift32, the state lives in the emitter so that emitting stays allocation free
+	float randomUnit(uint32_t& state) {
+		state ^= state << 13;
+		state ^= state >> 17;
+		state ^= state << 5;
+		return (state >> 8) * (1.f / 16777216.f);
+	}
+
+	float randomSigned(uint32_t& state) {
+		return 2.f * randomUnit(state) - 1.f;
+	}
+
+	glm::vec3 randomInBox(uint32_t& state) {
+		const float x = randomSigned(state);
+		const float y = randomSigned(state);
+		const float z = randomSigned(state);
+		return glm::vec3(x, y, z);
+	}
+
+	// Rejection sampling, accepts ~52% of the cube samples
+	glm::vec3 randomInBall(uint32_t& state) {
+		glm::vec3 sample;
+		do {
+			sample = randomInBox(state);
+		} while (glm::dot(sample, sample) > 1.f);
+		return sample;
+	}
+}
+
+const char* getEmitterShapeName(EmitterShape shape) {
+	switch (shape) {
+	case EmitterShape::Point: return "Point";
+	case EmitterShape::Box: return "Box";
+	case EmitterShape::Sphere: return "Sphere";
+	default: return "?";
+	}
+}
+
+int emitParticles(ParticleEmitter& emitter, ParticleSystem& system, float dt) {
+	if (!emitter.enabled) {
+		return 0;
+	}
+	emitter.pending += std::max(emitter.rate, 0.f) * dt;
+	const int requested = static_cast<int>(emitter.pending);
+	emitter.pending -= requested;
+
+	const int first = spawnParticles(system, requested);
+	uint32_t& state = emitter.randomState;
+	for (int i = first; i < system.count; ++i) {
+		glm::vec3 offset = glm::vec3(0.f);
+		switch (emitter.shape) {
+		case EmitterShape::Box:
+			offset = randomInBox(state) * emitter.halfExtent;
+			break;
+		case EmitterShape::Sphere:
+			offset = randomInBall(state) * emitter.halfExtent.x;
+			break;
+		default:
+			break;
+		}
+		const glm::vec3 velocity = emitter.baseVelocity + randomInBall(state) * emitter.velocityJitter;
+		setParticle(system, i, emitter.position + offset, velocity);
+		system.lifetime[i] = emitter.lifetime > 0.f
+			? std::max(emitter.lifetime + randomSigned(state) * emitter.lifetimeJitter, 0.001f)
+			: 0.f;
+	}
+	return system.count - first;
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include "ParticleSystem.h"
+
+#include <glm/vec3.hpp>
+#include <stdint.h>
+
+enum class EmitterShape {
+	Point,
+	Box,
+	Sphere,
+	Count
+};
+
+const char* getEmitterShapeName(EmitterShape shape);
+
+// Spawns particles into a ParticleSystem at a steady rate. Emitting only
+// writes into the system's preallocated arrays, so it never allocates; when
+// the system is full the particles that do not fit are dropped.
+struct ParticleEmitter {
+	EmitterShape shape = EmitterShape::Point;
+	glm::vec3 position = glm::vec3(0.f);
+	glm::vec3 halfExtent = glm::vec3(1.f); // box half size, x is the sphere radius
+	bool enabled = true;
+
+	float rate = 500.f; // particles/s
+	float lifetime = 3.f; // s, 0 lives until killed
+	float lifetimeJitter = 0.5f; // lifetime +- jitter, uniform
+
+	// Initial velocity: baseVelocity plus a uniform sample of the ball of radius velocityJitter
+	glm::vec3 baseVelocity = glm::vec3(0.f, 2.f, 0.f);
+	float velocityJitter = 0.5f;
+
+	// Fraction of a particle carried over between steps
+	float pending = 0.f;
+	uint32_t randomState = 0x9E3779B9u;
+};
+
+// Emits rate * dt particles (carrying the fractional part to the next call)
+// and returns how many were spawned
+int emitParticles(ParticleEmitter& emitter, ParticleSystem& system, float dt);
@@ -0,0 +1,228 @@
+#pragma once
+
+#include "../threadpool.h"
+#include "ParticleSystem.h"
+
+#include <glm/common.hpp>
+#include <glm/geometric.hpp>
+#include <chrono>
+#include <cmath>
+
+// Integrators are policies with a static step(position, velocity,
+// acceleration, dt), where acceleration(position) returns a glm::vec3. The
+// policy is a template argument of the particle loop, so the loop body holds
+// no branch on the integrator. All of them advance positions and velocities
+// by exactly dt.
+
+// v += a(x) dt, then x += v dt. One evaluation, first order, symplectic.
+struct SemiImplicitEuler {
+	static constexpr int accelerationEvaluations = 1;
+
+	template <typename Acceleration>
+	static void step(glm::vec3& position, glm::vec3& velocity, const Acceleration& acceleration, float dt) {
+		velocity += acceleration(position) * dt;
+		position += velocity * dt;
+	}
+};
+
+// Drift half a step, kick with the acceleration there, drift again. One
+// evaluation, second order, symplectic, and no previous position to keep.
+struct PositionVerlet {
+	static constexpr int accelerationEvaluations = 1;
+
+	template <typename Acceleration>
+	static void step(glm::vec3& position, glm::vec3& velocity, const Acceleration& acceleration, float dt) {
+		const glm::vec3 midPosition = position + velocity * (0.5f * dt);
+		velocity += acceleration(midPosition) * dt;
+		position = midPosition + velocity * (0.5f * dt);
+	}
+};
+
+// Classic fourth order Runge-Kutta on (x, v). Four evaluations.
+struct RungeKutta4 {
+	static constexpr int accelerationEvaluations = 4;
+
+	template <typename Acceleration>
+	static void step(glm::vec3& position, glm::vec3& velocity, const Acceleration& acceleration, float dt) {
+		const float halfDt = 0.5f * dt;
+		const glm::vec3 v1 = velocity;
+		const glm::vec3 a1 = acceleration(position);
+		const glm::vec3 v2 = velocity + a1 * halfDt;
+		const glm::vec3 a2 = acceleration(position + v1 * halfDt);
+		const glm::vec3 v3 = velocity + a2 * halfDt;
+		const glm::vec3 a3 = acceleration(position + v2 * halfDt);
+		const glm::vec3 v4 = velocity + a3 * dt;
+		const glm::vec3 a4 = acceleration(position + v3 * dt);
+		position += (v1 + 2.f * v2 + 2.f * v3 + v4) * (dt / 6.f);
+		velocity += (a1 + 2.f * a2 + 2.f * a3 + a4) * (dt / 6.f);
+	}
+};
+
+enum class ParticleIntegrator {
+	SemiImplicitEuler,
+	PositionVerlet,
+	RungeKutta4,
+	Count
+};
+
+inline const char* getParticleIntegratorName(ParticleIntegrator integrator) {
+	switch (integrator) {
+	case ParticleIntegrator::SemiImplicitEuler: return "Semi-implicit Euler";
+	case ParticleIntegrator::PositionVerlet: return "Position Verlet";
+	case ParticleIntegrator::RungeKutta4: return "RK4";
+	default: return "?";
+	}
+}
+
+// Mirrors a coordinate that left [minBound, maxBound] back inside and flips
+// its velocity, with selects rather than branches
+inline void bounceParticleAxis(float& position, float& velocity, float minBound, float maxBound) {
+	const bool below = position < minBound;
+	const bool above = position > maxBound;
+	position = below ? 2.f * minBound - position : position;
+	position = above ? 2.f * maxBound - position : position;
+	velocity = (below | above) ? -velocity : velocity;
+	// A particle faster than the cube in one step still ends up inside
+	position = glm::clamp(position, minBound, maxBound);
+}
+
+// Advances the particles [begin, end) by dt and bounces them inside the cube
+// [-cubeSize / 2, cubeSize / 2] x [0, cubeSize] x [-cubeSize / 2, cubeSize / 2]
+template <typename Integrator, typename Acceleration>
+void integrateParticleRange(ParticleSystem& system, const Acceleration& acceleration, float cubeSize, float dt, int begin, int end) {
+	const float halfSize = 0.5f * cubeSize;
+	float* pPositionX = system.positionX.data();
+	float* pPositionY = system.positionY.data();
+	float* pPositionZ = system.positionZ.data();
+	float* pVelocityX = system.velocityX.data();
+	float* pVelocityY = system.velocityY.data();
+	float* pVelocityZ = system.velocityZ.data();
+	for (int i = begin; i < end; ++i) {
+		glm::vec3 position = { pPositionX[i], pPositionY[i], pPositionZ[i] };
+		glm::vec3 velocity = { pVelocityX[i], pVelocityY[i], pVelocityZ[i] };
+		Integrator::step(position, velocity, acceleration, dt);
+		bounceParticleAxis(position.x, velocity.x, -halfSize, halfSize);
+		bounceParticleAxis(position.y, velocity.y, 0.f, cubeSize);
+		bounceParticleAxis(position.z, velocity.z, -halfSize, halfSize);
+		pPositionX[i] = position.x;
+		pPositionY[i] = position.y;
+		pPositionZ[i] = position.z;
+		pVelocityX[i] = velocity.x;
+		pVelocityY[i] = velocity.y;
+		pVelocityZ[i] = velocity.z;
+	}
+}
+
+template <typename Integrator, typename Acceleration>
+void integrateParticles(ParticleSystem& system, const Acceleration& acceleration, float cubeSize, float dt) {
+	integrateParticleRange<Integrator>(system, acceleration, cubeSize, dt, 0, system.count);
+}
+
+// Same, split across the pool. acceleration is called concurrently and must
+// only read shared state.
+template <typename Integrator, typename Acceleration>
+void integrateParticles(ParticleSystem& system, const Acceleration& acceleration, float cubeSize, float dt, ThreadPool& pool) {
+	parallelFor(pool, system.count, 1024, [&](int begin, int end) {
+		integrateParticleRange<Integrator>(system, acceleration, cubeSize, dt, begin, end);
+	});
+}
+
+// Runtime choice, resolved once per call rather than per particle
+template <typename Acceleration>
+void integrateParticles(ParticleSystem& system, ParticleIntegrator integrator, const Acceleration& acceleration, float cubeSize, float dt) {
+	switch (integrator) {
+	case ParticleIntegrator::SemiImplicitEuler:
+		integrateParticles<SemiImplicitEuler>(system, acceleration, cubeSize, dt);
+		break;
+	case ParticleIntegrator::PositionVerlet:
+		integrateParticles<PositionVerlet>(system, acceleration, cubeSize, dt);
+		break;
+	case ParticleIntegrator::RungeKutta4:
+		integrateParticles<RungeKutta4>(system, acceleration, cubeSize, dt);
+		break;
+	default:
+		break;
+	}
+}
+
+template <typename Acceleration>
+void integrateParticles(ParticleSystem& system, ParticleIntegrator integrator, const Acceleration& acceleration, float cubeSize, float dt, ThreadPool& pool) {
+	switch (integrator) {
+	case ParticleIntegrator::SemiImplicitEuler:
+		integrateParticles<SemiImplicitEuler>(system, acceleration, cubeSize, dt, pool);
+		break;
+	case ParticleIntegrator::PositionVerlet:
+		integrateParticles<PositionVerlet>(system, acceleration, cubeSize, dt, pool);
+		break;
+	case ParticleIntegrator::RungeKutta4:
+		integrateParticles<RungeKutta4>(system, acceleration, cubeSize, dt, pool);
+		break;
+	default:
+		break;
+	}
+}
+
+struct ParticleIntegratorBenchmark {
+	static constexpr int integratorCount = static_cast<int>(ParticleIntegrator::Count);
+	float dt = 0.f;
+	int particleCount = 0;
+	int stepCount = 0;
+	float stepMs[integratorCount] = {};
+	// Position error against RK4 at dt / 4, after stepCount steps
+	float meanError[integratorCount] = {};
+	float maxError[integratorCount] = {};
+	bool stable[integratorCount] = {};
+	// Cheapest integrator whose mean error stays under the tolerance, RK4 when
+	// none does
+	ParticleIntegrator recommended = ParticleIntegrator::RungeKutta4;
+};
+
+// Runs every integrator on copies of system for stepCount steps of dt. A run
+// is stable when every position stays finite and the mean error is below
+// tolerance * cubeSize.
+template <typename Acceleration>
+ParticleIntegratorBenchmark benchmarkParticleIntegrators(const ParticleSystem& system, const Acceleration& acceleration, float cubeSize, float dt, int stepCount, float tolerance) {
+	ParticleIntegratorBenchmark benchmark;
+	benchmark.dt = dt;
+	benchmark.particleCount = system.count;
+	benchmark.stepCount = stepCount;
+
+	ParticleSystem reference = system;
+	for (int step = 0; step < 4 * stepCount; ++step) {
+		integrateParticles<RungeKutta4>(reference, acceleration, cubeSize, 0.25f * dt);
+	}
+
+	float bestMs = 0.f;
+	bool foundStable = false;
+	for (int i = 0; i < ParticleIntegratorBenchmark::integratorCount; ++i) {
+		const ParticleIntegrator integrator = static_cast<ParticleIntegrator>(i);
+		ParticleSystem run = system;
+		const auto runStart = std::chrono::steady_clock::now();
+		for (int step = 0; step < stepCount; ++step) {
+			integrateParticles(run, integrator, acceleration, cubeSize, dt);
+		}
+		const float runMs = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - runStart).count();
+		benchmark.stepMs[i] = stepCount > 0 ? runMs / stepCount : 0.f;
+
+		bool finite = true;
+		double errorSum = 0.0;
+		float maxError = 0.f;
+		for (int p = 0; p < run.count; ++p) {
+			const glm::vec3 position = getParticlePosition(run, p);
+			finite = finite && std::isfinite(position.x) && std::isfinite(position.y) && std::isfinite(position.z);
+			const float error = glm::length(position - getParticlePosition(reference, p));
+			errorSum += error;
+			maxError = glm::max(maxError, error);
+		}
+		benchmark.meanError[i] = run.count > 0 ? static_cast<float>(errorSum / run.count) : 0.f;
+		benchmark.maxError[i] = maxError;
+		benchmark.stable[i] = finite && benchmark.meanError[i] < tolerance * cubeSize;
+
+		if (benchmark.stable[i] && (!foundStable || benchmark.stepMs[i] < bestMs)) {
+			foundStable = true;
+			bestMs = benchmark.stepMs[i];
+			benchmark.recommended = integrator;
+		}
+	}
+	return benchmark;
+}
@@ -0,0 +1,77 @@
+#include "ParticleSystem.h"
+
+#include <algorithm>
+#include <assert.h>
+
+void createParticleSystem(ParticleSystem& system, int capacity) {
+	system.capacity = capacity;
+	system.count = 0;
+	for (std::vector<float>* pArray : { &system.positionX, &system.positionY, &system.positionZ,
+		&system.velocityX, &system.velocityY, &system.velocityZ, &system.age, &system.lifetime }) {
+		pArray->assign(capacity, 0.f);
+	}
+	system.id.assign(capacity, 0);
+	system.nextId = 1;
+	system.spawnedCount = 0;
+	system.expiredCount = 0;
+}
+
+int spawnParticles(ParticleSystem& system, int spawnCount) {
+	const int first = system.count;
+	const int last = std::min(system.count + spawnCount, system.capacity);
+	for (int i = first; i < last; ++i) {
+		setParticle(system, i, glm::vec3(0.f), glm::vec3(0.f));
+		system.age[i] = 0.f;
+		system.lifetime[i] = 0.f;
+		system.id[i] = system.nextId++;
+	}
+	system.spawnedCount += last - first;
+	system.count = last;
+	return first;
+}
+
+void killParticle(ParticleSystem& system, int index) {
+	assert(index >= 0 && index < system.count);
+	const int last = --system.count;
+	system.positionX[index] = system.positionX[last];
+	system.positionY[index] = system.positionY[last];
+	system.positionZ[index] = system.positionZ[last];
+	system.velocityX[index] = system.velocityX[last];
+	system.velocityY[index] = system.velocityY[last];
+	system.velocityZ[index] = system.velocityZ[last];
+	system.age[index] = system.age[last];
+	system.lifetime[index] = system.lifetime[last];
+	system.id[index] = system.id[last];
+}
+
+int expireParticles(ParticleSystem& system, float dt) {
+	int expired = 0;
+	// Backwards, so the particle swapped into a freed slot was already aged
+	for (int i = system.count - 1; i >= 0; --i) {
+		const float age = system.age[i] + dt;
+		system.age[i] = age;
+		if (system.lifetime[i] > 0.f && age >= system.lifetime[i]) {
+			killParticle(system, i);
+			++expired;
+		}
+	}
+	system.expiredCount += expired;
+	return expired;
+}
+
+glm::vec3 getParticlePosition(const ParticleSystem& system, int index) {
+	return { system.positionX[index], system.positionY[index], system.positionZ[index] };
+}
+
+glm::vec3 getParticleVelocity(const ParticleSystem& system, int index) {
+	return { system.velocityX[index], system.velocityY[index], system.velocityZ[index] };
+}
+
+void setParticle(ParticleSystem& system, int index, const glm::vec3& position, const glm::vec3& velocity) {
+	system.positionX[index] = position.x;
+	system.positionY[index] = position.y;
+	system.positionZ[index] = position.z;
+	system.velocityX[index] = velocity.x;
+	system.velocityY[index] = velocity.y;
+	system.velocityZ[index] = velocity.z;
+}
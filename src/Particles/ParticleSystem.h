@@ -0,0 +1,47 @@
+#pragma once
+
+#include <glm/vec3.hpp>
+#include <stdint.h>
+#include <vector>
+
+// Particle state as structure of arrays. Storage is allocated once for
+// capacity particles, spawning and killing never allocate. Live particles are
+// [0, count): killing one moves the last live particle into its slot.
+// Particles with a lifetime expire once their age reaches it, a lifetime of 0
+// lives until killed.
+struct ParticleSystem {
+	int capacity = 0;
+	int count = 0;
+	std::vector<float> positionX;
+	std::vector<float> positionY;
+	std::vector<float> positionZ;
+	std::vector<float> velocityX;
+	std::vector<float> velocityY;
+	std::vector<float> velocityZ;
+	std::vector<float> age;
+	std::vector<float> lifetime;
+	// Unique per spawned particle, never 0, follows the particle when it moves to another slot
+	std::vector<uint32_t> id;
+	uint32_t nextId = 1;
+
+	// Totals since creation
+	int spawnedCount = 0;
+	int expiredCount = 0;
+};
+
+// Drops every particle
+void createParticleSystem(ParticleSystem& system, int capacity);
+
+// Adds up to spawnCount particles (fewer when full) at rest at the origin,
+// without a lifetime, and returns the index of the first one: the new
+// particles are [first, count)
+int spawnParticles(ParticleSystem& system, int spawnCount);
+
+void killParticle(ParticleSystem& system, int index);
+
+// Ages every particle by dt and kills the expired ones, returns how many
+int expireParticles(ParticleSystem& system, float dt);
+
+glm::vec3 getParticlePosition(const ParticleSystem& system, int index);
+glm::vec3 getParticleVelocity(const ParticleSystem& system, int index);
+void setParticle(ParticleSystem& system, int index, const glm::vec3& position, const glm::vec3& velocity);
@@ -9,6 +9,7 @@
 #include <iostream>
 #include <vector>
 #include <time.h>
+#include <chrono>
 #include <imgui.h>
 #include <GLFW/glfw3.h>
 #include <glm/mat4x4.hpp>
@@ -16,7 +17,12 @@
 #include <glm/gtx/euler_angles.hpp>
 #include <glm/gtx/quaternion.hpp>
 #include "../MyViewer.cpp"
-#include "Particle.h"
+#include "BarnesHut.h"
+#include "ForceFieldGrid.h"
+#include "ParticleCollisions.h"
+#include "ParticleEmitter.h"
+#include "ParticleIntegrators.h"
+#include "ParticleSystem.h"
 #include "Well.h"
 
 struct ParticlesViewer : Viewer {
@@ -30,7 +36,35 @@ struct ParticlesViewer : Viewer {
 	float wellStrength;
 	double cachedElapsedTime = 0;
 
-	std::vector<Particle*>particles = std::vector<Particle*>();
+	ParticleSystem particles;
+	int particleCapacity = 100000;
+	ParticleIntegrator integrator = ParticleIntegrator::SemiImplicitEuler;
+	float lastDeltaTime = 1.f / 60.f;
+	ParticleIntegratorBenchmark integratorBenchmark;
+	bool hasIntegratorBenchmark = false;
+	float integratorTolerance = 0.01f; // mean error, relative to the cube size
+	bool autoPickIntegrator = false;
+	// Wells baked into a grid, so the per particle cost does not grow with the well count
+	bool useForceField = true;
+	ForceFieldGrid forceField;
+	// Particles also attract each other, through an octree rebuilt every step
+	bool nBody = false;
+	BarnesHutTree barnesHut;
+	std::vector<BarnesHutAccuracy> barnesHutAccuracy;
+	float lastStepMs = 0.f;
+	std::vector<ParticleEmitter> emitters;
+	bool collideParticlePairs = false;
+	ParticleCollisionGrid collisionGrid;
+	bool showTrails = false;
+	int trailLength = 16; // frames
+	glm::vec4 trailColor = glm::vec4(1.f, .5f, 0.f, .6f);
+	// Below 1, particles go through the sorted translucent pass
+	float particleAlpha = 1.f;
+	// Lives on the GPU, render3D appends one frame to it
+	mutable TrailRing trailRing;
+	// Smoothed over the last frames
+	float spawnedPerSecond = 0.f;
+	float expiredPerSecond = 0.f;
 	std::vector<Well*>wells = std::vector<Well*>();
 
 	VertexShaderAdditionalData additionalShaderData;
@@ -47,12 +81,48 @@ struct ParticlesViewer : Viewer {
 		return (GetRandFloat() - .5) * 2;
 	}
 
-	void AddParticle()
+	void AddParticles(int spawnCount)
 	{
-		particles.push_back(
-			new Particle(
+		const int first = spawnParticles(particles, spawnCount);
+		for (int i = first; i < particles.count; ++i)
+		{
+			setParticle(particles, i,
 				glm::vec3(GetRandSignedFloat() * cubeSize / 2, cubeSize * GetRandFloat(), GetRandSignedFloat() * cubeSize / 2),
-				glm::vec3(GetRandSignedFloat() * .01, GetRandSignedFloat() * .01, GetRandSignedFloat() * .01)));
+				glm::vec3(GetRandSignedFloat() * .6, GetRandSignedFloat() * .6, GetRandSignedFloat() * .6));
+		}
+	}
+
+	void KillRandomParticles(int killCount)
+	{
+		for (int i = 0; i < killCount && particles.count > 0; i++)
+		{
+			killParticle(particles, rand() % particles.count);
+		}
+	}
+
+	void AddEmitter(EmitterShape shape)
+	{
+		ParticleEmitter emitter;
+		emitter.shape = shape;
+		emitter.position = glm::vec3(0.f, cubeSize / 4, 0.f);
+		emitter.halfExtent = glm::vec3(cubeSize / 10);
+		emitter.randomState = static_cast<uint32_t>(rand()) | 1u;
+		emitters.push_back(emitter);
+	}
+
+	void UpdateEmitters(float deltaTime)
+	{
+		const int expired = expireParticles(particles, deltaTime);
+		int spawned = 0;
+		for (ParticleEmitter& emitter : emitters)
+		{
+			spawned += emitParticles(emitter, particles, deltaTime);
+		}
+		if (deltaTime > 0.f)
+		{
+			spawnedPerSecond += 0.05f * (spawned / deltaTime - spawnedPerSecond);
+			expiredPerSecond += 0.05f * (expired / deltaTime - expiredPerSecond);
+		}
 	}
 
 	void AddWell()
@@ -61,17 +131,99 @@ struct ParticlesViewer : Viewer {
 			new Well(
 				glm::vec3(GetRandSignedFloat() * cubeSize / 2, cubeSize * GetRandFloat(), GetRandSignedFloat() * cubeSize / 2),
 				wellSize));
+		markForceFieldDirty(forceField);
+	}
+
+	// Sum of the well pulls, evaluated wherever the integrator asks
+	struct WellAcceleration
+	{
+		const std::vector<Well*>* pWells;
+		float strength;
+
+		glm::vec3 operator()(const glm::vec3& position) const
+		{
+			glm::vec3 acceleration = glm::vec3(0.f);
+			for (Well* well : *pWells)
+			{
+				acceleration += well->GetPullVectorFromPosition(position);
+			}
+			return acceleration * strength;
+		}
+	};
+
+	WellAcceleration GetWellAcceleration() const
+	{
+		return { &wells, wellStrength };
 	}
 
-	glm::vec3 GetParticleExternalForce(Particle* particle) 
+	// Same field, read from the baked grid
+	struct ForceFieldAcceleration
 	{
-		glm::vec3 externalForce = glm::vec3();
-		for each (Well* well  in wells)
+		const ForceFieldGrid* pGrid;
+
+		glm::vec3 operator()(const glm::vec3& position) const
 		{
-			externalForce += well->GetPullVectorFromPosition(particle->GetPosition());
+			return sampleForceField(*pGrid, position);
 		}
+	};
 
-		return glm::vec3(externalForce.x * wellStrength, externalForce.y * wellStrength, externalForce.z * wellStrength);;
+	ForceFieldAcceleration GetForceFieldAcceleration() const
+	{
+		return { &forceField };
+	}
+
+	// Well field plus the pull of every particle, from the last built tree
+	template <typename WellField>
+	struct NBodyAcceleration
+	{
+		WellField wellField;
+		const BarnesHutTree* pTree;
+
+		glm::vec3 operator()(const glm::vec3& position) const
+		{
+			return wellField(position) + barnesHutAcceleration(*pTree, position);
+		}
+	};
+
+	// Calls step(acceleration) with the acceleration of the current settings
+	template <typename Step>
+	void WithAcceleration(const Step& step)
+	{
+		if (useForceField)
+		{
+			// Only rebakes after the wells, cube size or strength changed
+			updateForceField(forceField, wells, wellStrength, cubeSize, threadPool);
+			if (nBody)
+			{
+				step(NBodyAcceleration<ForceFieldAcceleration>{ GetForceFieldAcceleration(), &barnesHut });
+			}
+			else
+			{
+				step(GetForceFieldAcceleration());
+			}
+		}
+		else if (nBody)
+		{
+			step(NBodyAcceleration<WellAcceleration>{ GetWellAcceleration(), &barnesHut });
+		}
+		else
+		{
+			step(GetWellAcceleration());
+		}
+	}
+
+	void BenchmarkIntegrators()
+	{
+		// In N-body mode the bodies stay where the last tree saw them for the whole benchmark
+		WithAcceleration([this](const auto& acceleration)
+		{
+			integratorBenchmark = benchmarkParticleIntegrators(particles, acceleration, cubeSize, lastDeltaTime, 60, integratorTolerance);
+		});
+		hasIntegratorBenchmark = true;
+		if (autoPickIntegrator)
+		{
+			integrator = integratorBenchmark.recommended;
+		}
 	}
 
 	void init() override {
@@ -84,18 +236,19 @@ struct ParticlesViewer : Viewer {
 
 		additionalShaderData.Pos = { 0.,0.,0. };
 		double cachedElapsedTime = 0;
+		createParticleSystem(particles, particleCapacity);
 	}
 
 
 	void update(double elapsedTime) override {
 
-		leftMouseButtonPressed = glfwGetMouseButton(window, GLFW_MOUSE_BUTTON_LEFT) == GLFW_PRESS;
+		leftMouseButtonPressed = isMouseButtonPressed(GLFW_MOUSE_BUTTON_LEFT);
 
-		altKeyPressed = glfwGetKey(window, GLFW_KEY_LEFT_ALT) == GLFW_PRESS || glfwGetKey(window, GLFW_KEY_RIGHT_ALT) == GLFW_PRESS;
+		altKeyPressed = isKeyPressed(GLFW_KEY_LEFT_ALT) || isKeyPressed(GLFW_KEY_RIGHT_ALT);
 
 		double mouseX;
 		double mouseY;
-		glfwGetCursorPos(window, &mouseX, &mouseY);
+		getCursorPos(mouseX, mouseY);
 
 		mousePos = { float(mouseX), viewportHeight - float(mouseY) };
 
@@ -105,11 +258,32 @@ struct ParticlesViewer : Viewer {
 		double deltaTime = elapsedTime - cachedElapsedTime;
 		cachedElapsedTime = elapsedTime;
 
+		// Playing back a point cache replaces the simulation
+		if (nextPointCacheFrame())
+		{
+			return;
+		}
+
 		//apply particle forces
-		for each (Particle * particle in particles)
+		lastDeltaTime = static_cast<float>(deltaTime);
+		UpdateEmitters(lastDeltaTime);
+		const auto stepStart = std::chrono::steady_clock::now();
+		if (nBody)
 		{
-			particle->SetNewPositionFromForce(cubeSize, GetParticleExternalForce(particle), deltaTime);
+			buildBarnesHutTree(barnesHut, particles, cubeSize, threadPool);
 		}
+		WithAcceleration([this](const auto& acceleration)
+		{
+			integrateParticles(particles, integrator, acceleration, cubeSize, lastDeltaTime, threadPool);
+		});
+		if (collideParticlePairs)
+		{
+			collideParticles(collisionGrid, particles, cubeSize, threadPool);
+		}
+		lastStepMs = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - stepStart).count();
+
+		const float* positions[3] = { particles.positionX.data(), particles.positionY.data(), particles.positionZ.data() };
+		recordPointCacheFrame(pointCacheRecorder, positions, 1, particles.count, static_cast<float>(elapsedTime));
 	}
 
 	void render3D_custom(const RenderApi3D& api) const override {
@@ -118,6 +292,18 @@ struct ParticlesViewer : Viewer {
 	}
 
 
+	void DrawParticle(const RenderApi3D& api, const glm::vec3& position) const
+	{
+		if (particleAlpha < 1.f)
+		{
+			api.translucentSphere(position, collisionGrid.params.radius, glm::vec4(1.f, 0.f, 0.f, particleAlpha));
+		}
+		else
+		{
+			api.solidSphere(position, collisionGrid.params.radius, 3, 3, red);
+		}
+	}
+
 	void render3D(const RenderApi3D& api) const override {
 
 		glm::vec3 vertices[24] =
@@ -165,15 +351,57 @@ struct ParticlesViewer : Viewer {
 		api.lines(vertices, 24, glm::vec4(0.5f, 0.5f, 0.5f, 1.f), nullptr);
 
 		//render particles
-		for each (Particle * particle in particles)
+		const bool playingPointCache = isPointCacheOpen(pointCachePlayer);
+		if (playingPointCache)
+		{
+			const float* pX = getPointCacheComponent(pointCachePlayer, 0);
+			const float* pY = getPointCacheComponent(pointCachePlayer, 1);
+			const float* pZ = getPointCacheComponent(pointCachePlayer, 2);
+			for (int i = 0; i < pointCachePlayer.pointCount; ++i)
+			{
+				DrawParticle(api, glm::vec3(pX[i], pY[i], pZ[i]));
+			}
+		}
+		else
 		{
-			api.solidSphere(particle->GetPosition(), .1f, 3, 3, red);
+			for (int i = 0; i < particles.count; ++i)
+			{
+				DrawParticle(api, getParticlePosition(particles, i));
+			}
+		}
+
+		// The cache holds no particle ids to follow
+		if (showTrails && !playingPointCache)
+		{
+			api.trails(trailRing, particles.positionX.data(), particles.positionY.data(), particles.positionZ.data(),
+				particles.id.data(), particles.count, trailLength, trailColor);
 		}
 
 		//Render wells
 		for each (Well * well in wells)
 		{
-			api.solidSphere(well->GetPosition(), well->GetSize(), 10, 10, glm::vec4(0,0,.3,.3));
+			api.translucentSphere(well->GetPosition(), well->GetSize(), glm::vec4(0,0,.3,.3));
+		}
+
+		//Render emitters
+		const glm::vec4 emitterColor = glm::vec4(.3f, .3f, 0.f, .3f);
+		for (const ParticleEmitter& emitter : emitters)
+		{
+			switch (emitter.shape)
+			{
+			case EmitterShape::Box:
+			{
+				const glm::mat4 model = glm::scale(glm::translate(glm::mat4(1.f), emitter.position), 2.f * emitter.halfExtent);
+				api.solidCube(1.f, emitterColor, &model);
+				break;
+			}
+			case EmitterShape::Sphere:
+				api.translucentSphere(emitter.position, emitter.halfExtent.x, emitterColor);
+				break;
+			default:
+				api.translucentSphere(emitter.position, .15f, emitterColor);
+				break;
+			}
 		}
 	}
 
@@ -212,28 +440,113 @@ struct ParticlesViewer : Viewer {
 		ImGui::ColorEdit4("Background color", (float*)&backgroundColor, ImGuiColorEditFlags_NoInputs);
 		ImGui::DragFloat("CubeSize", (float*)&cubeSize);
 
+		ImGui::Text("Particles: %d / %d", particles.count, particles.capacity);
+		// Reallocates and drops every particle, so only once the slider is released
+		ImGui::SliderInt("Particle Capacity", &particleCapacity, 100, 1000000, "%d", ImGuiSliderFlags_Logarithmic);
+		if (ImGui::IsItemDeactivatedAfterEdit())
+		{
+			createParticleSystem(particles, particleCapacity);
+		}
+
 		if (ImGui::Button("Spawn Particle")) 
 		{
-			AddParticle();
+			AddParticles(1);
 		}
 
 		if (ImGui::Button("Spawn 10 Particles"))
 		{
-			for (size_t i = 0; i < 10; i++)
-			{
+			AddParticles(10);
+		}
+
+		if (ImGui::Button("Spawn 100 Particles")) 
+		{
+			AddParticles(100);
+		}
+
+		if (ImGui::Button("Spawn 1000 Particles"))
+		{
+			AddParticles(1000);
+		}
 
-				AddParticle();
+		if (ImGui::Button("Kill 10 Particles"))
+		{
+			KillRandomParticles(10);
+		}
+		int integratorIndex = static_cast<int>(integrator);
+		if (ImGui::Combo("Integrator", &integratorIndex, "Semi-implicit Euler\0Position Verlet\0RK4\0"))
+		{
+			integrator = static_cast<ParticleIntegrator>(integratorIndex);
+		}
+		ImGui::SliderFloat("Integrator Tolerance", &integratorTolerance, 0.0001f, 0.1f, "%.4f", ImGuiSliderFlags_Logarithmic);
+		ImGui::Checkbox("Use Recommended Integrator", &autoPickIntegrator);
+		// 60 steps of each integrator plus the reference, on copies of the particles
+		if (ImGui::Button("Benchmark Integrators"))
+		{
+			BenchmarkIntegrators();
+		}
+		if (hasIntegratorBenchmark)
+		{
+			const ParticleIntegratorBenchmark& benchmark = integratorBenchmark;
+			ImGui::Text("%d particles, dt %.4f s, %d steps, reference RK4 at dt / 4", benchmark.particleCount, benchmark.dt, benchmark.stepCount);
+			for (int i = 0; i < ParticleIntegratorBenchmark::integratorCount; i++)
+			{
+				ImGui::Text("%-20s %.3f ms/step, mean error %.5f, max %.5f%s", getParticleIntegratorName(static_cast<ParticleIntegrator>(i)),
+					benchmark.stepMs[i], benchmark.meanError[i], benchmark.maxError[i], benchmark.stable[i] ? "" : " (unstable)");
 			}
+			ImGui::Text("Recommended: %s", getParticleIntegratorName(benchmark.recommended));
 		}
 
-		if (ImGui::Button("Spawn 100 Particles")) 
+		if (ImGui::CollapsingHeader("Emitters"))
 		{
-			for (size_t i = 0; i < 100; i++)
+			ImGui::Text("Spawned %.0f/s, expired %.0f/s (%d / %d in total)", spawnedPerSecond, expiredPerSecond,
+				particles.spawnedCount, particles.expiredCount);
+			for (int shape = 0; shape < static_cast<int>(EmitterShape::Count); shape++)
 			{
+				if (shape > 0)
+				{
+					ImGui::SameLine();
+				}
+				const std::string label = std::string("Add ") + getEmitterShapeName(static_cast<EmitterShape>(shape));
+				if (ImGui::Button(label.c_str()))
+				{
+					AddEmitter(static_cast<EmitterShape>(shape));
+				}
+			}
 
-				AddParticle();
+			int removeIndex = -1;
+			for (int i = 0; i < static_cast<int>(emitters.size()); i++)
+			{
+				ParticleEmitter& emitter = emitters[i];
+				ImGui::PushID(i);
+				ImGui::Separator();
+				ImGui::Checkbox(getEmitterShapeName(emitter.shape), &emitter.enabled);
+				ImGui::SameLine();
+				if (ImGui::Button("Remove"))
+				{
+					removeIndex = i;
+				}
+				ImGui::DragFloat3("Position", &emitter.position.x, 0.05f);
+				if (emitter.shape == EmitterShape::Box)
+				{
+					ImGui::DragFloat3("Half Extent", &emitter.halfExtent.x, 0.05f, 0.f, cubeSize);
+				}
+				else if (emitter.shape == EmitterShape::Sphere)
+				{
+					ImGui::DragFloat("Radius", &emitter.halfExtent.x, 0.05f, 0.f, cubeSize);
+				}
+				ImGui::SliderFloat("Rate (particles/s)", &emitter.rate, 0.f, 100000.f, "%.0f", ImGuiSliderFlags_Logarithmic);
+				ImGui::SliderFloat("Lifetime (s)", &emitter.lifetime, 0.f, 20.f);
+				ImGui::SliderFloat("Lifetime Jitter", &emitter.lifetimeJitter, 0.f, 5.f);
+				ImGui::DragFloat3("Velocity", &emitter.baseVelocity.x, 0.05f);
+				ImGui::SliderFloat("Velocity Jitter", &emitter.velocityJitter, 0.f, 5.f);
+				ImGui::PopID();
+			}
+			if (removeIndex >= 0)
+			{
+				emitters.erase(emitters.begin() + removeIndex);
 			}
 		}
+
 		ImGui::DragFloat("wellSize", (float*)&wellSize, 0, 3);
 		ImGui::SliderFloat("wellStrength", (float*)&wellStrength, 0, 20);
 
@@ -242,6 +555,56 @@ struct ParticlesViewer : Viewer {
 			AddWell();
 		}
 
+		ImGui::Checkbox("Use Force Field Grid", &useForceField);
+		if (useForceField)
+		{
+			// Resizing the grid rebakes it on the next update
+			ImGui::SliderInt("Force Field Resolution", &forceField.resolution, 8, 128);
+			ImGui::Text("Wells: %d, grid %d^3, %d bakes, last %.3f ms", static_cast<int>(wells.size()),
+				forceField.resolution, forceField.bakeCount, forceField.lastBakeMs);
+		}
+
+		ImGui::Checkbox("N-Body (Barnes-Hut)", &nBody);
+		if (nBody)
+		{
+			BarnesHutParams& params = barnesHut.params;
+			ImGui::SliderFloat("Opening Angle (theta)", &params.theta, 0.f, 1.5f);
+			ImGui::SliderFloat("Softening", &params.softening, 0.001f, 1.f, "%.3f", ImGuiSliderFlags_Logarithmic);
+			ImGui::SliderFloat("Total Mass", &params.totalMass, 0.f, 100.f);
+			ImGui::Text("Tree: %d nodes, depth %d, build %.3f ms", static_cast<int>(barnesHut.nodes.size()), barnesHut.depth, barnesHut.lastBuildMs);
+			// Every body against the tree at each theta, 256 of them against the direct sum
+			if (ImGui::Button("Measure Accuracy vs Theta"))
+			{
+				barnesHutAccuracy = measureBarnesHutAccuracy(barnesHut, { 0.2f, 0.35f, 0.5f, 0.7f, 1.f }, 256, threadPool);
+			}
+			for (const BarnesHutAccuracy& accuracy : barnesHutAccuracy)
+			{
+				ImGui::Text("theta %.2f: %.2f ms, %.0f interactions/body, error mean %.5f max %.5f", accuracy.theta,
+					accuracy.forceMs, accuracy.meanInteractions, accuracy.meanError, accuracy.maxError);
+			}
+		}
+		ImGui::Checkbox("Particle Collisions", &collideParticlePairs);
+		if (collideParticlePairs)
+		{
+			ImGui::SliderFloat("Particle Radius", &collisionGrid.params.radius, 0.01f, 1.f, "%.3f", ImGuiSliderFlags_Logarithmic);
+			ImGui::SliderFloat("Restitution", &collisionGrid.params.restitution, 0.f, 1.f);
+			ImGui::Text("Grid %d^3, %d contacts", collisionGrid.cellsPerAxis, collisionGrid.lastContactCount);
+			ImGui::Text("Broadphase %.3f ms, narrow phase %.3f ms", collisionGrid.lastBroadphaseMs, collisionGrid.lastNarrowphaseMs);
+		}
+		// The history is stale after being hidden
+		if (ImGui::Checkbox("Trails", &showTrails))
+		{
+			clearTrailRing(trailRing);
+		}
+		if (showTrails)
+		{
+			ImGui::SliderInt("Trail Length (frames)", &trailLength, 2, 64);
+			ImGui::ColorEdit4("Trail Color", &trailColor.x, ImGuiColorEditFlags_NoInputs);
+		}
+		ImGui::SliderFloat("Particle Alpha", &particleAlpha, 0.05f, 1.f);
+		ImGui::Text("Step %.3f ms", lastStepMs);
+		drawPointCacheGUI(3);
+
 		ImGui::Text("Application average %.3f ms/frame (%.1f FPS)", 1000.0f / ImGui::GetIO().Framerate, ImGui::GetIO().Framerate);
 
 		ImGui::End();
@@ -27,9 +27,14 @@ float Well::GetSize()
 
 glm::vec3 Well::GetPullVectorFromPosition(glm::vec3 position)
 {
-	float distanceMultiplier = ((float)1 / (wellPosition - position).length()) * size;
-	
-	glm::vec3 normalizedVector = glm::normalize(wellPosition - position);
+	// vec3::length() is the component count, not the distance
+	const glm::vec3 toWell = wellPosition - position;
+	const float distance = glm::length(toWell);
+	if (distance <= 0.f)
+	{
+		return glm::vec3(0.f);
+	}
 
-	return normalizedVector * distanceMultiplier;
+	// Pull of size / distance towards the well
+	return toWell * (size / (distance * distance));
 }
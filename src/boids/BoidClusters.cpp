@@ -0,0 +1,195 @@
+#include "BoidClusters.h"
+
+#include "BoidFlock.h"
+
+#include <glm/common.hpp>
+#include <algorithm>
+#include <chrono>
+
+namespace {
+	constexpr int CLUSTER_CHUNK_SIZE = 512;
+
+	// Path halving: any ancestor stays an ancestor, so racing stores are
+	// harmless
+	int findRoot(std::atomic<int>* pParents, int i) {
+		int parent = pParents[i].load(std::memory_order_relaxed);
+		while (parent != i) {
+			const int grandParent = pParents[parent].load(std::memory_order_relaxed);
+			if (grandParent != parent) {
+				pParents[i].store(grandParent, std::memory_order_relaxed);
+			}
+			i = parent;
+			parent = grandParent;
+		}
+		return i;
+	}
+
+	// The larger root is hooked under the smaller one, retried if another
+	// thread hooked it first
+	void unite(std::atomic<int>* pParents, int a, int b) {
+		for (;;) {
+			a = findRoot(pParents, a);
+			b = findRoot(pParents, b);
+			if (a == b) {
+				return;
+			}
+			if (a < b) {
+				std::swap(a, b);
+			}
+			int expected = a;
+			if (pParents[a].compare_exchange_weak(expected, b, std::memory_order_relaxed)) {
+				return;
+			}
+		}
+	}
+
+	int histogramBin(int size) {
+		int bin = 0;
+		while (size > 1 && bin < BOID_CLUSTER_HISTOGRAM_BINS - 1) {
+			size >>= 1;
+			++bin;
+		}
+		return bin;
+	}
+}
+
+void findBoidClusters(BoidClusters& clusters, const BoidFlock& flock, float visualRange, ThreadPool& pool) {
+	const auto detectionStart = std::chrono::steady_clock::now();
+	const BoidArrays& sorted = flock.sorted;
+	const int count = flock.boids.size();
+	clusters.valid = false;
+	if (flock.lastStepMode == BoidStepMode::Topological || sorted.size() != count) {
+		return;
+	}
+
+	if (clusters.parentCapacity < count) {
+		clusters.parents.reset(new std::atomic<int>[count]);
+		clusters.parentCapacity = count;
+	}
+	std::atomic<int>* pParents = clusters.parents.get();
+	parallelFor(pool, count, CLUSTER_CHUNK_SIZE, [&](int begin, int end) {
+		for (int k = begin; k < end; ++k) {
+			pParents[k].store(k, std::memory_order_relaxed);
+		}
+	});
+
+	// Same pairs as the step, each one once. In-range candidates are first
+	// compacted without branches, about a third of them pass so a branch per
+	// test would mispredict all the time. Pairs already in one cluster, the
+	// common case inside a flock, then cost a root compare.
+	const float visualRangeSq = visualRange * visualRange;
+	const float* xs = sorted.x.data();
+	const float* ys = sorted.y.data();
+	auto uniteNeighbors = [&](int k, int& rootK, int* pNeighbors, int neighborCount) {
+		for (int n = 0; n < neighborCount; ++n) {
+			const int rootJ = findRoot(pParents, pNeighbors[n]);
+			if (rootJ != rootK) {
+				unite(pParents, rootK, rootJ);
+				rootK = findRoot(pParents, rootK);
+			}
+		}
+	};
+	if (flock.lastStepMode == BoidStepMode::VerletLists) {
+		const BoidVerletLists& lists = flock.verletLists;
+		const size_t stride = lists.slots.size() / static_cast<size_t>(std::max(count, 1));
+		parallelFor(pool, count, CLUSTER_CHUNK_SIZE, [&](int begin, int end) {
+			std::vector<int> neighbors(stride);
+			for (int k = begin; k < end; ++k) {
+				const float px = xs[k];
+				const float py = ys[k];
+				const int* pSlots = &lists.slots[k * stride];
+				int neighborCount = 0;
+				for (int n = 0; n < lists.counts[k]; ++n) {
+					const int j = pSlots[n];
+					const float dx = px - xs[j];
+					const float dy = py - ys[j];
+					neighbors[neighborCount] = j;
+					neighborCount += (j > k) & (dx * dx + dy * dy < visualRangeSq);
+				}
+				int rootK = findRoot(pParents, k);
+				uniteNeighbors(k, rootK, neighbors.data(), neighborCount);
+			}
+		});
+	}
+	else {
+		const BoidGrid& grid = flock.grid;
+		parallelFor(pool, count, CLUSTER_CHUNK_SIZE, [&](int begin, int end) {
+			std::vector<int> neighbors;
+			for (int k = begin; k < end; ++k) {
+				const float px = xs[k];
+				const float py = ys[k];
+				int rootK = findRoot(pParents, k);
+				grid.forEachNeighborRange(glm::vec2(px, py), [&](int rangeBegin, int rangeEnd) {
+					const int first = std::max(rangeBegin, k + 1);
+					if (first >= rangeEnd) {
+						return;
+					}
+					if (static_cast<int>(neighbors.size()) < rangeEnd - first) {
+						neighbors.resize(rangeEnd - first);
+					}
+					int neighborCount = 0;
+					for (int j = first; j < rangeEnd; ++j) {
+						const float dx = px - xs[j];
+						const float dy = py - ys[j];
+						neighbors[neighborCount] = j;
+						neighborCount += dx * dx + dy * dy < visualRangeSq;
+					}
+					uniteNeighbors(k, rootK, neighbors.data(), neighborCount);
+				});
+			}
+		});
+	}
+
+	// Sizes per root, serial and linear
+	clusters.sizes.assign(count, 0);
+	for (int k = 0; k < count; ++k) {
+		++clusters.sizes[findRoot(pParents, k)];
+	}
+	clusters.clusterCount = 0;
+	clusters.largestCluster = 0;
+	clusters.singletonCount = 0;
+	std::fill(clusters.histogram, clusters.histogram + BOID_CLUSTER_HISTOGRAM_BINS, 0.f);
+	for (int k = 0; k < count; ++k) {
+		const int size = clusters.sizes[k];
+		if (size == 0) {
+			continue;
+		}
+		++clusters.clusterCount;
+		clusters.largestCluster = std::max(clusters.largestCluster, size);
+		clusters.singletonCount += size == 1 ? 1 : 0;
+		clusters.histogram[histogramBin(size)] += 1.f;
+	}
+	clusters.valid = true;
+	clusters.detectionMs = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - detectionStart).count();
+
+	if (clusters.pLogFile) {
+		fprintf(clusters.pLogFile, "%u,%d,%d,%d,%d", clusters.logStep++, count, clusters.clusterCount, clusters.largestCluster, clusters.singletonCount);
+		for (int bin = 0; bin < BOID_CLUSTER_HISTOGRAM_BINS; ++bin) {
+			fprintf(clusters.pLogFile, ",%d", static_cast<int>(clusters.histogram[bin]));
+		}
+		fprintf(clusters.pLogFile, "\n");
+	}
+}
+
+bool startBoidClusterLog(BoidClusters& clusters, char const* path) {
+	stopBoidClusterLog(clusters);
+	clusters.pLogFile = fopen(path, "w");
+	if (!clusters.pLogFile) {
+		fprintf(stderr, "Failed to open file %s \n", path);
+		return false;
+	}
+	fprintf(clusters.pLogFile, "step,boids,clusters,largest,singletons");
+	for (int bin = 0; bin < BOID_CLUSTER_HISTOGRAM_BINS; ++bin) {
+		fprintf(clusters.pLogFile, ",size_%d", 1 << bin);
+	}
+	fprintf(clusters.pLogFile, "\n");
+	clusters.logStep = 0;
+	return true;
+}
+
+void stopBoidClusterLog(BoidClusters& clusters) {
+	if (clusters.pLogFile) {
+		fclose(clusters.pLogFile);
+		clusters.pLogFile = nullptr;
+	}
+}
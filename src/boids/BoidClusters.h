@@ -0,0 +1,43 @@
+#pragma once
+
+#include "../threadpool.h"
+
+#include <atomic>
+#include <memory>
+#include <stdio.h>
+#include <vector>
+
+struct BoidFlock;
+
+// Cluster sizes 1, 2-3, 4-7, ... the last bin holds everything larger
+constexpr int BOID_CLUSTER_HISTOGRAM_BINS = 16;
+
+// Connected components of the "within visual range" graph, found with a
+// lock-free union-find over the neighbor structure the step just used
+struct BoidClusters {
+	// Union-find forest over the sorted slots, roots are the smallest slot of
+	// their cluster so the result does not depend on the thread count
+	std::unique_ptr<std::atomic<int>[]> parents;
+	int parentCapacity = 0;
+	std::vector<int> sizes; // per root, scratch
+
+	// Results of the last detection
+	bool valid = false;
+	int clusterCount = 0;
+	int largestCluster = 0;
+	int singletonCount = 0;
+	float histogram[BOID_CLUSTER_HISTOGRAM_BINS] = {};
+	float detectionMs = 0.f;
+
+	// CSV stream, one line per detection
+	FILE* pLogFile = nullptr;
+	unsigned int logStep = 0;
+};
+
+// Uses the grid or the Verlet lists of the last stepBoidFlock, whichever it
+// used, with positions at the start of that step. After a topological step
+// there is no range based structure and the clusters are marked invalid.
+void findBoidClusters(BoidClusters& clusters, const BoidFlock& flock, float visualRange, ThreadPool& pool);
+
+bool startBoidClusterLog(BoidClusters& clusters, char const* path);
+void stopBoidClusterLog(BoidClusters& clusters);
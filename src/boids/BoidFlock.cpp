@@ -0,0 +1,717 @@
+#include "BoidFlock.h"
+
+#include <glm/geometric.hpp>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <stdint.h>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define BOIDS_HAS_AVX2_KERNEL 1
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+// MSVC accepts AVX2 intrinsics in any function
+#define BOIDS_AVX2_TARGET
+#else
+#include <cpuid.h>
+#define BOIDS_AVX2_TARGET __attribute__((target("avx2,fma")))
+#endif
+#else
+#define BOIDS_HAS_AVX2_KERNEL 0
+#endif
+
+namespace {
+	struct NeighborSums {
+		float centerX = 0.f;
+		float centerY = 0.f;
+		float velocityX = 0.f;
+		float velocityY = 0.f;
+		float moveX = 0.f;
+		float moveY = 0.f;
+		int count = 0;
+	};
+
+	struct NeighborQuery {
+		const float* xs;
+		const float* ys;
+		const float* vxs;
+		const float* vys;
+		float px;
+		float py;
+		float visualRangeSq;
+		float separationDistanceSq;
+	};
+
+	using AccumulateNeighborsFn = void(const NeighborQuery& query, int begin, int end, NeighborSums& sums);
+
+	void accumulateNeighborsScalar(const NeighborQuery& query, int begin, int end, NeighborSums& sums) {
+		for (int k = begin; k < end; ++k) {
+			const float dx = query.px - query.xs[k];
+			const float dy = query.py - query.ys[k];
+			const float distanceSq = dx * dx + dy * dy;
+			if (distanceSq < query.visualRangeSq) {
+				sums.centerX += query.xs[k];
+				sums.centerY += query.ys[k];
+				sums.velocityX += query.vxs[k];
+				sums.velocityY += query.vys[k];
+				sums.count += 1;
+			}
+			if (distanceSq < query.separationDistanceSq) {
+				sums.moveX += dx;
+				sums.moveY += dy;
+			}
+		}
+	}
+
+	using AccumulateListFn = void(const NeighborQuery& query, const int* pSlots, int slotCount, NeighborSums& sums);
+
+	void accumulateListScalar(const NeighborQuery& query, const int* pSlots, int slotCount, NeighborSums& sums) {
+		for (int n = 0; n < slotCount; ++n) {
+			const int k = pSlots[n];
+			const float dx = query.px - query.xs[k];
+			const float dy = query.py - query.ys[k];
+			const float distanceSq = dx * dx + dy * dy;
+			if (distanceSq < query.visualRangeSq) {
+				sums.centerX += query.xs[k];
+				sums.centerY += query.ys[k];
+				sums.velocityX += query.vxs[k];
+				sums.velocityY += query.vys[k];
+				sums.count += 1;
+			}
+			if (distanceSq < query.separationDistanceSq) {
+				sums.moveX += dx;
+				sums.moveY += dy;
+			}
+		}
+	}
+
+#if BOIDS_HAS_AVX2_KERNEL
+	BOIDS_AVX2_TARGET inline float horizontalSum(__m256 v) {
+		__m128 sum = _mm_add_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+		sum = _mm_add_ps(sum, _mm_movehl_ps(sum, sum));
+		sum = _mm_add_ss(sum, _mm_shuffle_ps(sum, sum, 1));
+		return _mm_cvtss_f32(sum);
+	}
+
+	// Tests 8 boid pairs per iteration, the tail is loaded with a lane mask
+	BOIDS_AVX2_TARGET void accumulateNeighborsAvx2(const NeighborQuery& query, int begin, int end, NeighborSums& sums) {
+		const __m256 px = _mm256_set1_ps(query.px);
+		const __m256 py = _mm256_set1_ps(query.py);
+		const __m256 visualRangeSq = _mm256_set1_ps(query.visualRangeSq);
+		const __m256 separationDistanceSq = _mm256_set1_ps(query.separationDistanceSq);
+		const __m256 one = _mm256_set1_ps(1.f);
+		const __m256i laneIndex = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+
+		__m256 centerX = _mm256_setzero_ps();
+		__m256 centerY = _mm256_setzero_ps();
+		__m256 velocityX = _mm256_setzero_ps();
+		__m256 velocityY = _mm256_setzero_ps();
+		__m256 moveX = _mm256_setzero_ps();
+		__m256 moveY = _mm256_setzero_ps();
+		__m256 count = _mm256_setzero_ps();
+
+		for (int k = begin; k < end; k += 8) {
+			__m256 x, y, vx, vy, valid;
+			if (k + 8 <= end) {
+				x = _mm256_loadu_ps(query.xs + k);
+				y = _mm256_loadu_ps(query.ys + k);
+				vx = _mm256_loadu_ps(query.vxs + k);
+				vy = _mm256_loadu_ps(query.vys + k);
+				valid = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+			}
+			else {
+				const __m256i tail = _mm256_cmpgt_epi32(_mm256_set1_epi32(end - k), laneIndex);
+				x = _mm256_maskload_ps(query.xs + k, tail);
+				y = _mm256_maskload_ps(query.ys + k, tail);
+				vx = _mm256_maskload_ps(query.vxs + k, tail);
+				vy = _mm256_maskload_ps(query.vys + k, tail);
+				valid = _mm256_castsi256_ps(tail);
+			}
+
+			const __m256 dx = _mm256_sub_ps(px, x);
+			const __m256 dy = _mm256_sub_ps(py, y);
+			const __m256 distanceSq = _mm256_fmadd_ps(dx, dx, _mm256_mul_ps(dy, dy));
+			const __m256 inRange = _mm256_and_ps(_mm256_cmp_ps(distanceSq, visualRangeSq, _CMP_LT_OQ), valid);
+			const __m256 tooClose = _mm256_and_ps(_mm256_cmp_ps(distanceSq, separationDistanceSq, _CMP_LT_OQ), valid);
+
+			centerX = _mm256_add_ps(centerX, _mm256_and_ps(inRange, x));
+			centerY = _mm256_add_ps(centerY, _mm256_and_ps(inRange, y));
+			velocityX = _mm256_add_ps(velocityX, _mm256_and_ps(inRange, vx));
+			velocityY = _mm256_add_ps(velocityY, _mm256_and_ps(inRange, vy));
+			count = _mm256_add_ps(count, _mm256_and_ps(inRange, one));
+			moveX = _mm256_add_ps(moveX, _mm256_and_ps(tooClose, dx));
+			moveY = _mm256_add_ps(moveY, _mm256_and_ps(tooClose, dy));
+		}
+
+		sums.centerX += horizontalSum(centerX);
+		sums.centerY += horizontalSum(centerY);
+		sums.velocityX += horizontalSum(velocityX);
+		sums.velocityY += horizontalSum(velocityY);
+		sums.moveX += horizontalSum(moveX);
+		sums.moveY += horizontalSum(moveY);
+		sums.count += static_cast<int>(horizontalSum(count));
+	}
+
+	// Same as accumulateNeighborsAvx2, with the boids gathered from a list
+	BOIDS_AVX2_TARGET void accumulateListAvx2(const NeighborQuery& query, const int* pSlots, int slotCount, NeighborSums& sums) {
+		const __m256 px = _mm256_set1_ps(query.px);
+		const __m256 py = _mm256_set1_ps(query.py);
+		const __m256 visualRangeSq = _mm256_set1_ps(query.visualRangeSq);
+		const __m256 separationDistanceSq = _mm256_set1_ps(query.separationDistanceSq);
+		const __m256 one = _mm256_set1_ps(1.f);
+		const __m256i laneIndex = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+
+		__m256 centerX = _mm256_setzero_ps();
+		__m256 centerY = _mm256_setzero_ps();
+		__m256 velocityX = _mm256_setzero_ps();
+		__m256 velocityY = _mm256_setzero_ps();
+		__m256 moveX = _mm256_setzero_ps();
+		__m256 moveY = _mm256_setzero_ps();
+		__m256 count = _mm256_setzero_ps();
+
+		for (int n = 0; n < slotCount; n += 8) {
+			const __m256i tail = _mm256_cmpgt_epi32(_mm256_set1_epi32(slotCount - n), laneIndex);
+			const __m256i slots = _mm256_maskload_epi32(pSlots + n, tail);
+			const __m256 valid = _mm256_castsi256_ps(tail);
+			const __m256 zero = _mm256_setzero_ps();
+			const __m256 x = _mm256_mask_i32gather_ps(zero, query.xs, slots, valid, 4);
+			const __m256 y = _mm256_mask_i32gather_ps(zero, query.ys, slots, valid, 4);
+			const __m256 vx = _mm256_mask_i32gather_ps(zero, query.vxs, slots, valid, 4);
+			const __m256 vy = _mm256_mask_i32gather_ps(zero, query.vys, slots, valid, 4);
+
+			const __m256 dx = _mm256_sub_ps(px, x);
+			const __m256 dy = _mm256_sub_ps(py, y);
+			const __m256 distanceSq = _mm256_fmadd_ps(dx, dx, _mm256_mul_ps(dy, dy));
+			const __m256 inRange = _mm256_and_ps(_mm256_cmp_ps(distanceSq, visualRangeSq, _CMP_LT_OQ), valid);
+			const __m256 tooClose = _mm256_and_ps(_mm256_cmp_ps(distanceSq, separationDistanceSq, _CMP_LT_OQ), valid);
+
+			centerX = _mm256_add_ps(centerX, _mm256_and_ps(inRange, x));
+			centerY = _mm256_add_ps(centerY, _mm256_and_ps(inRange, y));
+			velocityX = _mm256_add_ps(velocityX, _mm256_and_ps(inRange, vx));
+			velocityY = _mm256_add_ps(velocityY, _mm256_and_ps(inRange, vy));
+			count = _mm256_add_ps(count, _mm256_and_ps(inRange, one));
+			moveX = _mm256_add_ps(moveX, _mm256_and_ps(tooClose, dx));
+			moveY = _mm256_add_ps(moveY, _mm256_and_ps(tooClose, dy));
+		}
+
+		sums.centerX += horizontalSum(centerX);
+		sums.centerY += horizontalSum(centerY);
+		sums.velocityX += horizontalSum(velocityX);
+		sums.velocityY += horizontalSum(velocityY);
+		sums.moveX += horizontalSum(moveX);
+		sums.moveY += horizontalSum(moveY);
+		sums.count += static_cast<int>(horizontalSum(count));
+	}
+#endif
+
+	bool detectAvx2() {
+#if BOIDS_HAS_AVX2_KERNEL
+#if defined(_MSC_VER)
+		int info[4];
+		__cpuid(info, 0);
+		if (info[0] < 7) {
+			return false;
+		}
+		__cpuid(info, 1);
+		const bool osxsave = (info[2] & (1 << 27)) != 0;
+		const bool fma = (info[2] & (1 << 12)) != 0;
+		if (!osxsave || !fma || (_xgetbv(0) & 0x6) != 0x6) {
+			return false;
+		}
+		__cpuidex(info, 7, 0);
+		return (info[1] & (1 << 5)) != 0;
+#else
+		return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+#endif
+#else
+		return false;
+#endif
+	}
+
+	constexpr int BOIDS_CHUNK_SIZE = 512;
+
+	void gatherSortedState(BoidFlock& flock, ThreadPool& pool) {
+		const BoidArrays& boids = flock.boids;
+		const std::vector<int>& sortedItems = flock.grid.sortedItems;
+		flock.sorted.resize(boids.size());
+		BoidArrays& sorted = flock.sorted;
+		parallelFor(pool, boids.size(), BOIDS_CHUNK_SIZE, [&](int begin, int end) {
+			for (int k = begin; k < end; ++k) {
+				const int i = sortedItems[k];
+				sorted.x[k] = boids.x[i];
+				sorted.y[k] = boids.y[i];
+				sorted.vx[k] = boids.vx[i];
+				sorted.vy[k] = boids.vy[i];
+			}
+		});
+	}
+
+	void buildGrid(BoidFlock& flock, float range, const BoidFlockParams& params) {
+		BoidArrays& boids = flock.boids;
+		// The query range and the separation distance must fit in one cell
+		const float cellSize = std::max(range, params.separationDistance);
+		flock.grid.build(boids.size(), [&boids](int i) { return glm::vec2(boids.x[i], boids.y[i]); }, params.width, params.height, cellSize);
+	}
+
+	// Applies the rules to one boid, sums include the boid itself when
+	// selfIncluded is set. Returns the new velocity.
+	glm::vec2 steerBoid(const BoidFlockParams& params, const glm::vec2& position, const glm::vec2& initialVelocity, const NeighborSums& sums, bool selfIncluded) {
+		const float centeringFactor = 0.01f * params.coherence; // adjust velocity by this %
+		const float avoidFactor = 0.1f * params.separation; // Adjust velocity by this %
+		const float matchingFactor = 0.1f * params.alignment;
+		const float margin = 50.f;
+		const float turnFactor = 1.f;
+
+		glm::vec2 velocity = initialVelocity;
+
+		// Cohesion
+		if (sums.count) {
+			const glm::vec2 center = glm::vec2(sums.centerX, sums.centerY) / static_cast<float>(sums.count);
+			velocity += (center - position) * centeringFactor;
+		}
+
+		// Separation, the boid itself adds a null offset
+		velocity += glm::vec2(sums.moveX, sums.moveY) * avoidFactor;
+
+		// Alignment, the boid contributes the velocity it has at this point
+		if (sums.count) {
+			glm::vec2 velocitySum = { sums.velocityX, sums.velocityY };
+			if (selfIncluded) {
+				velocitySum += velocity - initialVelocity;
+			}
+			const glm::vec2 averageVelocity = velocitySum / static_cast<float>(sums.count);
+			velocity += (averageVelocity - velocity) * matchingFactor;
+		}
+
+		// Speed limit
+		const float speed = glm::length(velocity);
+		if (speed > params.speedLimit) {
+			velocity = (velocity / speed) * params.speedLimit;
+		}
+
+		// Keep within bounds
+		if (position.x < margin) {
+			velocity.x += turnFactor;
+		}
+		if (position.x > params.width - margin) {
+			velocity.x -= turnFactor;
+		}
+		if (position.y < margin) {
+			velocity.y += turnFactor;
+		}
+		if (position.y > params.height - margin) {
+			velocity.y -= turnFactor;
+		}
+
+		// Obstacles, one field sample whatever their count
+		if (params.pObstacles && params.obstacleMargin > 0.f) {
+			float distance;
+			glm::vec2 gradient;
+			sampleObstacleField(*params.pObstacles, position, distance, gradient);
+			if (distance < params.obstacleMargin) {
+				velocity += gradient * (params.obstacleAvoidance * (1.f - distance / params.obstacleMargin));
+			}
+		}
+
+		return velocity;
+	}
+
+	NeighborQuery makeQuery(const BoidArrays& sorted, const BoidFlockParams& params) {
+		NeighborQuery query;
+		query.xs = sorted.x.data();
+		query.ys = sorted.y.data();
+		query.vxs = sorted.vx.data();
+		query.vys = sorted.vy.data();
+		query.px = 0.f;
+		query.py = 0.f;
+		query.visualRangeSq = params.visualRange * params.visualRange;
+		query.separationDistanceSq = params.separationDistance * params.separationDistance;
+		return query;
+	}
+
+	void stepWithGrid(BoidFlock& flock, const BoidFlockParams& params, ThreadPool& pool) {
+		BoidArrays& boids = flock.boids;
+		buildGrid(flock, params.visualRange, params);
+		gatherSortedState(flock, pool);
+
+		AccumulateNeighborsFn* accumulateNeighbors = accumulateNeighborsScalar;
+#if BOIDS_HAS_AVX2_KERNEL
+		if (params.allowAvx2 && isAvx2Supported()) {
+			accumulateNeighbors = accumulateNeighborsAvx2;
+		}
+#endif
+		flock.usedAvx2 = accumulateNeighbors != accumulateNeighborsScalar;
+
+		const BoidArrays& sorted = flock.sorted;
+		const std::vector<int>& sortedItems = flock.grid.sortedItems;
+		const NeighborQuery sharedQuery = makeQuery(sorted, params);
+
+		// Walking in cell order keeps the neighbor ranges of consecutive boids hot
+		parallelFor(pool, boids.size(), BOIDS_CHUNK_SIZE, [&](int begin, int end) {
+			NeighborQuery query = sharedQuery;
+			for (int k = begin; k < end; ++k) {
+				const int i = sortedItems[k];
+				const glm::vec2 position = { sorted.x[k], sorted.y[k] };
+				const glm::vec2 initialVelocity = { sorted.vx[k], sorted.vy[k] };
+
+				query.px = position.x;
+				query.py = position.y;
+				NeighborSums sums;
+				flock.grid.forEachNeighborRange(position, [&](int rangeBegin, int rangeEnd) {
+					accumulateNeighbors(query, rangeBegin, rangeEnd, sums);
+				});
+				boids.neighborCount[i] = sums.count;
+
+				const glm::vec2 velocity = steerBoid(params, position, initialVelocity, sums, params.visualRange > 0.f);
+				const glm::vec2 newPosition = position + velocity * params.speed;
+				boids.x[i] = newPosition.x;
+				boids.y[i] = newPosition.y;
+				boids.vx[i] = velocity.x;
+				boids.vy[i] = velocity.y;
+			}
+		});
+	}
+
+	// One spare slot per list for the branch free append
+	int verletListStride(const BoidVerletLists& lists) {
+		return lists.capacity + 1;
+	}
+
+	// Lists hold slots of the sorted copy. The cell order of the last build is
+	// kept until the next one, so the slots stay valid in between.
+	void buildVerletLists(BoidFlock& flock, float listRange, const BoidFlockParams& params, ThreadPool& pool) {
+		BoidVerletLists& lists = flock.verletLists;
+		const int count = flock.boids.size();
+		buildGrid(flock, listRange, params);
+		gatherSortedState(flock, pool);
+
+		const BoidArrays& sorted = flock.sorted;
+		const float listRangeSq = listRange * listRange;
+		const int capacity = lists.capacity;
+		const int stride = verletListStride(lists);
+		lists.slots.resize(static_cast<size_t>(count) * stride);
+		lists.counts.resize(count);
+		lists.anchorX = sorted.x;
+		lists.anchorY = sorted.y;
+		lists.range = listRange;
+
+		std::vector<int> chunkOverflows((count + BOIDS_CHUNK_SIZE - 1) / BOIDS_CHUNK_SIZE, 0);
+		parallelFor(pool, count, BOIDS_CHUNK_SIZE, [&](int begin, int end) {
+			int overflows = 0;
+			for (int k = begin; k < end; ++k) {
+				const glm::vec2 position = { sorted.x[k], sorted.y[k] };
+				int* pSlots = &lists.slots[static_cast<size_t>(k) * stride];
+				int listCount = 0;
+				flock.grid.forEachNeighborRange(position, [&](int rangeBegin, int rangeEnd) {
+					for (int j = rangeBegin; j < rangeEnd; ++j) {
+						const float dx = position.x - sorted.x[j];
+						const float dy = position.y - sorted.y[j];
+						// Branch free append, a full list keeps overwriting its spare slot
+						pSlots[std::min(listCount, capacity)] = j;
+						listCount += dx * dx + dy * dy < listRangeSq ? 1 : 0;
+					}
+				});
+				overflows += std::max(listCount - capacity, 0);
+				lists.counts[k] = std::min(listCount, capacity);
+			}
+			chunkOverflows[begin / BOIDS_CHUNK_SIZE] = overflows;
+		});
+
+		lists.overflowCount = 0;
+		for (int overflows : chunkOverflows) {
+			lists.overflowCount += overflows;
+		}
+		lists.valid = true;
+		++lists.rebuildCount;
+	}
+
+	// Returns the largest squared distance between a boid and its position at
+	// the last list build
+	float stepWithVerletLists(BoidFlock& flock, const BoidFlockParams& params, ThreadPool& pool) {
+		BoidArrays& boids = flock.boids;
+		const BoidVerletLists& lists = flock.verletLists;
+		const int count = boids.size();
+
+		AccumulateListFn* accumulateList = accumulateListScalar;
+#if BOIDS_HAS_AVX2_KERNEL
+		if (params.allowAvx2 && isAvx2Supported()) {
+			accumulateList = accumulateListAvx2;
+		}
+#endif
+		flock.usedAvx2 = accumulateList != accumulateListScalar;
+
+		const BoidArrays& sorted = flock.sorted;
+		const std::vector<int>& sortedItems = flock.grid.sortedItems;
+		const NeighborQuery sharedQuery = makeQuery(sorted, params);
+		const int stride = verletListStride(lists);
+
+		std::vector<float> chunkMaxDisplacementSq((count + BOIDS_CHUNK_SIZE - 1) / BOIDS_CHUNK_SIZE, 0.f);
+		parallelFor(pool, count, BOIDS_CHUNK_SIZE, [&](int begin, int end) {
+			NeighborQuery query = sharedQuery;
+			float maxDisplacementSq = 0.f;
+			for (int k = begin; k < end; ++k) {
+				const int i = sortedItems[k];
+				const glm::vec2 position = { sorted.x[k], sorted.y[k] };
+				const glm::vec2 initialVelocity = { sorted.vx[k], sorted.vy[k] };
+
+				query.px = position.x;
+				query.py = position.y;
+				NeighborSums sums;
+				accumulateList(query, &lists.slots[static_cast<size_t>(k) * stride], lists.counts[k], sums);
+				boids.neighborCount[i] = sums.count;
+
+				const glm::vec2 velocity = steerBoid(params, position, initialVelocity, sums, params.visualRange > 0.f);
+				const glm::vec2 newPosition = position + velocity * params.speed;
+				boids.x[i] = newPosition.x;
+				boids.y[i] = newPosition.y;
+				boids.vx[i] = velocity.x;
+				boids.vy[i] = velocity.y;
+
+				const glm::vec2 displacement = newPosition - glm::vec2(lists.anchorX[k], lists.anchorY[k]);
+				maxDisplacementSq = std::max(maxDisplacementSq, glm::dot(displacement, displacement));
+			}
+			chunkMaxDisplacementSq[begin / BOIDS_CHUNK_SIZE] = maxDisplacementSq;
+		});
+
+		float maxDisplacementSq = 0.f;
+		for (float displacementSq : chunkMaxDisplacementSq) {
+			maxDisplacementSq = std::max(maxDisplacementSq, displacementSq);
+		}
+		return maxDisplacementSq;
+	}
+
+	void stepVerlet(BoidFlock& flock, const BoidFlockParams& params, ThreadPool& pool) {
+		BoidVerletLists& lists = flock.verletLists;
+		lists.rebuiltLastStep = false;
+		// A pair within range now was within range + skin at the last build as
+		// long as no boid moved by more than skin / 2 since
+		const float listRange = std::max(params.visualRange, params.separationDistance) + params.verletSkin;
+		const bool stale = !lists.valid
+			|| lists.counts.size() != flock.boids.x.size()
+			|| lists.slots.size() != flock.boids.x.size() * verletListStride(lists)
+			|| lists.range != listRange
+			|| lists.maxDisplacement > 0.5f * params.verletSkin;
+		if (stale) {
+			buildVerletLists(flock, listRange, params, pool);
+			lists.rebuiltLastStep = true;
+		}
+		else {
+			gatherSortedState(flock, pool);
+		}
+		lists.maxDisplacement = std::sqrt(stepWithVerletLists(flock, params, pool));
+		++lists.stepCount;
+	}
+
+	uint32_t spreadBits(uint32_t v) {
+		v &= 0xffff;
+		v = (v | (v << 8)) & 0x00ff00ff;
+		v = (v | (v << 4)) & 0x0f0f0f0f;
+		v = (v | (v << 2)) & 0x33333333;
+		v = (v | (v << 1)) & 0x55555555;
+		return v;
+	}
+
+	uint32_t mortonCode(int x, int y) {
+		return spreadBits(static_cast<uint32_t>(x)) | (spreadBits(static_cast<uint32_t>(y)) << 1);
+	}
+
+	// Line jumps along the order in which the step visits boids, see
+	// BoidReorderStats
+	int estimateGatherMisses(const std::vector<int>& order) {
+		constexpr int floatsPerLine = 64 / sizeof(float);
+		int jumps = order.empty() ? 0 : 1;
+		for (size_t k = 1; k < order.size(); ++k) {
+			jumps += order[k] / floatsPerLine != order[k - 1] / floatsPerLine ? 1 : 0;
+		}
+		return 5 * jumps;
+	}
+
+	// Moves boids of a cell next to each other, and cells close in space close
+	// in memory. The grid already groups boids by cell, so this only walks its
+	// cells in Morton order.
+	void reorderBoids(BoidFlock& flock, const BoidFlockParams& params, ThreadPool& pool) {
+		const auto reorderStart = std::chrono::steady_clock::now();
+		BoidArrays& boids = flock.boids;
+		const int count = boids.size();
+		buildGrid(flock, params.visualRange, params);
+		const BoidGrid& grid = flock.grid;
+		flock.reorder.estimatedMissesBeforeReorder = estimateGatherMisses(grid.sortedItems);
+
+		// Code in the high bits, cell in the low bits
+		std::vector<uint64_t> cellKeys(grid.cellCount());
+		for (int cy = 0; cy < grid.cellCountY; ++cy) {
+			for (int cx = 0; cx < grid.cellCountX; ++cx) {
+				const int cell = cy * grid.cellCountX + cx;
+				cellKeys[cell] = (static_cast<uint64_t>(mortonCode(cx, cy)) << 32) | static_cast<uint32_t>(cell);
+			}
+		}
+		std::sort(cellKeys.begin(), cellKeys.end());
+
+		std::vector<int> newOrder;
+		newOrder.reserve(count);
+		for (const uint64_t key : cellKeys) {
+			const int cell = static_cast<int>(key & 0xffffffffu);
+			newOrder.insert(newOrder.end(), grid.sortedItems.begin() + grid.cellStart[cell], grid.sortedItems.begin() + grid.cellStart[cell + 1]);
+		}
+
+		// sorted is scratch until the step gathers into it again
+		BoidArrays& reordered = flock.sorted;
+		reordered.resize(count);
+		parallelFor(pool, count, BOIDS_CHUNK_SIZE, [&](int begin, int end) {
+			for (int k = begin; k < end; ++k) {
+				const int i = newOrder[k];
+				reordered.x[k] = boids.x[i];
+				reordered.y[k] = boids.y[i];
+				reordered.vx[k] = boids.vx[i];
+				reordered.vy[k] = boids.vy[i];
+				reordered.neighborCount[k] = boids.neighborCount[i];
+				reordered.id[k] = boids.id[i];
+			}
+		});
+		std::swap(boids, reordered);
+
+		flock.idToIndex.resize(count);
+		for (int k = 0; k < count; ++k) {
+			flock.idToIndex[boids.id[k]] = k;
+		}
+
+		// Lists hold slots of the previous order
+		flock.verletLists.valid = false;
+		++flock.reorder.reorderCount;
+		flock.reorder.stepsSinceReorder = 0;
+		flock.reorder.lastReorderMs = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - reorderStart).count();
+	}
+
+	// Per boid cost bounded by k whatever the local density
+	void stepTopological(BoidFlock& flock, const BoidFlockParams& params, ThreadPool& pool) {
+		BoidArrays& boids = flock.boids;
+		const int count = boids.size();
+		KdTree2D& tree = flock.kdTree;
+		flock.usedAvx2 = false;
+
+		const auto buildStart = std::chrono::steady_clock::now();
+		buildKdTree(tree, boids.x.data(), boids.y.data(), count, pool);
+		flock.kdTreeBuildMs = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - buildStart).count();
+
+		// Previous state in tree order
+		BoidArrays& sorted = flock.sorted;
+		sorted.resize(count);
+		parallelFor(pool, count, BOIDS_CHUNK_SIZE, [&](int begin, int end) {
+			for (int k = begin; k < end; ++k) {
+				const int i = tree.order[k];
+				sorted.x[k] = tree.points[k].x;
+				sorted.y[k] = tree.points[k].y;
+				sorted.vx[k] = boids.vx[i];
+				sorted.vy[k] = boids.vy[i];
+			}
+		});
+
+		// The boid itself comes first, at distance 0
+		const int k = glm::clamp(params.topologicalNeighbors + 1, 1, KD_TREE_MAX_NEIGHBORS);
+		const float visualRangeSq = params.visualRange * params.visualRange;
+		const float separationDistanceSq = params.separationDistance * params.separationDistance;
+
+		parallelFor(pool, count, BOIDS_CHUNK_SIZE, [&](int begin, int end) {
+			int neighbors[KD_TREE_MAX_NEIGHBORS];
+			for (int n = begin; n < end; ++n) {
+				const int i = tree.order[n];
+				const glm::vec2 position = { sorted.x[n], sorted.y[n] };
+				const glm::vec2 initialVelocity = { sorted.vx[n], sorted.vy[n] };
+
+				const int neighborCount = findNearestNeighbors(tree, position, k, neighbors);
+				NeighborSums sums;
+				int inRangeCount = 0;
+				for (int m = 0; m < neighborCount; ++m) {
+					const int j = neighbors[m];
+					const float dx = position.x - sorted.x[j];
+					const float dy = position.y - sorted.y[j];
+					const float distanceSq = dx * dx + dy * dy;
+					sums.centerX += sorted.x[j];
+					sums.centerY += sorted.y[j];
+					sums.velocityX += sorted.vx[j];
+					sums.velocityY += sorted.vy[j];
+					if (distanceSq < separationDistanceSq) {
+						sums.moveX += dx;
+						sums.moveY += dy;
+					}
+					inRangeCount += distanceSq < visualRangeSq ? 1 : 0;
+				}
+				sums.count = neighborCount;
+				boids.neighborCount[i] = inRangeCount;
+
+				const glm::vec2 velocity = steerBoid(params, position, initialVelocity, sums, true);
+				const glm::vec2 newPosition = position + velocity * params.speed;
+				boids.x[i] = newPosition.x;
+				boids.y[i] = newPosition.y;
+				boids.vx[i] = velocity.x;
+				boids.vy[i] = velocity.y;
+			}
+		});
+	}
+}
+
+void BoidArrays::resize(int count) {
+	x.resize(count);
+	y.resize(count);
+	vx.resize(count);
+	vy.resize(count);
+	neighborCount.resize(count);
+	id.resize(count);
+}
+
+void BoidArrays::push(const glm::vec2& position, const glm::vec2& velocity) {
+	id.push_back(size());
+	x.push_back(position.x);
+	y.push_back(position.y);
+	vx.push_back(velocity.x);
+	vy.push_back(velocity.y);
+	neighborCount.push_back(0);
+}
+
+bool isAvx2Supported() {
+	static const bool supported = detectAvx2();
+	return supported;
+}
+
+void invalidateVerletLists(BoidFlock& flock) {
+	flock.verletLists.valid = false;
+}
+
+void clearBoidFlock(BoidFlock& flock) {
+	flock.boids.clear();
+	flock.idToIndex.clear();
+	flock.reorder.stepsSinceReorder = 0;
+	invalidateVerletLists(flock);
+}
+
+void stepBoidFlock(BoidFlock& flock, const BoidFlockParams& params, ThreadPool& pool) {
+	BoidReorderStats& reorder = flock.reorder;
+	const bool reorderNow = params.reorderInterval > 0 && ++reorder.stepsSinceReorder >= params.reorderInterval;
+	if (reorderNow) {
+		reorderBoids(flock, params, pool);
+	}
+
+	if (params.topological) {
+		flock.verletLists.valid = false;
+		flock.verletLists.rebuiltLastStep = false;
+		stepTopological(flock, params, pool);
+		flock.lastStepMode = BoidStepMode::Topological;
+		reorder.estimatedMissesPerStep = estimateGatherMisses(flock.kdTree.order);
+	}
+	else if (!params.useVerletLists) {
+		flock.verletLists.valid = false;
+		flock.verletLists.rebuiltLastStep = false;
+		stepWithGrid(flock, params, pool);
+		flock.lastStepMode = BoidStepMode::Grid;
+		reorder.estimatedMissesPerStep = estimateGatherMisses(flock.grid.sortedItems);
+	}
+	else {
+		stepVerlet(flock, params, pool);
+		flock.lastStepMode = BoidStepMode::VerletLists;
+		reorder.estimatedMissesPerStep = estimateGatherMisses(flock.grid.sortedItems);
+	}
+	if (reorderNow) {
+		reorder.estimatedMissesAfterReorder = reorder.estimatedMissesPerStep;
+	}
+}
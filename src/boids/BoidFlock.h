@@ -0,0 +1,138 @@
+#pragma once
+
+#include "BoidGrid.hpp"
+#include "KdTree2D.h"
+#include "ObstacleField.h"
+#include "../threadpool.h"
+
+#include <glm/vec2.hpp>
+#include <vector>
+
+// Boid state as structure of arrays
+struct BoidArrays {
+	std::vector<float> x;
+	std::vector<float> y;
+	std::vector<float> vx;
+	std::vector<float> vy;
+	// Boids within the visual range (itself included) during the last step.
+	// In topological mode, only those among the k nearest are counted.
+	std::vector<int> neighborCount;
+	// Push order of each boid, kept when the storage is reordered
+	std::vector<int> id;
+
+	int size() const { return static_cast<int>(x.size()); }
+	void resize(int count);
+	void clear() { resize(0); }
+	void push(const glm::vec2& position, const glm::vec2& velocity);
+};
+
+struct BoidFlockParams {
+	float coherence;
+	float separation;
+	float alignment;
+	float visualRange;
+	float separationDistance;
+	float speed;
+	float speedLimit;
+	// Boids are steered back inside [0, width] x [0, height]
+	float width;
+	float height;
+	bool allowAvx2 = true;
+	// Reuse per boid neighbor lists built with the ranges plus verletSkin
+	// until a boid has moved by more than verletSkin / 2
+	bool useVerletLists = false;
+	float verletSkin = 20.f;
+	// Cohesion and alignment over the k nearest boids instead of the boids
+	// within the visual range, found through a k-d tree. Separation still uses
+	// the separation distance, among those k.
+	bool topological = false;
+	int topologicalNeighbors = 7;
+	// Steps between two reorders of the storage along the Morton curve of the
+	// grid cells, 0 = never
+	int reorderInterval = 10;
+	// Boids closer than obstacleMargin to an obstacle are pushed along the
+	// field gradient, harder the deeper they are. The margin should not exceed
+	// the field maxDistance.
+	const ObstacleField* pObstacles = nullptr;
+	float obstacleMargin = 40.f;
+	float obstacleAvoidance = 1.f;
+};
+
+struct BoidVerletLists {
+	int capacity = 128; // neighbors kept per boid, the rest is dropped
+	// Slots in BoidFlock::sorted, capacity + 1 per boid, in sorted order
+	std::vector<int> slots;
+	std::vector<int> counts;
+	// Positions at the last build, in sorted order
+	std::vector<float> anchorX;
+	std::vector<float> anchorY;
+	float range = 0.f;
+	float maxDisplacement = 0.f; // since the last build
+	bool valid = false;
+
+	// Stats
+	int overflowCount = 0; // neighbors dropped at the last build
+	bool rebuiltLastStep = false;
+	unsigned int rebuildCount = 0;
+	unsigned int stepCount = 0;
+};
+
+struct BoidReorderStats {
+	unsigned int reorderCount = 0;
+	float lastReorderMs = 0.f;
+	int stepsSinceReorder = 0;
+	// Estimated from the access order of the step gather and scatter: every
+	// jump to another 64 byte line of one of the 5 arrays counts as a miss, a
+	// model rather than a hardware counter reading
+	int estimatedMissesPerStep = 0;
+	int estimatedMissesBeforeReorder = 0; // in the step before the last reorder
+	int estimatedMissesAfterReorder = 0;  // in the step after
+};
+
+// Neighbor structure used by the last step
+enum class BoidStepMode {
+	Grid,        // grid and sorted are valid for the visual range
+	VerletLists, // verletLists and sorted are valid
+	Topological  // sorted is in k-d tree order
+};
+
+struct BoidFlock {
+	BoidArrays boids;
+
+	// Per step scratch: grid, and the state at the start of the step in cell
+	// order. The step reads only this copy and writes only boids, so every boid
+	// can be updated independently.
+	BoidGrid grid;
+	BoidArrays sorted;
+
+	BoidVerletLists verletLists;
+
+	// Topological mode, rebuilt every step
+	KdTree2D kdTree;
+	float kdTreeBuildMs = 0.f;
+
+	// Current index of each boid id, rebuilt by the reorder
+	std::vector<int> idToIndex;
+	BoidReorderStats reorder;
+
+	bool usedAvx2 = false; // kernel picked for the last step
+	BoidStepMode lastStepMode = BoidStepMode::Grid;
+
+	// Current index of the boid with this id
+	int indexOfId(int boidId) const {
+		return idToIndex.size() == boids.x.size() ? idToIndex[boidId] : boidId;
+	}
+};
+
+// True when the CPU and OS support AVX2 + FMA
+bool isAvx2Supported();
+
+// Forces a list rebuild on the next step, call it after moving boids around
+void invalidateVerletLists(BoidFlock& flock);
+
+// Removes every boid, ids restart from 0
+void clearBoidFlock(BoidFlock& flock);
+
+// Boids are split in fixed size chunks over the pool. The result does not
+// depend on the thread count.
+void stepBoidFlock(BoidFlock& flock, const BoidFlockParams& params, ThreadPool& pool);
@@ -0,0 +1,151 @@
+#include "BoidFlock3D.h"
+
+#include <glm/geometric.hpp>
+#include <algorithm>
+
+namespace {
+	constexpr int BOIDS_3D_CHUNK_SIZE = 512;
+
+	void gatherSortedState(BoidFlock3D& flock, ThreadPool& pool) {
+		const BoidArrays3D& boids = flock.boids;
+		const std::vector<int>& sortedItems = flock.grid.sortedItems;
+		flock.sorted.resize(boids.size());
+		BoidArrays3D& sorted = flock.sorted;
+		parallelFor(pool, boids.size(), BOIDS_3D_CHUNK_SIZE, [&](int begin, int end) {
+			for (int k = begin; k < end; ++k) {
+				const int i = sortedItems[k];
+				sorted.x[k] = boids.x[i];
+				sorted.y[k] = boids.y[i];
+				sorted.z[k] = boids.z[i];
+				sorted.vx[k] = boids.vx[i];
+				sorted.vy[k] = boids.vy[i];
+				sorted.vz[k] = boids.vz[i];
+			}
+		});
+	}
+
+	void keepWithinBox(const glm::vec3& position, glm::vec3& velocity, const glm::vec3& boxMin, const glm::vec3& boxMax) {
+		const float margin = 50.f;
+		const float turnFactor = 1.f;
+		for (int axis = 0; axis < 3; ++axis) {
+			if (position[axis] < boxMin[axis] + margin) {
+				velocity[axis] += turnFactor;
+			}
+			if (position[axis] > boxMax[axis] - margin) {
+				velocity[axis] -= turnFactor;
+			}
+		}
+	}
+}
+
+void BoidArrays3D::resize(int count) {
+	x.resize(count);
+	y.resize(count);
+	z.resize(count);
+	vx.resize(count);
+	vy.resize(count);
+	vz.resize(count);
+	neighborCount.resize(count);
+}
+
+void BoidArrays3D::push(const glm::vec3& position, const glm::vec3& velocity) {
+	x.push_back(position.x);
+	y.push_back(position.y);
+	z.push_back(position.z);
+	vx.push_back(velocity.x);
+	vy.push_back(velocity.y);
+	vz.push_back(velocity.z);
+	neighborCount.push_back(0);
+}
+
+void stepBoidFlock3D(BoidFlock3D& flock, const BoidFlock3DParams& params, ThreadPool& pool) {
+	BoidArrays3D& boids = flock.boids;
+	const int count = boids.size();
+
+	const float cellSize = std::max(std::max(params.visualRange, params.separationDistance), 1.f);
+	flock.grid.build(count, [&boids](int i) { return glm::vec3(boids.x[i], boids.y[i], boids.z[i]); }, cellSize);
+	gatherSortedState(flock, pool);
+
+	const float centeringFactor = 0.01f * params.coherence; // adjust velocity by this %
+	const float avoidFactor = 0.1f * params.separation; // Adjust velocity by this %
+	const float matchingFactor = 0.1f * params.alignment;
+	const float visualRangeSq = params.visualRange * params.visualRange;
+	const float separationDistanceSq = params.separationDistance * params.separationDistance;
+
+	const BoidArrays3D& sorted = flock.sorted;
+	const std::vector<int>& sortedItems = flock.grid.sortedItems;
+
+	parallelFor(pool, count, BOIDS_3D_CHUNK_SIZE, [&](int begin, int end) {
+		for (int k = begin; k < end; ++k) {
+			const int i = sortedItems[k];
+			const glm::vec3 position = { sorted.x[k], sorted.y[k], sorted.z[k] };
+			const glm::vec3 initialVelocity = { sorted.vx[k], sorted.vy[k], sorted.vz[k] };
+			glm::vec3 velocity = initialVelocity;
+
+			float centerX = 0.f, centerY = 0.f, centerZ = 0.f;
+			float velocityX = 0.f, velocityY = 0.f, velocityZ = 0.f;
+			float moveX = 0.f, moveY = 0.f, moveZ = 0.f;
+			int numNeighbors = 0;
+
+			// The boid itself is visited too: it is in range and adds a null offset
+			flock.grid.forEachNeighborRange(position, [&](int rangeBegin, int rangeEnd) {
+				for (int j = rangeBegin; j < rangeEnd; ++j) {
+					const float dx = position.x - sorted.x[j];
+					const float dy = position.y - sorted.y[j];
+					const float dz = position.z - sorted.z[j];
+					const float distanceSq = dx * dx + dy * dy + dz * dz;
+					if (distanceSq < visualRangeSq) {
+						centerX += sorted.x[j];
+						centerY += sorted.y[j];
+						centerZ += sorted.z[j];
+						velocityX += sorted.vx[j];
+						velocityY += sorted.vy[j];
+						velocityZ += sorted.vz[j];
+						numNeighbors += 1;
+					}
+					if (distanceSq < separationDistanceSq) {
+						moveX += dx;
+						moveY += dy;
+						moveZ += dz;
+					}
+				}
+			});
+			boids.neighborCount[i] = numNeighbors;
+
+			// Cohesion
+			if (numNeighbors) {
+				const glm::vec3 center = glm::vec3(centerX, centerY, centerZ) / static_cast<float>(numNeighbors);
+				velocity += (center - position) * centeringFactor;
+			}
+
+			// Separation
+			velocity += glm::vec3(moveX, moveY, moveZ) * avoidFactor;
+
+			// Alignment, the boid contributes the velocity it has at this point
+			if (numNeighbors) {
+				glm::vec3 velocitySum = { velocityX, velocityY, velocityZ };
+				if (visualRangeSq > 0.f) {
+					velocitySum += velocity - initialVelocity;
+				}
+				const glm::vec3 averageVelocity = velocitySum / static_cast<float>(numNeighbors);
+				velocity += (averageVelocity - velocity) * matchingFactor;
+			}
+
+			// Speed limit
+			const float speed = glm::length(velocity);
+			if (speed > params.speedLimit) {
+				velocity = (velocity / speed) * params.speedLimit;
+			}
+
+			keepWithinBox(position, velocity, params.boxMin, params.boxMax);
+
+			const glm::vec3 newPosition = position + velocity * params.speed;
+			boids.x[i] = newPosition.x;
+			boids.y[i] = newPosition.y;
+			boids.z[i] = newPosition.z;
+			boids.vx[i] = velocity.x;
+			boids.vy[i] = velocity.y;
+			boids.vz[i] = velocity.z;
+		}
+	});
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include "BoidHashGrid3D.hpp"
+#include "../threadpool.h"
+
+#include <glm/vec3.hpp>
+#include <vector>
+
+// 3D boid state as structure of arrays
+struct BoidArrays3D {
+	std::vector<float> x;
+	std::vector<float> y;
+	std::vector<float> z;
+	std::vector<float> vx;
+	std::vector<float> vy;
+	std::vector<float> vz;
+	// Boids within the visual range (itself included) during the last step
+	std::vector<int> neighborCount;
+
+	int size() const { return static_cast<int>(x.size()); }
+	void resize(int count);
+	void clear() { resize(0); }
+	void push(const glm::vec3& position, const glm::vec3& velocity);
+};
+
+// Same rules and units as BoidFlockParams, in a box instead of the viewport
+struct BoidFlock3DParams {
+	float coherence;
+	float separation;
+	float alignment;
+	float visualRange;
+	float separationDistance;
+	float speed;
+	float speedLimit;
+	// Boids are steered back inside [boxMin, boxMax]
+	glm::vec3 boxMin;
+	glm::vec3 boxMax;
+};
+
+struct BoidFlock3D {
+	BoidArrays3D boids;
+
+	// Per step scratch: grid, and the state at the start of the step in
+	// bucket order
+	BoidHashGrid3D grid;
+	BoidArrays3D sorted;
+};
+
+// Same scheduling as stepBoidFlock: deterministic for any thread count
+void stepBoidFlock3D(BoidFlock3D& flock, const BoidFlock3DParams& params, ThreadPool& pool);
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <glm/common.hpp>
+#include <glm/vec2.hpp>
+#include <vector>
+
+// Uniform grid over [0, width] x [0, height], rebuilt from scratch with a
+// counting sort. Positions outside the area are clamped into the border cells,
+// which keeps queries correct as long as the cell size is at least the query
+// radius.
+struct BoidGrid {
+    float cellSize = 1.f;
+    int cellCountX = 0;
+    int cellCountY = 0;
+    // Items of cell c are sortedItems[cellStart[c] .. cellStart[c + 1])
+    std::vector<int> cellStart = std::vector<int>();
+    std::vector<int> sortedItems = std::vector<int>();
+    std::vector<int> itemCells = std::vector<int>();
+
+    int cellX(float x) const { return glm::clamp(static_cast<int>(x / cellSize), 0, cellCountX - 1); }
+    int cellY(float y) const { return glm::clamp(static_cast<int>(y / cellSize), 0, cellCountY - 1); }
+    int cellCount() const { return cellCountX * cellCountY; }
+
+    // getPosition(i) returns the glm::vec2 position of item i
+    template <typename GetPosition>
+    void build(int itemCount, GetPosition getPosition, float width, float height, float newCellSize) {
+        cellSize = newCellSize;
+        cellCountX = glm::max(1, static_cast<int>(glm::ceil(width / cellSize)));
+        cellCountY = glm::max(1, static_cast<int>(glm::ceil(height / cellSize)));
+
+        cellStart.assign(cellCount() + 1, 0);
+        itemCells.resize(itemCount);
+        sortedItems.resize(itemCount);
+
+        // Count, prefix sum, scatter
+        for (int i = 0; i < itemCount; ++i) {
+            const glm::vec2 position = getPosition(i);
+            const int cell = cellY(position.y) * cellCountX + cellX(position.x);
+            itemCells[i] = cell;
+            ++cellStart[cell + 1];
+        }
+        for (int c = 0; c < cellCount(); ++c) {
+            cellStart[c + 1] += cellStart[c];
+        }
+        std::vector<int>& cursor = scratchCursor;
+        cursor.assign(cellStart.begin(), cellStart.end() - 1);
+        for (int i = 0; i < itemCount; ++i) {
+            sortedItems[cursor[itemCells[i]]++] = i;
+        }
+    }
+
+    // Calls visit(begin, end) for the (up to) three ranges of sortedItems
+    // covering the 3x3 cells around position
+    template <typename VisitRange>
+    void forEachNeighborRange(const glm::vec2& position, VisitRange visitRange) const {
+        const int cx = cellX(position.x);
+        const int cy = cellY(position.y);
+        for (int y = glm::max(cy - 1, 0); y <= glm::min(cy + 1, cellCountY - 1); ++y) {
+            // Cells of a row are contiguous in sortedItems
+            const int rowFirstCell = y * cellCountX;
+            const int begin = cellStart[rowFirstCell + glm::max(cx - 1, 0)];
+            const int end = cellStart[rowFirstCell + glm::min(cx + 1, cellCountX - 1) + 1];
+            if (begin < end) {
+                visitRange(begin, end);
+            }
+        }
+    }
+
+    // Calls visit(j) for every item in the 3x3 cells around position
+    template <typename Visit>
+    void forEachNeighbor(const glm::vec2& position, Visit visit) const {
+        forEachNeighborRange(position, [&](int begin, int end) {
+            for (int k = begin; k < end; ++k) {
+                visit(sortedItems[k]);
+            }
+        });
+    }
+
+private:
+    std::vector<int> scratchCursor = std::vector<int>();
+};
@@ -0,0 +1,123 @@
+#pragma once
+
+#include <glm/common.hpp>
+#include <glm/vec3.hpp>
+#include <vector>
+
+// Unbounded 3D grid: integer cell coordinates are hashed into a power of two
+// bucket table, then items are sorted by bucket with a counting sort. Only
+// (y, z) is hashed and x is added afterwards, so a row of cells along x maps
+// to consecutive buckets and a 3x3x3 query reads 9 contiguous spans. Cells
+// sharing a bucket only cost extra distance tests, so callers must still
+// check the distance of every item they visit.
+struct BoidHashGrid3D {
+    float cellSize = 1.f;
+    unsigned int bucketMask = 0;
+    // Items of bucket b are sortedItems[bucketStart[b] .. bucketStart[b + 1])
+    std::vector<int> bucketStart = std::vector<int>();
+    std::vector<int> sortedItems = std::vector<int>();
+    std::vector<int> itemBuckets = std::vector<int>();
+
+    int bucketCount() const { return static_cast<int>(bucketMask) + 1; }
+
+    glm::ivec3 cellOf(const glm::vec3& position) const {
+        return glm::ivec3(glm::floor(position / cellSize));
+    }
+
+    int bucketOf(const glm::ivec3& cell) const {
+        const unsigned int rowHash = (static_cast<unsigned int>(cell.y) * 19349663u)
+            ^ (static_cast<unsigned int>(cell.z) * 83492791u);
+        return static_cast<int>((rowHash + static_cast<unsigned int>(cell.x)) & bucketMask);
+    }
+
+    // getPosition(i) returns the glm::vec3 position of item i
+    template <typename GetPosition>
+    void build(int itemCount, GetPosition getPosition, float newCellSize) {
+        cellSize = newCellSize;
+        // About two buckets per item keeps collisions rare
+        unsigned int buckets = 64;
+        while (buckets < 2u * static_cast<unsigned int>(itemCount)) {
+            buckets *= 2;
+        }
+        bucketMask = buckets - 1;
+
+        bucketStart.assign(bucketCount() + 1, 0);
+        itemBuckets.resize(itemCount);
+        sortedItems.resize(itemCount);
+
+        for (int i = 0; i < itemCount; ++i) {
+            const int bucket = bucketOf(cellOf(getPosition(i)));
+            itemBuckets[i] = bucket;
+            ++bucketStart[bucket + 1];
+        }
+        for (int b = 0; b < bucketCount(); ++b) {
+            bucketStart[b + 1] += bucketStart[b];
+        }
+        std::vector<int>& cursor = scratchCursor;
+        cursor.assign(bucketStart.begin(), bucketStart.end() - 1);
+        for (int i = 0; i < itemCount; ++i) {
+            sortedItems[cursor[itemBuckets[i]]++] = i;
+        }
+    }
+
+    // Calls visit(begin, end) over the items of the 3x3x3 cells around
+    // position, each bucket at most once
+    template <typename VisitRange>
+    void forEachNeighborRange(const glm::vec3& position, VisitRange visitRange) const {
+        const glm::ivec3 center = cellOf(position);
+
+        // Inclusive bucket spans, one per row, split where the table wraps
+        int spanFirst[18];
+        int spanLast[18];
+        int spanCount = 0;
+        for (int z = -1; z <= 1; ++z) {
+            for (int y = -1; y <= 1; ++y) {
+                const int first = bucketOf(center + glm::ivec3(-1, y, z));
+                const int last = (first + 2) & static_cast<int>(bucketMask);
+                if (first <= last) {
+                    spanFirst[spanCount] = first;
+                    spanLast[spanCount++] = last;
+                }
+                else {
+                    spanFirst[spanCount] = first;
+                    spanLast[spanCount++] = static_cast<int>(bucketMask);
+                    spanFirst[spanCount] = 0;
+                    spanLast[spanCount++] = last;
+                }
+            }
+        }
+
+        // Rows hashing close to each other overlap: sort the spans and merge them
+        for (int i = 1; i < spanCount; ++i) {
+            const int first = spanFirst[i];
+            const int last = spanLast[i];
+            int j = i - 1;
+            for (; j >= 0 && spanFirst[j] > first; --j) {
+                spanFirst[j + 1] = spanFirst[j];
+                spanLast[j + 1] = spanLast[j];
+            }
+            spanFirst[j + 1] = first;
+            spanLast[j + 1] = last;
+        }
+        int mergedFirst = spanFirst[0];
+        int mergedLast = spanLast[0];
+        for (int i = 1; i <= spanCount; ++i) {
+            if (i < spanCount && spanFirst[i] <= mergedLast + 1) {
+                mergedLast = glm::max(mergedLast, spanLast[i]);
+                continue;
+            }
+            const int begin = bucketStart[mergedFirst];
+            const int end = bucketStart[mergedLast + 1];
+            if (begin < end) {
+                visitRange(begin, end);
+            }
+            if (i < spanCount) {
+                mergedFirst = spanFirst[i];
+                mergedLast = spanLast[i];
+            }
+        }
+    }
+
+private:
+    std::vector<int> scratchCursor = std::vector<int>();
+};
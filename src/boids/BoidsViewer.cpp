@@ -12,18 +12,14 @@
 #include <vector>
 #include <GLFW/glfw3.h>
 #include "../MyViewer.cpp"
+#include "BoidClusters.h"
+#include "BoidFlock.h"
+#include "BoidFlock3D.h"
+#include <glm/gtc/matrix_transform.hpp>
 
 
 struct BoidsViewer : Viewer {
 
-	class Boid {
-	public:
-		Boid() = default;
-		~Boid() = default;
-		glm::vec2 position = { 0, 0 };
-		glm::vec2 velocity = { 0, 0 };
-	};
-
 	glm::vec3 jointPosition;
 	glm::vec3 cubePosition;
 	float boneAngle;
@@ -35,7 +31,26 @@ struct BoidsViewer : Viewer {
 
 	VertexShaderAdditionalData additionalShaderData;
 
-	std::vector<Boid*> boids = std::vector<Boid*>();
+	BoidFlock flock;
+
+	// 3D mode: same rules in a cube of box3DSize, shown as a cube of
+	// box3DWorldSize world units centered on the origin
+	bool flock3DMode = false;
+	BoidFlock3D flock3D;
+	float box3DSize = 1000.f;
+	static constexpr float box3DWorldSize = 4.f;
+	float glyph3DSize = 0.03f;
+
+	// Render snapshot, written by publishSnapshot() only
+	BoidArrays renderBoids;
+	std::vector<glm::vec3> renderGlyphPositions = std::vector<glm::vec3>();
+	std::vector<glm::vec3> renderGlyphDirections = std::vector<glm::vec3>();
+	std::vector<glm::vec4> renderGlyphColors = std::vector<glm::vec4>();
+	float renderBox3DSize = 1000.f;
+	// Point cache of the 2D flock: x, y, vx, vy, neighborCount. Set by
+	// publishSnapshot(), the flock stays frozen while a cache plays.
+	bool playingPointCache = false;
+	std::vector<float> recordedNeighborCounts = std::vector<float>();
 
 	// Boids Parameters
 	float boidsCoherence = 0.5f;
@@ -48,17 +63,47 @@ struct BoidsViewer : Viewer {
 	float boidsModelArrowThickness = 8;
 	float boidsModelArrowHat = 77;
 	float boidsVisualRange = 36;
+	static constexpr float boidsSeparationDistance = 20.0f;
 	bool mouseAttractBoids = false;
 	int maxNeighborForColor = 5;
 	glm::vec4 minNeighborColor = { 0.f, 1.f, 0.f, 1.f };
 	glm::vec4 maxNeighborColor = { 1.f, 0.f, 0.f, 1.f };
+	bool allowAvx2 = true;
+	bool vertexPullingBoids = true; // arrows built by the vertex shader
+	float simulationStepMs = 0.f;
+
+	// Verlet lists, see BoidFlockParams
+	bool useVerletLists = false;
+	float verletSkin = 20.f;
+	// Topological neighborhood, see BoidFlockParams
+	bool topological = false;
+	int topologicalNeighbors = 7;
+	int reorderInterval = 10; // steps between Morton reorders, 0 = never
+
+	// Obstacles, 2D only. Alt + left click places a circle at the mouse.
+	ObstacleField obstacles;
+	bool avoidObstacles = true;
+	float obstacleMargin = 40.f;
+	float obstacleAvoidance = 1.f;
+	float newObstacleRadius = 40.f;
+	bool placingObstacle = false;
+	char obstaclesPath[256] = "obstacles.txt";
+	glm::vec4 obstacleColor = { 1.f, 1.f, 1.f, 1.f };
+
+	// Flock clusters, 2D only, from the neighbor structure of the step
+	BoidClusters clusters;
+	bool detectClusters = true;
+	int clusterInterval = 10; // steps between two detections
+	int stepsSinceClusters = 0;
+	char clusterLogPath[256] = "boid_clusters.csv";
+	// Running averages of the 2D step in each mode, to show the time saved
+	float gridStepAverageMs = 0.f;
+	float verletStepAverageMs = 0.f;
 
 	BoidsViewer() : Viewer("BoidsViewer", 1280, 720) {}
 
 	~BoidsViewer() {
-		for (const Boid* boid : boids) {
-			delete boid;
-		}
+		stopBoidClusterLog(clusters);
 	}
 
 	void init() override {
@@ -74,12 +119,25 @@ struct BoidsViewer : Viewer {
 		initBoids();
 	}
 
+	void resetBoids() {
+		clearBoidFlock(flock);
+		flock3D.boids.clear();
+		initBoids();
+	}
+
 	void initBoids() {
+		if (flock3DMode) {
+			for (int i = 0; i < numBoids; i++) {
+				const glm::vec3 position = glm::vec3(randFloat(), randFloat(), randFloat()) * box3DSize;
+				const glm::vec3 velocity = { randFloat()*10-5, randFloat()*10-5, randFloat()*10-5 };
+				flock3D.boids.push(position, velocity);
+			}
+			return;
+		}
 		for (int i = 0; i < numBoids; i++) {
-			Boid* boid = new Boid();
-			boid->position = { randFloat()*static_cast<float>(viewportWidth), randFloat()*static_cast<float>(viewportHeight) };
-			boid->velocity = { randFloat()*10-5, randFloat()*10-5 };
-			boids.push_back(boid);
+			const glm::vec2 position = { randFloat()*static_cast<float>(viewportWidth), randFloat()*static_cast<float>(viewportHeight) };
+			const glm::vec2 velocity = { randFloat()*10-5, randFloat()*10-5 };
+			flock.boids.push(position, velocity);
 		}
 	}
 
@@ -87,150 +145,204 @@ struct BoidsViewer : Viewer {
 		return rand() / static_cast<float>(RAND_MAX);
 	}
 
-	static double distance(const Boid& boid1, const Boid& boid2) {
-		return glm::distance(boid1.position, boid2.position);
+	BoidFlockParams flockParams() const {
+		BoidFlockParams params;
+		params.coherence = boidsCoherence;
+		params.separation = boidsSeparation;
+		params.alignment = boidsAlignment;
+		params.visualRange = boidsVisualRange;
+		params.separationDistance = boidsSeparationDistance;
+		params.speed = boidsSpeed;
+		params.speedLimit = boidsSpeedLimit;
+		params.width = static_cast<float>(viewportWidth);
+		params.height = static_cast<float>(viewportHeight);
+		params.allowAvx2 = allowAvx2;
+		params.useVerletLists = useVerletLists;
+		params.verletSkin = verletSkin;
+		params.topological = topological;
+		params.topologicalNeighbors = topologicalNeighbors;
+		params.reorderInterval = reorderInterval;
+		params.pObstacles = avoidObstacles && !obstacles.obstacles.empty() ? &obstacles : nullptr;
+		params.obstacleMargin = glm::min(obstacleMargin, obstacles.maxDistance);
+		params.obstacleAvoidance = obstacleAvoidance;
+		return params;
 	}
 
-	void keepWithinBounds(Boid& boid) {
-		const double margin = 50;
-		const double turnFactor = 1;
+	BoidFlock3DParams flock3DParams() const {
+		BoidFlock3DParams params;
+		params.coherence = boidsCoherence;
+		params.separation = boidsSeparation;
+		params.alignment = boidsAlignment;
+		params.visualRange = boidsVisualRange;
+		params.separationDistance = boidsSeparationDistance;
+		params.speed = boidsSpeed;
+		params.speedLimit = boidsSpeedLimit;
+		params.boxMin = glm::vec3(0.f);
+		params.boxMax = glm::vec3(box3DSize);
+		return params;
+	}
 
-		if (boid.position.x < margin) {
-			boid.velocity.x += turnFactor;
-		}
-		if (boid.position.x > viewportWidth - margin) {
-			boid.velocity.x -= turnFactor;
-		}
-		if (boid.position.y < margin) {
-			boid.velocity.y += turnFactor;
-		}
-		if (boid.position.y > viewportHeight - margin) {
-			boid.velocity.y -= turnFactor;
-		}
+	// Maps the simulation box to the world space cube
+	glm::mat4 box3DModel(float boxSize) const {
+		const float scale = box3DWorldSize / boxSize;
+		const glm::mat4 translation = glm::translate(glm::identity<glm::mat4>(), glm::vec3(-0.5f * box3DWorldSize));
+		return glm::scale(translation, glm::vec3(scale));
 	}
 
-	void flyTowardCenter(Boid& boid) {
-		const float centeringFactor = 0.01f * boidsCoherence; // adjust velocity by this %
+	glm::vec4 getColor(int neighborCount) const {
+		// Interpolate color based on number of neighbors
+		const float t = std::min(static_cast<float>(neighborCount) / static_cast<float>(maxNeighborForColor), 1.f);
+		return glm::mix(minNeighborColor, maxNeighborColor, t);
+	}
 
-		float centerX = 0;
-		float centerY = 0;
+	void update(double elapsedTime) override {
+		boneAngle = (float)elapsedTime;
 
-		int numNeighbors = 0;
+		leftMouseButtonPressed = isMouseButtonPressed(GLFW_MOUSE_BUTTON_LEFT);
 
-		for (const Boid* otherBoid : boids) {
-			if (distance(boid, *otherBoid) < boidsVisualRange) {
-				centerX += otherBoid->position.x;
-				centerY += otherBoid->position.y;
-				numNeighbors += 1;
-			}
-		}
+		altKeyPressed = isKeyPressed(GLFW_KEY_LEFT_ALT) || isKeyPressed(GLFW_KEY_RIGHT_ALT);
+
+		double mouseX;
+		double mouseY;
+		getCursorPos(mouseX, mouseY);
 
-		if (numNeighbors) {
-			centerX /= static_cast<float>(numNeighbors);
-			centerY /= static_cast<float>(numNeighbors);
+		mousePos = { float(mouseX), viewportHeight - float(mouseY) };
 
-			boid.velocity.x += (centerX - boid.position.x) * centeringFactor;
-			boid.velocity.y += (centerY - boid.position.y) * centeringFactor;
+		// The field covers the viewport, the worker is idle here
+		if (obstacles.width != static_cast<float>(viewportWidth) || obstacles.height != static_cast<float>(viewportHeight)) {
+			rebuildObstacleField(obstacles, static_cast<float>(viewportWidth), static_cast<float>(viewportHeight), threadPool);
 		}
-	}
+		const bool placeObstacle = !flock3DMode && altKeyPressed && leftMouseButtonPressed && !ImGui::GetIO().WantCaptureMouse;
+		if (placeObstacle && !placingObstacle) {
+			Obstacle obstacle;
+			obstacle.shape = ObstacleShape::Circle;
+			obstacle.center = mousePos;
+			obstacle.radius = newObstacleRadius;
+			addObstacle(obstacles, obstacle, threadPool);
+		}
+		placingObstacle = placeObstacle;
 
-	void avoidOthers(Boid& boid) const {
-		float avoidFactor = 0.1f * boidsSeparation; // Adjust velocity by this %
-	    float moveX = 0.0f;
-	    float moveY = 0.0f;
-	    for (const Boid* otherBoid : boids) {
-	        if (otherBoid != &boid) {
-		        constexpr float minDistance = 20.0f;
-		        if (distance(boid, *otherBoid) < minDistance) {
-	                moveX += boid.position.x - otherBoid->position.x;
-	                moveY += boid.position.y - otherBoid->position.y;
-	            }
-	        }
-	    }
-
-	    boid.velocity.x += moveX * avoidFactor;
-	    boid.velocity.y += moveY * avoidFactor;
+		pCustomShaderData = &additionalShaderData;
+		CustomShaderDataSize = sizeof(VertexShaderAdditionalData);
 	}
 
-	void matchVelocity(Boid& boid) const {
-		float avgDX = 0;
-		float avgDY = 0;
-		int numNeighbors = 0;
+	void simulate(double elapsedTime) override {
+		if (playingPointCache) {
+			return;
+		}
+		const double stepStart = glfwGetTime();
 
-		for (const Boid* otherBoid : boids) {
-			if (distance(boid, *otherBoid) < boidsVisualRange) {
-				avgDX += otherBoid->velocity.x;
-				avgDY += otherBoid->velocity.y;
-				numNeighbors += 1;
+		if (flock3DMode) {
+			stepBoidFlock3D(flock3D, flock3DParams(), threadPool);
+		}
+		else {
+			stepBoidFlock(flock, flockParams(), threadPool);
+			if (detectClusters && ++stepsSinceClusters >= clusterInterval) {
+				findBoidClusters(clusters, flock, boidsVisualRange, threadPool);
+				stepsSinceClusters = 0;
 			}
 		}
 
-		if (numNeighbors) {
-			const float matchingFactor = 0.1f * boidsAlignment;
-			avgDX /= static_cast<float>(numNeighbors);
-			avgDY /= static_cast<float>(numNeighbors);
+		simulationStepMs = static_cast<float>(1000.0 * (glfwGetTime() - stepStart));
 
-			boid.velocity.x += (avgDX - boid.velocity.x) * matchingFactor;
-			boid.velocity.y += (avgDY - boid.velocity.y) * matchingFactor;
+		if (!flock3DMode && !topological) {
+			float& average = useVerletLists ? verletStepAverageMs : gridStepAverageMs;
+			average = average == 0.f ? simulationStepMs : glm::mix(average, simulationStepMs, 0.05f);
 		}
 	}
 
-	void limitSpeed(Boid &boid) const {
-		const float speed = glm::length(boid.velocity);
-		if (speed > boidsSpeedLimit) {
-			boid.velocity = (boid.velocity / speed) * boidsSpeedLimit;
+	void publishSnapshot() override {
+		playingPointCache = !flock3DMode && nextPointCacheFrame();
+		if (playingPointCache) {
+			const int count = pointCachePlayer.pointCount;
+			renderBoids.resize(count);
+			std::copy_n(getPointCacheComponent(pointCachePlayer, 0), count, renderBoids.x.begin());
+			std::copy_n(getPointCacheComponent(pointCachePlayer, 1), count, renderBoids.y.begin());
+			std::copy_n(getPointCacheComponent(pointCachePlayer, 2), count, renderBoids.vx.begin());
+			std::copy_n(getPointCacheComponent(pointCachePlayer, 3), count, renderBoids.vy.begin());
+			const float* pNeighborCounts = getPointCacheComponent(pointCachePlayer, 4);
+			for (int i = 0; i < count; ++i) {
+				renderBoids.neighborCount[i] = static_cast<int>(pNeighborCounts[i] + 0.5f);
+			}
 		}
-	}
-
-	glm::vec4 getColor(const Boid &boid) const {
-		// Count the numbers of neighbors
-		int numNeighbors = 0;
-		for (const Boid* otherBoid : boids) {
-			if (distance(boid, *otherBoid) < boidsVisualRange) {
-				numNeighbors += 1;
+		else {
+			renderBoids = flock.boids;
+			if (!flock3DMode && isPointCacheRecording(pointCacheRecorder)) {
+				recordedNeighborCounts.assign(renderBoids.neighborCount.begin(), renderBoids.neighborCount.end());
+				const float* components[5] = { renderBoids.x.data(), renderBoids.y.data(), renderBoids.vx.data(), renderBoids.vy.data(), recordedNeighborCounts.data() };
+				recordPointCacheFrame(pointCacheRecorder, components, 1, renderBoids.size(), static_cast<float>(glfwGetTime()));
 			}
 		}
 
-		// Interpolate color based on number of neighbors
-		const float t = std::min(static_cast<float>(numNeighbors) / static_cast<float>(maxNeighborForColor), 1.f);
-		return glm::mix(minNeighborColor, maxNeighborColor, t);
-	}
-
-	void update(double elapsedTime) override {
-		boneAngle = (float)elapsedTime;
-
-		leftMouseButtonPressed = glfwGetMouseButton(window, GLFW_MOUSE_BUTTON_LEFT) == GLFW_PRESS;
-
-		altKeyPressed = glfwGetKey(window, GLFW_KEY_LEFT_ALT) == GLFW_PRESS || glfwGetKey(window, GLFW_KEY_RIGHT_ALT) == GLFW_PRESS;
-
-		double mouseX;
-		double mouseY;
-		glfwGetCursorPos(window, &mouseX, &mouseY);
-
-		mousePos = { float(mouseX), viewportHeight - float(mouseY) };
-
-		pCustomShaderData = &additionalShaderData;
-		CustomShaderDataSize = sizeof(VertexShaderAdditionalData);
-		for (Boid* boid: boids) {
-			flyTowardCenter(*boid);
-			avoidOthers(*boid);
-			matchVelocity(*boid);
-			limitSpeed(*boid);
-			keepWithinBounds(*boid);
-			boid->position += boid->velocity * boidsSpeed;
+		const BoidArrays3D& boids3D = flock3D.boids;
+		renderGlyphPositions.resize(boids3D.size());
+		renderGlyphDirections.resize(boids3D.size());
+		renderGlyphColors.resize(boids3D.size());
+		for (int i = 0; i < boids3D.size(); ++i) {
+			renderGlyphPositions[i] = { boids3D.x[i], boids3D.y[i], boids3D.z[i] };
+			renderGlyphDirections[i] = { boids3D.vx[i], boids3D.vy[i], boids3D.vz[i] };
+			renderGlyphColors[i] = getColor(boids3D.neighborCount[i]);
 		}
+		renderBox3DSize = box3DSize;
 	}
 
 	void render3D_custom(const RenderApi3D& api) const override {
 	}
 
 	void render3D(const RenderApi3D& api) const override {
+		if (!flock3DMode) {
+			return;
+		}
+		const glm::mat4 model = box3DModel(renderBox3DSize);
+		const unsigned int glyphCount = static_cast<unsigned int>(renderGlyphPositions.size());
+		api.orientedGlyphs(renderGlyphPositions.data(), renderGlyphDirections.data(), renderGlyphColors.data(), glyphCount, glyph3DSize, &model);
+
+		// Box edges
+		glm::vec3 vertices[24];
+		int iVertex = 0;
+		for (int axis = 0; axis < 3; ++axis) {
+			for (int corner = 0; corner < 4; ++corner) {
+				glm::vec3 from = { 0.f, 0.f, 0.f };
+				from[(axis + 1) % 3] = (corner & 1) ? renderBox3DSize : 0.f;
+				from[(axis + 2) % 3] = (corner & 2) ? renderBox3DSize : 0.f;
+				glm::vec3 to = from;
+				to[axis] = renderBox3DSize;
+				vertices[iVertex++] = from;
+				vertices[iVertex++] = to;
+			}
+		}
+		api.lines(vertices, COUNTOF(vertices), white, &model);
 	}
 
 	void render2D(const RenderApi2D& api) const override {
-		for (Boid* boid: boids) {
-			//api.circleFill(boid->position, 5, 10, red);
-			api.arrow(boid->position, boid->position + normalize(boid->velocity),boidsModelArrowThickness,boidsModelArrowHat,getColor(*boid));
+		if (flock3DMode) {
+			return;
+		}
+		// Edited from the GUI only, while the worker is idle
+		std::vector<glm::vec2> polygonLines;
+		for (const Obstacle& obstacle : obstacles.obstacles) {
+			if (obstacle.shape == ObstacleShape::Circle) {
+				api.circleContour(obstacle.center, obstacle.radius, 32, obstacleColor);
+				continue;
+			}
+			for (size_t i = 0, j = obstacle.points.size() - 1; i < obstacle.points.size(); j = i++) {
+				polygonLines.push_back(obstacle.center + obstacle.points[j]);
+				polygonLines.push_back(obstacle.center + obstacle.points[i]);
+			}
+		}
+		if (!polygonLines.empty()) {
+			api.lines(polygonLines.data(), static_cast<unsigned int>(polygonLines.size()), obstacleColor);
+		}
+		if (vertexPullingBoids) {
+			api.boids(renderBoids.x.data(), renderBoids.y.data(), renderBoids.vx.data(), renderBoids.vy.data(), renderBoids.neighborCount.data(), renderBoids.size(),
+				boidsModelArrowThickness, boidsModelArrowHat, minNeighborColor, maxNeighborColor, maxNeighborForColor);
+			return;
+		}
+		for (int i = 0; i < renderBoids.size(); ++i) {
+			const glm::vec2 position = { renderBoids.x[i], renderBoids.y[i] };
+			const glm::vec2 velocity = { renderBoids.vx[i], renderBoids.vy[i] };
+			//api.circleFill(position, 5, 10, red);
+			api.arrow(position, position + normalize(velocity),boidsModelArrowThickness,boidsModelArrowHat,getColor(renderBoids.neighborCount[i]));
 		}
 	}
 
@@ -238,6 +350,17 @@ struct BoidsViewer : Viewer {
 		static bool showDemoWindow = false;
 
 		ImGui::Begin("3D Sandbox - Boids");
+		ImGui::SliderInt("Boids Count", &numBoids, 1, 200000, "%d", ImGuiSliderFlags_Logarithmic);
+		if (ImGui::Button("Reset Boids")) {
+			resetBoids();
+		}
+		if (ImGui::Checkbox("3D Flock", &flock3DMode)) {
+			resetBoids();
+		}
+		if (flock3DMode) {
+			ImGui::SliderFloat("3D Box Size", &box3DSize, 100.f, 4000.f);
+			ImGui::SliderFloat("3D Glyph Size", &glyph3DSize, 0.001f, 0.2f);
+		}
 		ImGui::SliderFloat("Boids Coherence", &boidsCoherence, 0.0f, 1.0f);
 		ImGui::SliderFloat("Boids Separation", &boidsSeparation, 0.0f, 1.0f);
 		ImGui::SliderFloat("Boids Alignment", &boidsAlignment, 0.0f, 1.0f);
@@ -249,6 +372,102 @@ struct BoidsViewer : Viewer {
 		ImGui::SliderFloat("Boids Model Arrow Hat", &boidsModelArrowHat, 0.0f, 100.0f);
 		ImGui::SliderInt("Boids Neighbor For Color", &maxNeighborForColor, 0, numBoids);
 		ImGui::Checkbox("Mouse Attracts Boids", &mouseAttractBoids);
+		ImGui::Checkbox("Pipelined Simulation", &pipelined);
+		ImGui::Checkbox("Allow AVX2", &allowAvx2);
+		if (!flock3DMode) {
+			drawPointCacheGUI(5);
+		}
+		ImGui::Checkbox("Vertex Pulling Arrows", &vertexPullingBoids);
+		if (!flock3DMode) {
+			ImGui::Checkbox("Topological (k Nearest)", &topological);
+			if (topological) {
+				ImGui::SliderInt("Nearest Neighbors", &topologicalNeighbors, 1, 32);
+			}
+			else {
+				ImGui::Checkbox("Verlet Neighbor Lists", &useVerletLists);
+			}
+			if (!topological && useVerletLists) {
+				ImGui::SliderFloat("Verlet Skin", &verletSkin, 0.f, 50.f);
+				if (ImGui::SliderInt("Verlet List Capacity", &flock.verletLists.capacity, 8, 512)) {
+					invalidateVerletLists(flock);
+				}
+			}
+			ImGui::SliderInt("Morton Reorder Interval", &reorderInterval, 0, 120);
+		}
+
+		if (!flock3DMode && ImGui::CollapsingHeader("Obstacles")) {
+			ImGui::Checkbox("Avoid Obstacles", &avoidObstacles);
+			ImGui::SliderFloat("Obstacle Margin", &obstacleMargin, 0.f, obstacles.maxDistance);
+			ImGui::SliderFloat("Obstacle Avoidance", &obstacleAvoidance, 0.f, 5.f);
+			ImGui::SliderFloat("New Obstacle Size", &newObstacleRadius, 5.f, 200.f);
+			const glm::vec2 viewportCenter = { 0.5f * viewportWidth, 0.5f * viewportHeight };
+			if (ImGui::Button("Add Circle")) {
+				Obstacle obstacle;
+				obstacle.shape = ObstacleShape::Circle;
+				obstacle.center = viewportCenter;
+				obstacle.radius = newObstacleRadius;
+				addObstacle(obstacles, obstacle, threadPool);
+			}
+			ImGui::SameLine();
+			if (ImGui::Button("Add Triangle")) {
+				Obstacle obstacle;
+				obstacle.shape = ObstacleShape::Polygon;
+				obstacle.center = viewportCenter;
+				for (int i = 0; i < 3; ++i) {
+					const float angle = glm::radians(90.f + 120.f * i);
+					obstacle.points.push_back(glm::vec2(glm::cos(angle), glm::sin(angle)) * newObstacleRadius);
+				}
+				addObstacle(obstacles, obstacle, threadPool);
+			}
+			ImGui::InputText("Obstacles File", obstaclesPath, sizeof(obstaclesPath));
+			if (ImGui::Button("Load")) {
+				if (loadObstacles(obstaclesPath, obstacles.obstacles)) {
+					rebuildObstacleField(obstacles, obstacles.width, obstacles.height, threadPool);
+				}
+			}
+			ImGui::SameLine();
+			if (ImGui::Button("Save")) {
+				saveObstacles(obstaclesPath, obstacles.obstacles);
+			}
+
+			int removedObstacle = -1;
+			for (int i = 0; i < static_cast<int>(obstacles.obstacles.size()); ++i) {
+				Obstacle& obstacle = obstacles.obstacles[i];
+				ImGui::PushID(i);
+				glm::vec2 center = obstacle.center;
+				if (ImGui::DragFloat2(obstacle.shape == ObstacleShape::Circle ? "Circle" : "Polygon", &center.x)) {
+					moveObstacle(obstacles, i, center, threadPool);
+				}
+				if (obstacle.shape == ObstacleShape::Circle) {
+					glm::vec2 previousMin, previousMax;
+					obstacleBounds(obstacle, previousMin, previousMax);
+					if (ImGui::DragFloat("Radius", &obstacle.radius, 1.f, 1.f, 500.f)) {
+						refreshObstacle(obstacles, i, previousMin, previousMax, threadPool);
+					}
+				}
+				if (ImGui::Button("Remove")) {
+					removedObstacle = i;
+				}
+				ImGui::PopID();
+			}
+			if (removedObstacle >= 0) {
+				removeObstacle(obstacles, removedObstacle, threadPool);
+			}
+		}
+
+		if (!flock3DMode && ImGui::CollapsingHeader("Clusters")) {
+			ImGui::Checkbox("Detect Clusters", &detectClusters);
+			ImGui::SliderInt("Cluster Interval", &clusterInterval, 1, 60);
+			ImGui::InputText("Cluster Log", clusterLogPath, sizeof(clusterLogPath));
+			if (clusters.pLogFile == nullptr) {
+				if (ImGui::Button("Start Cluster Log")) {
+					startBoidClusterLog(clusters, clusterLogPath);
+				}
+			}
+			else if (ImGui::Button("Stop Cluster Log")) {
+				stopBoidClusterLog(clusters);
+			}
+		}
 
 		if (ImGui::CollapsingHeader("Boids Colors")) {
 			ImGui::ColorPicker3("Min Neighbors Color", reinterpret_cast<float *>(&minNeighborColor));
@@ -257,14 +476,32 @@ struct BoidsViewer : Viewer {
 
 		// Drop down
 		if (ImGui::CollapsingHeader("Boids List")) {
-			// Iterate through boids with index loop
-			for (int i = 0; i < numBoids; i++) {
-				// Write the current boid index
-				ImGui::Text("Boid %d", i);
-				// Write position and velocity as text
-				ImGui::Text("Position: (%.2f, %.2f)", boids[i]->position.x, boids[i]->position.y);
-				ImGui::Text("Velocity: (%.2f, %.2f)", boids[i]->velocity.x, boids[i]->velocity.y);
-				ImGui::Separator();
+			// Only the visible rows are submitted
+			ImGuiListClipper clipper;
+			const BoidArrays& boids = flock.boids;
+			const BoidArrays3D& boids3D = flock3D.boids;
+			clipper.Begin(flock3DMode ? boids3D.size() : boids.size());
+			while (clipper.Step()) {
+				if (flock3DMode) {
+					for (int i = clipper.DisplayStart; i < clipper.DisplayEnd; i++) {
+						ImGui::Text("Boid %d", i);
+						ImGui::SameLine();
+						ImGui::Text("Position: (%.2f, %.2f, %.2f)", boids3D.x[i], boids3D.y[i], boids3D.z[i]);
+						ImGui::SameLine();
+						ImGui::Text("Velocity: (%.2f, %.2f, %.2f)", boids3D.vx[i], boids3D.vy[i], boids3D.vz[i]);
+					}
+					continue;
+				}
+				for (int row = clipper.DisplayStart; row < clipper.DisplayEnd; row++) {
+					// Rows follow boid ids, storage is reordered under them
+					const int i = flock.indexOfId(row);
+					ImGui::Text("Boid %d", row);
+					// Write position and velocity as text
+					ImGui::SameLine();
+					ImGui::Text("Position: (%.2f, %.2f)", boids.x[i], boids.y[i]);
+					ImGui::SameLine();
+					ImGui::Text("Velocity: (%.2f, %.2f)", boids.vx[i], boids.vy[i]);
+				}
 			}
 		}
 
@@ -301,4 +538,48 @@ struct BoidsViewer : Viewer {
 			ImGui::ShowDemoWindow(&showDemoWindow);
 		}
 	}
+
+	void drawInstrumentationGUI() override {
+		ImGui::Text("Boids: %d", flock3DMode ? flock3D.boids.size() : flock.boids.size());
+		ImGui::Text("Simulation step: %.3f ms on %d threads", simulationStepMs, threadPoolSize(threadPool));
+		if (flock3DMode) {
+			ImGui::Text("Hashed grid: %d buckets", flock3D.grid.bucketCount());
+			return;
+		}
+		ImGui::Text("Obstacles: %d, field %d x %d nodes, last rebuild %d nodes in %.3f ms", static_cast<int>(obstacles.obstacles.size()),
+			obstacles.nodeCountX, obstacles.nodeCountY, obstacles.lastRebuildNodeCount, obstacles.lastRebuildMs);
+		if (detectClusters && clusters.valid) {
+			ImGui::Text("Clusters: %d, largest %d boids, %d lone boids, %.3f ms", clusters.clusterCount, clusters.largestCluster, clusters.singletonCount, clusters.detectionMs);
+			ImGui::PlotHistogram("Cluster Sizes", clusters.histogram, BOID_CLUSTER_HISTOGRAM_BINS, 0, "1, 2-3, 4-7, ...", 0.f, FLT_MAX, ImVec2(0, 80));
+		}
+		else if (detectClusters) {
+			ImGui::Text("Clusters: needs the grid or Verlet lists");
+		}
+		const BoidReorderStats& reorder = flock.reorder;
+		if (reorderInterval > 0) {
+			ImGui::Text("Morton reorder: every %d steps, %.3f ms, %u done", reorderInterval, reorder.lastReorderMs, reorder.reorderCount);
+		}
+		ImGui::Text("Estimated cache misses per step: %d", reorder.estimatedMissesPerStep);
+		if (reorder.reorderCount > 0) {
+			ImGui::Text("At the last reorder: %d -> %d", reorder.estimatedMissesBeforeReorder, reorder.estimatedMissesAfterReorder);
+		}
+		if (topological) {
+			ImGui::Text("k-d tree: %d nearest, build %.3f ms, queries and rules %.3f ms", topologicalNeighbors, flock.kdTreeBuildMs, glm::max(simulationStepMs - flock.kdTreeBuildMs, 0.f));
+			return;
+		}
+		ImGui::Text("Grid: %d x %d cells", flock.grid.cellCountX, flock.grid.cellCountY);
+		ImGui::Text("Neighbor kernel: %s%s", flock.usedAvx2 ? "AVX2" : "scalar", isAvx2Supported() ? "" : " (AVX2 unsupported)");
+
+		const BoidVerletLists& lists = flock.verletLists;
+		if (useVerletLists && lists.stepCount > 0) {
+			ImGui::Text("Verlet lists: rebuilt %u times in %u steps (every %.1f steps)", lists.rebuildCount, lists.stepCount, lists.stepCount / float(glm::max(lists.rebuildCount, 1u)));
+			ImGui::Text("Max displacement %.2f / %.2f, %d neighbors dropped at last build", lists.maxDisplacement, 0.5f * verletSkin, lists.overflowCount);
+		}
+		if (gridStepAverageMs > 0.f && verletStepAverageMs > 0.f) {
+			ImGui::Text("Average step: grid %.3f ms, Verlet %.3f ms (saves %.3f ms)", gridStepAverageMs, verletStepAverageMs, gridStepAverageMs - verletStepAverageMs);
+		}
+		else {
+			ImGui::Text("Run both modes to compare grid and Verlet step times");
+		}
+	}
 };
@@ -0,0 +1,144 @@
+#include "KdTree2D.h"
+
+#include <glm/common.hpp>
+#include <algorithm>
+#include <assert.h>
+#include <float.h>
+
+namespace {
+	struct KdRange {
+		int begin;
+		int end;
+	};
+
+	// Splits [begin, end) at its median along the axis of largest extent
+	int splitRange(KdTree2D& tree, int begin, int end) {
+		glm::vec2 minPosition = tree.points[tree.order[begin]];
+		glm::vec2 maxPosition = minPosition;
+		for (int i = begin + 1; i < end; ++i) {
+			minPosition = glm::min(minPosition, tree.points[tree.order[i]]);
+			maxPosition = glm::max(maxPosition, tree.points[tree.order[i]]);
+		}
+		const glm::vec2 extent = maxPosition - minPosition;
+		const int axis = extent.y > extent.x ? 1 : 0;
+
+		const int mid = (begin + end) / 2;
+		const std::vector<glm::vec2>& points = tree.points;
+		// Ties are broken by index so that the result is fully determined
+		std::nth_element(tree.order.begin() + begin, tree.order.begin() + mid, tree.order.begin() + end, [&points, axis](int a, int b) {
+			return points[a][axis] < points[b][axis] || (points[a][axis] == points[b][axis] && a < b);
+		});
+		tree.splitAxis[mid] = static_cast<unsigned char>(axis);
+		return mid;
+	}
+
+	void buildSubtree(KdTree2D& tree, int begin, int end) {
+		if (end - begin <= tree.leafSize) {
+			return;
+		}
+		const int mid = splitRange(tree, begin, end);
+		buildSubtree(tree, begin, mid);
+		buildSubtree(tree, mid + 1, end);
+	}
+
+	// Splits the first levels serially and returns the remaining subtrees
+	void splitTopLevels(KdTree2D& tree, int begin, int end, int depth, std::vector<KdRange>& subtrees) {
+		if (depth == 0 || end - begin <= tree.leafSize) {
+			subtrees.push_back({ begin, end });
+			return;
+		}
+		const int mid = splitRange(tree, begin, end);
+		splitTopLevels(tree, begin, mid, depth - 1, subtrees);
+		splitTopLevels(tree, mid + 1, end, depth - 1, subtrees);
+	}
+
+	struct NearestSet {
+		int k;
+		int count = 0;
+		int indices[KD_TREE_MAX_NEIGHBORS];
+		float distancesSq[KD_TREE_MAX_NEIGHBORS];
+
+		float worstDistanceSq() const {
+			return count < k ? FLT_MAX : distancesSq[count - 1];
+		}
+
+		void insert(int index, float distanceSq) {
+			if (distanceSq >= worstDistanceSq()) {
+				return;
+			}
+			int i = count < k ? count++ : count - 1;
+			for (; i > 0 && distancesSq[i - 1] > distanceSq; --i) {
+				distancesSq[i] = distancesSq[i - 1];
+				indices[i] = indices[i - 1];
+			}
+			distancesSq[i] = distanceSq;
+			indices[i] = index;
+		}
+	};
+
+	void searchNearest(const KdTree2D& tree, const glm::vec2& position, int begin, int end, NearestSet& nearest) {
+		if (end - begin <= tree.leafSize) {
+			for (int i = begin; i < end; ++i) {
+				const glm::vec2 offset = tree.points[i] - position;
+				nearest.insert(i, offset.x * offset.x + offset.y * offset.y);
+			}
+			return;
+		}
+		const int mid = (begin + end) / 2;
+		const int axis = tree.splitAxis[mid];
+		const glm::vec2 offset = tree.points[mid] - position;
+		nearest.insert(mid, offset.x * offset.x + offset.y * offset.y);
+
+		const float planeDistance = position[axis] - tree.points[mid][axis];
+		if (planeDistance < 0.f) {
+			searchNearest(tree, position, begin, mid, nearest);
+			if (planeDistance * planeDistance < nearest.worstDistanceSq()) {
+				searchNearest(tree, position, mid + 1, end, nearest);
+			}
+		}
+		else {
+			searchNearest(tree, position, mid + 1, end, nearest);
+			if (planeDistance * planeDistance < nearest.worstDistanceSq()) {
+				searchNearest(tree, position, begin, mid, nearest);
+			}
+		}
+	}
+}
+
+void buildKdTree(KdTree2D& tree, const float* x, const float* y, int count, ThreadPool& pool) {
+	// Split on item positions first, they are moved to tree order at the end
+	tree.points.resize(count);
+	tree.order.resize(count);
+	tree.splitAxis.assign(count, 0);
+	for (int i = 0; i < count; ++i) {
+		tree.points[i] = { x[i], y[i] };
+		tree.order[i] = i;
+	}
+
+	// 64 subtrees keep a large pool busy while the serial part stays short
+	std::vector<KdRange> subtrees;
+	splitTopLevels(tree, 0, count, 6, subtrees);
+	parallelFor(pool, static_cast<int>(subtrees.size()), 1, [&](int begin, int end) {
+		for (int s = begin; s < end; ++s) {
+			buildSubtree(tree, subtrees[s].begin, subtrees[s].end);
+		}
+	});
+
+	std::vector<glm::vec2> itemPoints;
+	itemPoints.swap(tree.points);
+	tree.points.resize(count);
+	parallelFor(pool, count, 4096, [&](int begin, int end) {
+		for (int i = begin; i < end; ++i) {
+			tree.points[i] = itemPoints[tree.order[i]];
+		}
+	});
+}
+
+int findNearestNeighbors(const KdTree2D& tree, const glm::vec2& position, int k, int* pNeighbors) {
+	assert(k > 0 && k <= KD_TREE_MAX_NEIGHBORS);
+	NearestSet nearest;
+	nearest.k = k;
+	searchNearest(tree, position, 0, static_cast<int>(tree.points.size()), nearest);
+	std::copy(nearest.indices, nearest.indices + nearest.count, pNeighbors);
+	return nearest.count;
+}
@@ -0,0 +1,28 @@
+#pragma once
+
+#include "../threadpool.h"
+
+#include <glm/vec2.hpp>
+#include <vector>
+
+constexpr int KD_TREE_MAX_NEIGHBORS = 64;
+
+// Balanced 2D k-d tree stored implicitly: the node covering [begin, end) of
+// the points splits at mid = (begin + end) / 2 along splitAxis[mid], its
+// children cover [begin, mid) and [mid + 1, end). Ranges of at most leafSize
+// points are leaves.
+struct KdTree2D {
+	std::vector<int> order;        // item of each point, in tree order
+	std::vector<glm::vec2> points; // positions, in tree order
+	std::vector<unsigned char> splitAxis;
+	int leafSize = 8;
+};
+
+// Subtrees below the first levels are built in parallel. The tree only
+// depends on the positions, not on the thread count.
+void buildKdTree(KdTree2D& tree, const float* x, const float* y, int count, ThreadPool& pool);
+
+// Writes the tree order index of the (up to) k points nearest to position,
+// closest first, position itself included if it is in the tree. Returns the
+// count found. k <= KD_TREE_MAX_NEIGHBORS.
+int findNearestNeighbors(const KdTree2D& tree, const glm::vec2& position, int k, int* pNeighbors);
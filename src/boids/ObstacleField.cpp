@@ -0,0 +1,271 @@
+#include "ObstacleField.h"
+
+#include <glm/common.hpp>
+#include <glm/geometric.hpp>
+#include <assert.h>
+#include <chrono>
+#include <float.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+namespace {
+	void rebuildRegion(ObstacleField& field, const glm::vec2& regionMin, const glm::vec2& regionMax, ThreadPool& pool) {
+		const auto rebuildStart = std::chrono::steady_clock::now();
+		const glm::vec2 influenceMin = regionMin - field.maxDistance;
+		const glm::vec2 influenceMax = regionMax + field.maxDistance;
+		const int x0 = glm::clamp(static_cast<int>(glm::ceil(influenceMin.x / field.cellSize)), 0, field.nodeCountX - 1);
+		const int y0 = glm::clamp(static_cast<int>(glm::ceil(influenceMin.y / field.cellSize)), 0, field.nodeCountY - 1);
+		const int x1 = glm::clamp(static_cast<int>(glm::floor(influenceMax.x / field.cellSize)), 0, field.nodeCountX - 1);
+		const int y1 = glm::clamp(static_cast<int>(glm::floor(influenceMax.y / field.cellSize)), 0, field.nodeCountY - 1);
+		if (x0 > x1 || y0 > y1) {
+			field.lastRebuildNodeCount = 0;
+			return;
+		}
+
+		// Only obstacles within maxDistance of the region can change its nodes
+		const glm::vec2 nodesMin = glm::vec2(x0, y0) * field.cellSize;
+		const glm::vec2 nodesMax = glm::vec2(x1, y1) * field.cellSize;
+		std::vector<int> nearby;
+		for (int i = 0; i < static_cast<int>(field.obstacles.size()); ++i) {
+			glm::vec2 boundsMin, boundsMax;
+			obstacleBounds(field.obstacles[i], boundsMin, boundsMax);
+			if (boundsMin.x - field.maxDistance <= nodesMax.x && boundsMax.x + field.maxDistance >= nodesMin.x
+				&& boundsMin.y - field.maxDistance <= nodesMax.y && boundsMax.y + field.maxDistance >= nodesMin.y) {
+				nearby.push_back(i);
+			}
+		}
+
+		parallelFor(pool, y1 - y0 + 1, 4, [&](int begin, int end) {
+			for (int y = y0 + begin; y < y0 + end; ++y) {
+				for (int x = x0; x <= x1; ++x) {
+					const glm::vec2 position = glm::vec2(x, y) * field.cellSize;
+					float distance = field.maxDistance;
+					glm::vec2 gradient = glm::vec2(0.f);
+					for (const int i : nearby) {
+						glm::vec2 obstacleGradient;
+						const float obstacleDistance = obstacleSignedDistance(field.obstacles[i], position, obstacleGradient);
+						if (obstacleDistance < distance) {
+							distance = obstacleDistance;
+							gradient = obstacleGradient;
+						}
+					}
+					const int node = y * field.nodeCountX + x;
+					field.distances[node] = distance;
+					field.gradients[node] = gradient;
+				}
+			}
+		});
+
+		field.lastRebuildNodeCount = (x1 - x0 + 1) * (y1 - y0 + 1);
+		field.lastRebuildMs = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - rebuildStart).count();
+	}
+
+	glm::vec2 closestPointOnSegment(const glm::vec2& position, const glm::vec2& a, const glm::vec2& b) {
+		const glm::vec2 ab = b - a;
+		const float lengthSq = glm::dot(ab, ab);
+		const float t = lengthSq > 0.f ? glm::clamp(glm::dot(position - a, ab) / lengthSq, 0.f, 1.f) : 0.f;
+		return a + ab * t;
+	}
+}
+
+float obstacleSignedDistance(const Obstacle& obstacle, const glm::vec2& position, glm::vec2& gradient) {
+	if (obstacle.shape == ObstacleShape::Circle) {
+		const glm::vec2 offset = position - obstacle.center;
+		const float length = glm::length(offset);
+		gradient = length > 0.f ? offset / length : glm::vec2(0.f, 1.f);
+		return length - obstacle.radius;
+	}
+
+	const std::vector<glm::vec2>& points = obstacle.points;
+	if (points.empty()) {
+		gradient = glm::vec2(0.f);
+		return FLT_MAX;
+	}
+	float closestDistanceSq = FLT_MAX;
+	glm::vec2 closestPoint = obstacle.center + points[0];
+	bool inside = false;
+	for (size_t i = 0, j = points.size() - 1; i < points.size(); j = i++) {
+		const glm::vec2 a = obstacle.center + points[j];
+		const glm::vec2 b = obstacle.center + points[i];
+		const glm::vec2 point = closestPointOnSegment(position, a, b);
+		const glm::vec2 offset = position - point;
+		const float distanceSq = glm::dot(offset, offset);
+		if (distanceSq < closestDistanceSq) {
+			closestDistanceSq = distanceSq;
+			closestPoint = point;
+		}
+		// Even-odd rule
+		if ((a.y > position.y) != (b.y > position.y)
+			&& position.x < a.x + (position.y - a.y) * (b.x - a.x) / (b.y - a.y)) {
+			inside = !inside;
+		}
+	}
+	const float distance = glm::sqrt(closestDistanceSq);
+	gradient = distance > 0.f ? (position - closestPoint) / distance : glm::vec2(0.f);
+	if (inside) {
+		gradient = -gradient;
+		return -distance;
+	}
+	return distance;
+}
+
+void obstacleBounds(const Obstacle& obstacle, glm::vec2& min, glm::vec2& max) {
+	if (obstacle.shape == ObstacleShape::Circle || obstacle.points.empty()) {
+		min = obstacle.center - obstacle.radius;
+		max = obstacle.center + obstacle.radius;
+		return;
+	}
+	min = obstacle.points[0];
+	max = obstacle.points[0];
+	for (const glm::vec2& point : obstacle.points) {
+		min = glm::min(min, point);
+		max = glm::max(max, point);
+	}
+	min += obstacle.center;
+	max += obstacle.center;
+}
+
+void rebuildObstacleField(ObstacleField& field, float width, float height, ThreadPool& pool) {
+	assert(field.cellSize > 0.f);
+	field.width = width;
+	field.height = height;
+	field.nodeCountX = glm::max(2, static_cast<int>(glm::ceil(width / field.cellSize)) + 1);
+	field.nodeCountY = glm::max(2, static_cast<int>(glm::ceil(height / field.cellSize)) + 1);
+	field.distances.assign(field.nodeCountX * field.nodeCountY, field.maxDistance);
+	field.gradients.assign(field.nodeCountX * field.nodeCountY, glm::vec2(0.f));
+	rebuildRegion(field, glm::vec2(0.f), glm::vec2(width, height), pool);
+}
+
+void addObstacle(ObstacleField& field, const Obstacle& obstacle, ThreadPool& pool) {
+	field.obstacles.push_back(obstacle);
+	glm::vec2 min, max;
+	obstacleBounds(obstacle, min, max);
+	rebuildRegion(field, min, max, pool);
+}
+
+void removeObstacle(ObstacleField& field, int index, ThreadPool& pool) {
+	assert(index >= 0 && index < static_cast<int>(field.obstacles.size()));
+	glm::vec2 min, max;
+	obstacleBounds(field.obstacles[index], min, max);
+	field.obstacles.erase(field.obstacles.begin() + index);
+	rebuildRegion(field, min, max, pool);
+}
+
+void moveObstacle(ObstacleField& field, int index, const glm::vec2& center, ThreadPool& pool) {
+	assert(index >= 0 && index < static_cast<int>(field.obstacles.size()));
+	glm::vec2 previousMin, previousMax;
+	obstacleBounds(field.obstacles[index], previousMin, previousMax);
+	field.obstacles[index].center = center;
+	refreshObstacle(field, index, previousMin, previousMax, pool);
+}
+
+void refreshObstacle(ObstacleField& field, int index, const glm::vec2& previousMin, const glm::vec2& previousMax, ThreadPool& pool) {
+	glm::vec2 min, max;
+	obstacleBounds(field.obstacles[index], min, max);
+	// One region covering both bounds, a short move keeps it close to the
+	// size of the obstacle
+	rebuildRegion(field, glm::min(min, previousMin), glm::max(max, previousMax), pool);
+}
+
+void sampleObstacleField(const ObstacleField& field, const glm::vec2& position, float& distance, glm::vec2& gradient) {
+	if (field.distances.empty()) {
+		distance = field.maxDistance;
+		gradient = glm::vec2(0.f);
+		return;
+	}
+	const float fx = glm::clamp(position.x / field.cellSize, 0.f, static_cast<float>(field.nodeCountX - 1));
+	const float fy = glm::clamp(position.y / field.cellSize, 0.f, static_cast<float>(field.nodeCountY - 1));
+	const int x = glm::min(static_cast<int>(fx), field.nodeCountX - 2);
+	const int y = glm::min(static_cast<int>(fy), field.nodeCountY - 2);
+	const float tx = fx - static_cast<float>(x);
+	const float ty = fy - static_cast<float>(y);
+
+	const int node = y * field.nodeCountX + x;
+	const int above = node + field.nodeCountX;
+	distance = glm::mix(
+		glm::mix(field.distances[node], field.distances[node + 1], tx),
+		glm::mix(field.distances[above], field.distances[above + 1], tx), ty);
+	gradient = glm::mix(
+		glm::mix(field.gradients[node], field.gradients[node + 1], tx),
+		glm::mix(field.gradients[above], field.gradients[above + 1], tx), ty);
+}
+
+bool loadObstacles(char const* path, std::vector<Obstacle>& obstacles) {
+	FILE* pFile = fopen(path, "r");
+	if (!pFile) {
+		fprintf(stderr, "Failed to open file %s \n", path);
+		return false;
+	}
+	std::vector<Obstacle> loaded;
+	char line[4096];
+	int lineNumber = 0;
+	bool ok = true;
+	while (ok && fgets(line, sizeof(line), pFile)) {
+		++lineNumber;
+		char keyword[16];
+		int keywordLength = 0;
+		if (line[0] == '#' || sscanf(line, "%15s%n", keyword, &keywordLength) != 1) {
+			continue;
+		}
+
+		// Every number after the keyword
+		std::vector<float> values;
+		char* pCursor = line + keywordLength;
+		for (;;) {
+			char* pEnd = nullptr;
+			const float value = strtof(pCursor, &pEnd);
+			if (pEnd == pCursor) {
+				break;
+			}
+			values.push_back(value);
+			pCursor = pEnd;
+		}
+
+		Obstacle obstacle;
+		if (strcmp(keyword, "circle") == 0 && values.size() == 3) {
+			obstacle.shape = ObstacleShape::Circle;
+			obstacle.center = { values[0], values[1] };
+			obstacle.radius = values[2];
+		}
+		else if (strcmp(keyword, "polygon") == 0 && values.size() >= 8 && values.size() % 2 == 0) {
+			obstacle.shape = ObstacleShape::Polygon;
+			obstacle.center = { values[0], values[1] };
+			for (size_t i = 2; i < values.size(); i += 2) {
+				obstacle.points.push_back({ values[i], values[i + 1] });
+			}
+		}
+		else {
+			fprintf(stderr, "%s:%d: expected 'circle x y radius' or 'polygon x y' and at least 3 points\n", path, lineNumber);
+			ok = false;
+			break;
+		}
+		loaded.push_back(obstacle);
+	}
+	fclose(pFile);
+	if (ok) {
+		obstacles.swap(loaded);
+	}
+	return ok;
+}
+
+bool saveObstacles(char const* path, const std::vector<Obstacle>& obstacles) {
+	FILE* pFile = fopen(path, "w");
+	if (!pFile) {
+		fprintf(stderr, "Failed to open file %s \n", path);
+		return false;
+	}
+	for (const Obstacle& obstacle : obstacles) {
+		if (obstacle.shape == ObstacleShape::Circle) {
+			fprintf(pFile, "circle %g %g %g\n", obstacle.center.x, obstacle.center.y, obstacle.radius);
+			continue;
+		}
+		fprintf(pFile, "polygon %g %g", obstacle.center.x, obstacle.center.y);
+		for (const glm::vec2& point : obstacle.points) {
+			fprintf(pFile, " %g %g", point.x, point.y);
+		}
+		fprintf(pFile, "\n");
+	}
+	fclose(pFile);
+	return true;
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include "../threadpool.h"
+
+#include <glm/vec2.hpp>
+#include <vector>
+
+enum class ObstacleShape {
+	Circle,
+	Polygon
+};
+
+struct Obstacle {
+	ObstacleShape shape = ObstacleShape::Circle;
+	glm::vec2 center = glm::vec2(0.f);
+	float radius = 0.f; // Circle
+	// Polygon, closed, relative to center, either winding
+	std::vector<glm::vec2> points = std::vector<glm::vec2>();
+};
+
+// Signed distance to the closest obstacle (negative inside) and its gradient
+// at the nodes of a grid over [0, width] x [0, height]. Distances are clamped
+// to maxDistance, so an obstacle only changes the nodes within maxDistance of
+// its bounds and moving it only rebuilds that region.
+struct ObstacleField {
+	std::vector<Obstacle> obstacles = std::vector<Obstacle>();
+
+	float cellSize = 8.f;
+	float maxDistance = 64.f;
+	float width = 0.f;
+	float height = 0.f;
+	int nodeCountX = 0;
+	int nodeCountY = 0;
+	// Node (x, y) is at (x, y) * cellSize
+	std::vector<float> distances = std::vector<float>();
+	std::vector<glm::vec2> gradients = std::vector<glm::vec2>();
+
+	// Stats of the last rebuild
+	int lastRebuildNodeCount = 0;
+	float lastRebuildMs = 0.f;
+};
+
+float obstacleSignedDistance(const Obstacle& obstacle, const glm::vec2& position, glm::vec2& gradient);
+
+// Rebuilds every node, for a new area or a new cell size
+void rebuildObstacleField(ObstacleField& field, float width, float height, ThreadPool& pool);
+
+// Incremental edits, only the nodes near the old and new bounds are rebuilt
+void addObstacle(ObstacleField& field, const Obstacle& obstacle, ThreadPool& pool);
+void removeObstacle(ObstacleField& field, int index, ThreadPool& pool);
+void moveObstacle(ObstacleField& field, int index, const glm::vec2& center, ThreadPool& pool);
+// Call after changing the shape of an obstacle in place, with its bounds
+// before the change
+void refreshObstacle(ObstacleField& field, int index, const glm::vec2& previousMin, const glm::vec2& previousMax, ThreadPool& pool);
+
+void obstacleBounds(const Obstacle& obstacle, glm::vec2& min, glm::vec2& max);
+
+// Bilinear, positions outside the area are clamped to its border
+void sampleObstacleField(const ObstacleField& field, const glm::vec2& position, float& distance, glm::vec2& gradient);
+
+// Text file, one obstacle per line:
+//   circle <x> <y> <radius>
+//   polygon <x> <y> <x0> <y0> <x1> <y1> ... (points relative to x y)
+// Lines starting with # are ignored
+bool loadObstacles(char const* path, std::vector<Obstacle>& obstacles);
+bool saveObstacles(char const* path, const std::vector<Obstacle>& obstacles);
@@ -86,20 +86,20 @@ struct BounceViewer : Viewer {
 	void update(double elapsedTime) override {
 		boneAngle = static_cast<float>(elapsedTime);
 		elapsedTimeGlobal = static_cast<float>(elapsedTime);
-		leftMouseButtonPressed = glfwGetMouseButton(window, GLFW_MOUSE_BUTTON_LEFT) == GLFW_PRESS;
+		leftMouseButtonPressed = isMouseButtonPressed(GLFW_MOUSE_BUTTON_LEFT);
 		rightMouseButtonPressedPrevious = rightMouseButtonPressed;
-		rightMouseButtonPressed = glfwGetMouseButton(window, GLFW_MOUSE_BUTTON_RIGHT) == GLFW_PRESS;
+		rightMouseButtonPressed = isMouseButtonPressed(GLFW_MOUSE_BUTTON_RIGHT);
 		if (rightMouseButtonPressed && !rightMouseButtonPressedPrevious) {
             rightMouseButtonReleased = true;
         } else {
             rightMouseButtonReleased = false;
         }
 
-		altKeyPressed = glfwGetKey(window, GLFW_KEY_LEFT_ALT) == GLFW_PRESS || glfwGetKey(window, GLFW_KEY_RIGHT_ALT) == GLFW_PRESS;
+		altKeyPressed = isKeyPressed(GLFW_KEY_LEFT_ALT) || isKeyPressed(GLFW_KEY_RIGHT_ALT);
 
 		double mouseX;
 		double mouseY;
-		glfwGetCursorPos(window, &mouseX, &mouseY);
+		getCursorPos(mouseX, mouseY);
 
 		// Only bounce on right click
 		if (rightMouseButtonReleased) {
@@ -0,0 +1,233 @@
+#include "ClothSystem.h"
+
+#include <glm/geometric.hpp>
+#include <algorithm>
+#include <assert.h>
+#include <math.h>
+
+namespace {
+	// A chunk is a few microseconds of work, small cloths solve inline
+	constexpr int CLOTH_CHUNK_SIZE = 2048;
+
+	// Stable counting sort of the constraints by color
+	void groupClothConstraintsByColor(ClothSystem& cloth) {
+		const int count = getClothConstraintCount(cloth);
+		int colorCount = 0;
+		for (int c = 0; c < count; ++c) {
+			colorCount = std::max(colorCount, cloth.color[c] + 1);
+		}
+		cloth.colorStart.assign(colorCount + 1, 0);
+		for (int c = 0; c < count; ++c) {
+			++cloth.colorStart[cloth.color[c] + 1];
+		}
+		for (int k = 0; k < colorCount; ++k) {
+			cloth.colorStart[k + 1] += cloth.colorStart[k];
+		}
+
+		std::vector<int> slots(cloth.colorStart.begin(), cloth.colorStart.end() - 1);
+		std::vector<uint32_t> endpoints(cloth.endpoints.size());
+		std::vector<float> restLength(count);
+		std::vector<uint8_t> broken(count);
+		std::vector<uint8_t> color(count);
+		for (int c = 0; c < count; ++c) {
+			const int slot = slots[cloth.color[c]]++;
+			endpoints[2 * slot] = cloth.endpoints[2 * c];
+			endpoints[2 * slot + 1] = cloth.endpoints[2 * c + 1];
+			restLength[slot] = cloth.restLength[c];
+			broken[slot] = cloth.broken[c];
+			color[slot] = cloth.color[c];
+		}
+		cloth.endpoints.swap(endpoints);
+		cloth.restLength.swap(restLength);
+		cloth.broken.swap(broken);
+		cloth.color.swap(color);
+		cloth.colorsGrouped = true;
+	}
+
+	void solveClothConstraintRange(ClothSystem& cloth, const ClothParams& params, int begin, int end) {
+		// Everything in locals: the byte stores to broken may alias anything, the
+		// compiler would otherwise reload the array pointers and params each iteration
+		const uint32_t* pEndpoints = cloth.endpoints.data();
+		const float* pRestLength = cloth.restLength.data();
+		uint8_t* pBroken = cloth.broken.data();
+		float* pX = cloth.positionX.data();
+		float* pY = cloth.positionY.data();
+		float* pZ = cloth.positionZ.data();
+		const float* pInvMass = cloth.invMass.data();
+		const float strength = params.strength;
+		const float maxElongationRatio = params.maxElongationRatio;
+		for (int c = begin; c < end; ++c) {
+			const uint32_t a = pEndpoints[2 * c];
+			const uint32_t b = pEndpoints[2 * c + 1];
+			const float dx = pX[a] - pX[b];
+			const float dy = pY[a] - pY[b];
+			const float dz = pZ[a] - pZ[b];
+			const float distance = sqrtf(dx * dx + dy * dy + dz * dz);
+			const float restLength = pRestLength[c];
+
+			// Zero when compressed or already broken
+			const float stretch = std::max(distance - restLength, 0.f) * float(1 - pBroken[c]);
+			pBroken[c] |= uint8_t(distance > restLength * maxElongationRatio);
+
+			// Both ends pinned or coincident: the stretch or both weights are 0
+			const float weightA = pInvMass[a];
+			const float weightB = pInvMass[b];
+			const float scale = strength * stretch / std::max(distance * (weightA + weightB), 1e-12f);
+			pX[a] -= weightA * scale * dx;
+			pY[a] -= weightA * scale * dy;
+			pZ[a] -= weightA * scale * dz;
+			pX[b] += weightB * scale * dx;
+			pY[b] += weightB * scale * dy;
+			pZ[b] += weightB * scale * dz;
+		}
+	}
+}
+
+void clearCloth(ClothSystem& cloth) {
+	for (std::vector<float>* pArray : { &cloth.positionX, &cloth.positionY, &cloth.positionZ,
+		&cloth.previousX, &cloth.previousY, &cloth.previousZ,
+		&cloth.velocityX, &cloth.velocityY, &cloth.velocityZ, &cloth.invMass, &cloth.mass, &cloth.restLength }) {
+		pArray->clear();
+	}
+	cloth.particleColors.clear();
+	cloth.endpoints.clear();
+	cloth.broken.clear();
+	cloth.color.clear();
+	cloth.colorStart.clear();
+	cloth.colorsGrouped = true;
+}
+
+int addClothParticle(ClothSystem& cloth, const glm::vec3& position, float mass) {
+	assert(mass > 0.f);
+	const int particle = getClothParticleCount(cloth);
+	cloth.positionX.push_back(position.x);
+	cloth.positionY.push_back(position.y);
+	cloth.positionZ.push_back(position.z);
+	cloth.previousX.push_back(position.x);
+	cloth.previousY.push_back(position.y);
+	cloth.previousZ.push_back(position.z);
+	cloth.velocityX.push_back(0.f);
+	cloth.velocityY.push_back(0.f);
+	cloth.velocityZ.push_back(0.f);
+	cloth.invMass.push_back(1.f / mass);
+	cloth.mass.push_back(mass);
+	cloth.particleColors.push_back(0);
+	return particle;
+}
+
+void addClothConstraint(ClothSystem& cloth, int particle1, int particle2) {
+	assert(particle1 != particle2);
+	cloth.endpoints.push_back(static_cast<uint32_t>(particle1));
+	cloth.endpoints.push_back(static_cast<uint32_t>(particle2));
+	cloth.restLength.push_back(glm::length(getClothParticlePosition(cloth, particle1) - getClothParticlePosition(cloth, particle2)));
+	cloth.broken.push_back(0);
+
+	const uint64_t usedColors = cloth.particleColors[particle1] | cloth.particleColors[particle2];
+	assert(usedColors != ~uint64_t(0) && "more than CLOTH_MAX_COLOR_COUNT colors needed");
+	int color = 0;
+	while (usedColors & (uint64_t(1) << color)) {
+		++color;
+	}
+	cloth.particleColors[particle1] |= uint64_t(1) << color;
+	cloth.particleColors[particle2] |= uint64_t(1) << color;
+	cloth.color.push_back(static_cast<uint8_t>(color));
+	cloth.colorsGrouped = false;
+}
+
+glm::vec3 getClothParticlePosition(const ClothSystem& cloth, int particle) {
+	return glm::vec3(cloth.positionX[particle], cloth.positionY[particle], cloth.positionZ[particle]);
+}
+
+void setClothParticlePinned(ClothSystem& cloth, int particle, bool pinned) {
+	cloth.invMass[particle] = pinned ? 0.f : 1.f / cloth.mass[particle];
+	cloth.velocityX[particle] = 0.f;
+	cloth.velocityY[particle] = 0.f;
+	cloth.velocityZ[particle] = 0.f;
+}
+
+void setClothParticleMass(ClothSystem& cloth, int particle, float mass) {
+	assert(mass > 0.f);
+	cloth.mass[particle] = mass;
+	if (!isClothParticlePinned(cloth, particle)) {
+		cloth.invMass[particle] = 1.f / mass;
+	}
+}
+
+void integrateCloth(ClothSystem& cloth, const ClothParams& params, float dt) {
+	const int count = getClothParticleCount(cloth);
+	const glm::vec3 acceleration = params.gravity + params.wind;
+	for (int i = 0; i < count; ++i) {
+		// A select rather than a branch: pinned particles keep a zero velocity
+		const float movable = cloth.invMass[i] > 0.f ? 1.f : 0.f;
+		const float friction = params.airFriction * cloth.invMass[i];
+		cloth.previousX[i] = cloth.positionX[i];
+		cloth.previousY[i] = cloth.positionY[i];
+		cloth.previousZ[i] = cloth.positionZ[i];
+		cloth.velocityX[i] = movable * (cloth.velocityX[i] + (acceleration.x - friction * cloth.velocityX[i]) * dt);
+		cloth.velocityY[i] = movable * (cloth.velocityY[i] + (acceleration.y - friction * cloth.velocityY[i]) * dt);
+		cloth.velocityZ[i] = movable * (cloth.velocityZ[i] + (acceleration.z - friction * cloth.velocityZ[i]) * dt);
+		cloth.positionX[i] += cloth.velocityX[i] * dt;
+		cloth.positionY[i] += cloth.velocityY[i] * dt;
+		cloth.positionZ[i] += cloth.velocityZ[i] * dt;
+	}
+}
+
+void solveClothConstraints(ClothSystem& cloth, const ClothParams& params, ThreadPool& pool) {
+	if (!cloth.colorsGrouped) {
+		groupClothConstraintsByColor(cloth);
+	}
+	for (int k = 0; k < getClothColorCount(cloth); ++k) {
+		const int first = cloth.colorStart[k];
+		parallelFor(pool, cloth.colorStart[k + 1] - first, CLOTH_CHUNK_SIZE, [&](int begin, int end) {
+			solveClothConstraintRange(cloth, params, first + begin, first + end);
+		});
+	}
+}
+
+void updateClothVelocities(ClothSystem& cloth, float dt) {
+	if (dt <= 0.f) {
+		return;
+	}
+	const int count = getClothParticleCount(cloth);
+	const float inverseDt = 1.f / dt;
+	for (int i = 0; i < count; ++i) {
+		cloth.velocityX[i] = (cloth.positionX[i] - cloth.previousX[i]) * inverseDt;
+		cloth.velocityY[i] = (cloth.positionY[i] - cloth.previousY[i]) * inverseDt;
+		cloth.velocityZ[i] = (cloth.positionZ[i] - cloth.previousZ[i]) * inverseDt;
+	}
+}
+
+int removeBrokenClothConstraints(ClothSystem& cloth) {
+	// Compacting in order keeps the colors grouped, only their bounds move
+	const int count = getClothConstraintCount(cloth);
+	std::fill(cloth.colorStart.begin(), cloth.colorStart.end(), 0);
+	int kept = 0;
+	for (int c = 0; c < count; ++c) {
+		const uint32_t particle1 = cloth.endpoints[2 * c];
+		const uint32_t particle2 = cloth.endpoints[2 * c + 1];
+		const uint8_t color = cloth.color[c];
+		if (cloth.broken[c]) {
+			// A particle has at most one constraint per color
+			cloth.particleColors[particle1] &= ~(uint64_t(1) << color);
+			cloth.particleColors[particle2] &= ~(uint64_t(1) << color);
+			continue;
+		}
+		cloth.endpoints[2 * kept] = particle1;
+		cloth.endpoints[2 * kept + 1] = particle2;
+		cloth.restLength[kept] = cloth.restLength[c];
+		cloth.broken[kept] = 0;
+		cloth.color[kept] = color;
+		if (cloth.colorsGrouped) {
+			++cloth.colorStart[color + 1];
+		}
+		++kept;
+	}
+	for (int k = 0; k + 1 < static_cast<int>(cloth.colorStart.size()); ++k) {
+		cloth.colorStart[k + 1] += cloth.colorStart[k];
+	}
+	cloth.endpoints.resize(2 * kept);
+	cloth.restLength.resize(kept);
+	cloth.broken.resize(kept);
+	cloth.color.resize(kept);
+	return count - kept;
+}
@@ -0,0 +1,103 @@
+#pragma once
+
+#include "../threadpool.h"
+
+#include <glm/vec3.hpp>
+#include <stdint.h>
+#include <vector>
+
+struct ClothParams {
+	glm::vec3 gravity = { 0.f, -9.81f, 0.f };
+	glm::vec3 wind = { 0.f, 0.f, 0.f };
+	float airFriction = 0.5f;
+	// Share of a constraint's stretch corrected per solve
+	float strength = 1.f;
+	// A constraint breaks once stretched past its rest length times this
+	float maxElongationRatio = 1.5f;
+};
+
+// Cloth as structure of arrays. Constraints refer to particles by index, so
+// the particle arrays may grow without invalidating them. A pinned particle
+// has an inverse mass of 0: the integration and the solver move particles
+// proportionally to it, without branching on the pinned state.
+//
+// Constraints are colored as they are added: no two constraints of the same
+// color share a particle, so a color is solved in parallel without races and
+// the result does not depend on the thread count. Removing constraints never
+// makes two of a color share a particle, it only frees colors.
+constexpr int CLOTH_MAX_COLOR_COUNT = 64;
+
+struct ClothSystem {
+	// Particles
+	std::vector<float> positionX;
+	std::vector<float> positionY;
+	std::vector<float> positionZ;
+	std::vector<float> previousX; // position at the start of the substep
+	std::vector<float> previousY;
+	std::vector<float> previousZ;
+	std::vector<float> velocityX;
+	std::vector<float> velocityY;
+	std::vector<float> velocityZ;
+	std::vector<float> invMass; // 0 = pinned
+	std::vector<float> mass; // restored on unpinning, never read by the solver
+	std::vector<uint64_t> particleColors; // bit k set: one of the particle's constraints has color k
+
+	// Constraints
+	std::vector<uint32_t> endpoints; // two particle indices per constraint
+	std::vector<float> restLength;
+	std::vector<uint8_t> broken; // set by the solver or when cut, removed by removeBrokenClothConstraints
+	std::vector<uint8_t> color;
+
+	// The constraints of color k are [colorStart[k], colorStart[k + 1]) once
+	// grouped. Constraints added since the last solve are grouped by it.
+	std::vector<int> colorStart;
+	bool colorsGrouped = true;
+};
+
+void clearCloth(ClothSystem& cloth);
+
+inline int getClothParticleCount(const ClothSystem& cloth) {
+	return static_cast<int>(cloth.positionX.size());
+}
+
+inline int getClothConstraintCount(const ClothSystem& cloth) {
+	return static_cast<int>(cloth.restLength.size());
+}
+
+inline int getClothColorCount(const ClothSystem& cloth) {
+	return cloth.colorStart.empty() ? 0 : static_cast<int>(cloth.colorStart.size()) - 1;
+}
+
+// Returns the index of the new particle, at rest
+int addClothParticle(ClothSystem& cloth, const glm::vec3& position, float mass);
+
+// The rest length is the current distance between the particles. Takes the
+// lowest color free on both particles.
+void addClothConstraint(ClothSystem& cloth, int particle1, int particle2);
+
+glm::vec3 getClothParticlePosition(const ClothSystem& cloth, int particle);
+
+void setClothParticlePinned(ClothSystem& cloth, int particle, bool pinned);
+
+inline bool isClothParticlePinned(const ClothSystem& cloth, int particle) {
+	return cloth.invMass[particle] == 0.f;
+}
+
+void setClothParticleMass(ClothSystem& cloth, int particle, float mass);
+
+// Saves the positions, applies gravity, wind and air friction to the
+// velocities and moves the particles by them
+void integrateCloth(ClothSystem& cloth, const ClothParams& params, float dt);
+
+// One Gauss-Seidel pass over the constraints, color after color, each color
+// spread over the pool. Only stretched constraints pull; each end moves by its
+// share of the inverse mass. Constraints stretched past the elongation ratio
+// are flagged broken and stop pulling.
+void solveClothConstraints(ClothSystem& cloth, const ClothParams& params, ThreadPool& pool);
+
+// Velocities from the distance travelled since integrateCloth
+void updateClothVelocities(ClothSystem& cloth, float dt);
+
+// Drops the broken constraints, keeping the order and color of the others and
+// freeing their colors on their particles. Returns how many were removed.
+int removeBrokenClothConstraints(ClothSystem& cloth);
@@ -12,8 +12,7 @@
 #include <glm/gtx/euler_angles.hpp>
 #include <glm/gtx/quaternion.hpp>
 #include "../MyViewer.cpp"
-#include "ClothParticle.hpp"
-#include "ClothConstraint.hpp"
+#include "ClothSystem.h"
 #include <vector>
 #include <iostream>
 #include <algorithm>
@@ -35,9 +34,8 @@ struct ClothViewer : Viewer {
 	VertexShaderAdditionalData additionalShaderData;
 
 	// Cloth variables
-	std::vector<ClothParticle> particles = std::vector<ClothParticle>();
-	std::vector<ClothConstraint> constraints = std::vector<ClothConstraint>();
-	std::vector<ClothParticle*> anchorParticles = std::vector<ClothParticle*>();
+	ClothSystem cloth;
+	std::vector<int> anchorParticles = std::vector<int>();
 	std::vector<std::tuple<glm::vec3, glm::vec3>> lastRays = std::vector<std::tuple<glm::vec3, glm::vec3>>();
 	float previousElapsedTime = 0.f;
 	float deltaTime = 0.f;
@@ -58,6 +56,12 @@ struct ClothViewer : Viewer {
 	float clothConstraintStrength = 1.f;
 	float clothConstraintMaxElongationRatio = 1.5f;
 
+	// Render snapshot, written by publishSnapshot() only
+	std::vector<glm::vec3> renderParticlePositions = std::vector<glm::vec3>();
+	std::vector<glm::vec3> renderConstraintVertices = std::vector<glm::vec3>();
+	// Set by publishSnapshot(), the cloth stays frozen while a point cache plays
+	bool playingPointCache = false;
+
 	ClothViewer() : Viewer("ClothViewer", 1280, 720) {}
 
 	void init() override {
@@ -77,8 +81,7 @@ struct ClothViewer : Viewer {
 	void initCloth() {
 
 		// Clear the particles and constraints (to enable resets)
-		particles.clear();
-		constraints.clear();
+		clearCloth(cloth);
 		anchorParticles.clear();
 		lastRays.clear();
 
@@ -87,21 +90,27 @@ struct ClothViewer : Viewer {
 			for (int y = 0; y < clothHeight; ++y) {
 				for (int z = 0; z < clothLength; ++z) {
 					const glm::vec3 position = glm::vec3(x, y, z) * distanceBetweenParticlesOnSpawn;
-					ClothParticle particle;
-					particle.position = position;
-					particles.emplace_back(particle);
+					addClothParticle(cloth, position, 1.f);
 				}
 			}
 		}
 
-		// Create links between particles and their neighbors
-		for (int x = 0; x < clothWidth; ++x) {
-			for (int y = 0; y < clothHeight; ++y) {
-				for (int z = 0; z < clothLength; ++z) {
-					const int index = x * clothHeight * clothLength + y * clothLength + z;
-					if (x < clothWidth - 1) createLink(particles[index], particles[index + clothHeight * clothLength]);
-					if (y < clothHeight - 1) createLink(particles[index], particles[index + clothLength]);
-					if (z < clothLength - 1) createLink(particles[index], particles[index + 1]);
+		// Create links between particles and their neighbors, one axis at a time
+		// and even rows before odd ones: the greedy coloring then needs only two
+		// colors per axis, the fewest batches for the solver
+		const int extents[3] = { clothWidth, clothHeight, clothLength };
+		const int strides[3] = { clothHeight * clothLength, clothLength, 1 };
+		for (int axis = 0; axis < 3; ++axis) {
+			for (int parity = 0; parity < 2; ++parity) {
+				for (int x = 0; x < clothWidth; ++x) {
+					for (int y = 0; y < clothHeight; ++y) {
+						for (int z = 0; z < clothLength; ++z) {
+							const int coordinates[3] = { x, y, z };
+							if (coordinates[axis] % 2 != parity || coordinates[axis] == extents[axis] - 1) continue;
+							const int index = x * clothHeight * clothLength + y * clothLength + z;
+							addClothConstraint(cloth, index, index + strides[axis]);
+						}
+					}
 				}
 			}
 		}
@@ -110,7 +119,7 @@ struct ClothViewer : Viewer {
 		/*for (int x = 0; x < clothWidth; ++x) {
 			for (int z = 0; z < clothLength; ++z) {
 				const int index = x * clothHeight * clothLength + (clothHeight - 1) * clothLength + z;
-				particles[index].moving = false;
+				setClothParticlePinned(cloth, index, true);
 			}
 		}*/
 
@@ -118,34 +127,34 @@ struct ClothViewer : Viewer {
 		for (int z = 0; z < clothLength; ++z) {
 			const int index1 = (clothWidth - 1) * clothHeight * clothLength + (clothHeight - 1) * clothLength + z;
 			const int index2 = 0 * clothHeight * clothLength + (clothHeight - 1) * clothLength + z;
-			particles[index1].moving = false;
-			particles[index2].moving = false;
-			anchorParticles.emplace_back(&particles[index1]);
-			anchorParticles.emplace_back(&particles[index2]);
+			setClothParticlePinned(cloth, index1, true);
+			setClothParticlePinned(cloth, index2, true);
+			anchorParticles.emplace_back(index1);
+			anchorParticles.emplace_back(index2);
 		}
 	}
 
-	void createLink(ClothParticle& particle1, ClothParticle& particle2) {
-		ClothConstraint constraint = ClothConstraint(particle1, particle2, clothConstraintStrength, clothConstraintMaxElongationRatio);
-		constraints.emplace_back(constraint);
+	ClothParams clothParams() const {
+		ClothParams params;
+		params.gravity = gravity;
+		params.wind = wind;
+		params.airFriction = airFriction;
+		params.strength = clothConstraintStrength;
+		params.maxElongationRatio = clothConstraintMaxElongationRatio;
+		return params;
 	}
 
 	void update(double elapsedTime) override {
-		// Elapsed time is the time since the start of the application
-		// deltaTime is the time since the last frame
-		deltaTime = static_cast<float>(elapsedTime - previousElapsedTime);
-		previousElapsedTime = static_cast<float>(elapsedTime);
-
 		boneAngle = (float)elapsedTime;
 
-		leftMouseButtonPressed = glfwGetMouseButton(window, GLFW_MOUSE_BUTTON_LEFT) == GLFW_PRESS;
-		rightMouseButtonPressed = glfwGetMouseButton(window, GLFW_MOUSE_BUTTON_RIGHT) == GLFW_PRESS;
+		leftMouseButtonPressed = isMouseButtonPressed(GLFW_MOUSE_BUTTON_LEFT);
+		rightMouseButtonPressed = isMouseButtonPressed(GLFW_MOUSE_BUTTON_RIGHT);
 
-		altKeyPressed = glfwGetKey(window, GLFW_KEY_LEFT_ALT) == GLFW_PRESS || glfwGetKey(window, GLFW_KEY_RIGHT_ALT) == GLFW_PRESS;
+		altKeyPressed = isKeyPressed(GLFW_KEY_LEFT_ALT) || isKeyPressed(GLFW_KEY_RIGHT_ALT);
 
 		double mouseX;
 		double mouseY;
-		glfwGetCursorPos(window, &mouseX, &mouseY);
+		getCursorPos(mouseX, mouseY);
 
 		mousePos = { float(mouseX), viewportHeight - float(mouseY) };
 
@@ -153,72 +162,61 @@ struct ClothViewer : Viewer {
 		CustomShaderDataSize = sizeof(VertexShaderAdditionalData);
 
 		if (rightMouseButtonPressed) cutLinksUnderMouse();
-
-		const float subStepDeltaTime = deltaTime / static_cast<float>(subSteps);
-		removeBrokenLinks();
-		for (int i = subSteps; i--;) {
-			applyGravity();
-			applyWind();
-			applyAirFriction();
-			updatePositions(subStepDeltaTime);
-			solveConstraints();
-			updateDerivatives(subStepDeltaTime);
-		}
 	}
 
-	void removeBrokenLinks() {
-		constraints.erase(
-			std::remove_if(
-				constraints.begin(),
-				constraints.end(),
-				[](const ClothConstraint& c) {
-					return c.broken;
-				}
-			),
-			constraints.end()
-		);
-	}
-
-
-	void applyGravity() {
-		for (ClothParticle& clothParticle: particles) {
-			clothParticle.forces += gravity * clothParticle.mass;
+	void simulate(double elapsedTime) override {
+		// Elapsed time is the time since the start of the application
+		// deltaTime is the time since the last frame
+		deltaTime = static_cast<float>(elapsedTime - previousElapsedTime);
+		previousElapsedTime = static_cast<float>(elapsedTime);
+		if (playingPointCache) {
+			return;
 		}
-	}
 
-	void applyWind() {
-		for (ClothParticle& clothParticle: particles) {
-			clothParticle.forces += wind * clothParticle.mass;
+		const float subStepDeltaTime = deltaTime / static_cast<float>(subSteps);
+		const ClothParams params = clothParams();
+		removeBrokenClothConstraints(cloth);
+		for (int i = subSteps; i--;) {
+			integrateCloth(cloth, params, subStepDeltaTime);
+			for (int iteration = solverIterations; iteration--;) {
+				solveClothConstraints(cloth, params, threadPool);
+			}
+			updateClothVelocities(cloth, subStepDeltaTime);
 		}
 	}
 
-	void applyAirFriction() {
-		for (ClothParticle& clothParticle: particles) {
-			clothParticle.forces -= clothParticle.velocity * airFriction;
+	void publishSnapshot() override {
+		// Only the vertices are cached, the constraints are not drawn during playback
+		playingPointCache = nextPointCacheFrame();
+		if (playingPointCache) {
+			renderParticlePositions.resize(pointCachePlayer.pointCount);
+			for (int i = 0; i < pointCachePlayer.pointCount; ++i) {
+				renderParticlePositions[i] = glm::vec3(getPointCacheComponent(pointCachePlayer, 0)[i],
+					getPointCacheComponent(pointCachePlayer, 1)[i], getPointCacheComponent(pointCachePlayer, 2)[i]);
+			}
+			renderConstraintVertices.clear();
+			return;
 		}
-	}
 
-	void updatePositions(const float subStepDeltaTime) {
-		for (ClothParticle& clothParticle: particles) {
-			clothParticle.update(subStepDeltaTime);
+		const int particleCount = getClothParticleCount(cloth);
+		renderParticlePositions.resize(particleCount);
+		for (int i = 0; i < particleCount; ++i) {
+			renderParticlePositions[i] = getClothParticlePosition(cloth, i);
 		}
-	}
 
-	void solveConstraints() {
-		for (int i = solverIterations; i--;) {
-			for (ClothConstraint& constraint: constraints) {
-				constraint.solve();
-			}
+		const int constraintCount = getClothConstraintCount(cloth);
+		renderConstraintVertices.resize(2 * constraintCount);
+		for (int i = 0; i < 2 * constraintCount; ++i) {
+			renderConstraintVertices[i] = getClothParticlePosition(cloth, cloth.endpoints[i]);
 		}
-	}
 
-	void updateDerivatives(const float subStepDeltaTime) {
-		for (ClothParticle& clothParticle: particles) {
-			clothParticle.updateDerivatives(subStepDeltaTime);
+		if (!renderParticlePositions.empty()) {
+			const float* pFirst = &renderParticlePositions[0].x;
+			const float* positions[3] = { pFirst, pFirst + 1, pFirst + 2 };
+			recordPointCacheFrame(pointCacheRecorder, positions, 3, static_cast<int>(renderParticlePositions.size()), previousElapsedTime);
 		}
 	}
 
-
 	void cutLinksUnderMouse()
 	{
 		glm::vec2 screenSize = {viewportWidth, viewportHeight};
@@ -317,20 +315,20 @@ struct ClothViewer : Viewer {
 
 	    // 3) Iterate over every constraint and check distance. If under threshold, break it.
 	    const float cutThreshold = .5f;
-	    for (ClothConstraint& constraint : constraints)
+	    for (int i = 0; i < getClothConstraintCount(cloth); ++i)
 	    {
-	        if (constraint.broken) {
+	        if (cloth.broken[i]) {
 	            continue; // already broken, skip
 	        }
 
 	        // Retrieve the segment endpoints
-	        glm::vec3 p0 = constraint.particle1.get().position;
-	        glm::vec3 p1 = constraint.particle2.get().position;
+	        glm::vec3 p0 = getClothParticlePosition(cloth, cloth.endpoints[2 * i]);
+	        glm::vec3 p1 = getClothParticlePosition(cloth, cloth.endpoints[2 * i + 1]);
 
 	        // Compute distance from the ray to the constraint's segment
 	        float dist = distanceRayToSegment(p0, p1);
 	        if (dist < cutThreshold) {
-	            constraint.broken = true;
+	            cloth.broken[i] = 1;
 	        }
 	    }
 	}
@@ -349,16 +347,13 @@ struct ClothViewer : Viewer {
 		// Render the cloth particles and constraints
 
 		if (showClothParticles) {
-			for (const ClothParticle& clothParticle: particles) {
-				api.solidSphere(clothParticle.position, 0.1f, 10, 10, white);
+			for (const glm::vec3& position: renderParticlePositions) {
+				api.solidSphere(position, 0.1f, 10, 10, white);
 			}
 		}
 
-		if (showClothConstraints) {
-			for (const ClothConstraint& constraint: constraints) {
-				const glm::vec3 vertices[] = { constraint.particle1.get().position, constraint.particle2.get().position };
-				api.lines(vertices, 2, white, nullptr);
-			}
+		if (showClothConstraints && !renderConstraintVertices.empty()) {
+			api.lines(renderConstraintVertices.data(), static_cast<unsigned int>(renderConstraintVertices.size()), white, nullptr);
 		}
 
 		if (showRays) {
@@ -426,30 +421,36 @@ struct ClothViewer : Viewer {
 		ImGui::Checkbox("Show Cloth Particles", &showClothParticles);
 		ImGui::Checkbox("Show Cloth Constraints", &showClothConstraints);
 		ImGui::Checkbox("Show Rays", &showRays);
+		ImGui::Checkbox("Pipelined Simulation", &pipelined);
+		drawPointCacheGUI(3);
 
 
 		if (ImGui::CollapsingHeader("Cloth Particles")) {
 			for (int i = 0; i < anchorParticles.size(); ++i) {
-				ClothParticle* clothParticle = anchorParticles[i];
+				const int anchor = anchorParticles[i];
+				const glm::vec3 position = getClothParticlePosition(cloth, anchor);
 				ImGui::Text("Anchor Particle %d", i);
-				ImGui::Text("Position: (%.2f, %.2f, %.2f)", clothParticle->position.x, clothParticle->position.y, clothParticle->position.z);
-				if (!clothParticle->moving) {
+				ImGui::Text("Position: (%.2f, %.2f, %.2f)", position.x, position.y, position.z);
+				if (isClothParticlePinned(cloth, anchor)) {
 					if (ImGui::Button("Remove Attach")) {
-						clothParticle->moving = true;
+						setClothParticlePinned(cloth, anchor, false);
 					}
 				}
 				else {
 					if (ImGui::Button("Attach")) {
-						clothParticle->moving = false;
+						setClothParticlePinned(cloth, anchor, true);
 					}
 				}
 
 			}
-			for (int i = 0; i < particles.size(); ++i) {
-				const ClothParticle& clothParticle = particles[i];
+			for (int i = 0; i < getClothParticleCount(cloth); ++i) {
+				const glm::vec3 position = getClothParticlePosition(cloth, i);
 				ImGui::Text("Particle %d", i);
-				ImGui::Text("Position: (%.2f, %.2f, %.2f)", clothParticle.position.x, clothParticle.position.y, clothParticle.position.z);
-				ImGui::SliderFloat("Mass", &particles[i].mass, 0.1f, 10.f);
+				ImGui::Text("Position: (%.2f, %.2f, %.2f)", position.x, position.y, position.z);
+				float mass = cloth.mass[i];
+				if (ImGui::SliderFloat("Mass", &mass, 0.1f, 10.f)) {
+					setClothParticleMass(cloth, i, mass);
+				}
 				ImGui::Separator();
 			}
 		}
@@ -457,26 +458,20 @@ struct ClothViewer : Viewer {
 		if (ImGui::CollapsingHeader("Cloth Constraints")) {
 			ImGui::SliderFloat("Constraint Strength", &clothConstraintStrength, 0.f, 10.f);
 			ImGui::SliderFloat("Max Elongation Ratio", &clothConstraintMaxElongationRatio, 1.f, 10.f);
-			if (ImGui::Button("Update All Constraints")) {
-				for (ClothConstraint& constraint: constraints) {
-					constraint.strength = clothConstraintStrength;
-					constraint.maxElongationRatio = clothConstraintMaxElongationRatio;
-				}
-			}
+			ImGui::Text("%d constraints in %d parallel batches", getClothConstraintCount(cloth), getClothColorCount(cloth));
 
-			if (ImGui::Button("Break 5 Random")) {
+			if (ImGui::Button("Break 5 Random") && getClothConstraintCount(cloth) > 0) {
 				// Break 5 random constraints
 				for (int i = 0; i < 5; ++i) {
-					const int index = rand() % constraints.size();
-					constraints[index].broken = true;
+					const int index = rand() % getClothConstraintCount(cloth);
+					cloth.broken[index] = 1;
 				}
 			}
-			for (int i = 0; i < constraints.size(); ++i) {
-				ClothConstraint& clothConstraint = constraints[i];
-				if (clothConstraint.broken) break;
+			for (int i = 0; i < getClothConstraintCount(cloth); ++i) {
+				if (cloth.broken[i]) break;
 				ImGui::Text("Constraint %d", i);
 				if (ImGui::Button("Break")) {
-					clothConstraint.broken = true;
+					cloth.broken[i] = 1;
 				}
 				ImGui::Separator();
 			}
@@ -1,5 +1,6 @@
 #include "drawbuffer.h"
 #include <glad.h>
+#include <glm/common.hpp>
 
 void createBuffer3D(Buffer3D& buffer, const CreateBuffer3DParams& params) {
 	assert(buffer.vao == 0); // trying to create a buffer already initialized
@@ -74,6 +75,154 @@ void deleteBuffer3D(Buffer3D& buffer) {
 	buffer.vao = 0;
 }
 
+namespace {
+	template <typename T>
+	void uploadAttribute(GLuint vbo, GLuint location, T const* pData, GLsizei count, GLuint divisor) {
+		glBindBuffer(GL_ARRAY_BUFFER, vbo);
+		glEnableVertexAttribArray(location);
+		constexpr size_t size = sizeof(T) / sizeof(float);
+		glVertexAttribPointer(location, size, GL_FLOAT, GL_FALSE, sizeof(T), (void*)0);
+		glVertexAttribDivisor(location, divisor);
+		glBufferData(GL_ARRAY_BUFFER, count * sizeof(T), pData, GL_STREAM_DRAW);
+	}
+}
+
+void createInstancedBuffer3D(InstancedBuffer3D& buffer, const CreateInstancedBuffer3DParams& params) {
+	assert(buffer.vao == 0); // trying to create a buffer already initialized
+	assert(params.pVertices && params.pNormals && params.pInstanceColors && params.pInstancePositions && params.pInstanceDirections);
+
+	glGenVertexArrays(1, &buffer.vao);
+	glGenBuffers(buffer.BufferAttribCount, buffer.vbos);
+
+	glBindVertexArray(buffer.vao);
+
+	// Mesh, advances per vertex
+	uploadAttribute(buffer.vbos[buffer.BufferAttribVertex], buffer.BufferAttribVertex, params.pVertices, params.vertexCount, 0);
+	uploadAttribute(buffer.vbos[buffer.BufferAttribNormal], buffer.BufferAttribNormal, params.pNormals, params.vertexCount, 0);
+
+	// Instances, advance per instance
+	uploadAttribute(buffer.vbos[buffer.BufferAttribInstanceColor], buffer.BufferAttribInstanceColor, params.pInstanceColors, params.instanceCount, 1);
+	uploadAttribute(buffer.vbos[buffer.BufferAttribInstancePosition], buffer.BufferAttribInstancePosition, params.pInstancePositions, params.instanceCount, 1);
+	uploadAttribute(buffer.vbos[buffer.BufferAttribInstanceDirection], buffer.BufferAttribInstanceDirection, params.pInstanceDirections, params.instanceCount, 1);
+
+	buffer.vertexCount = params.vertexCount;
+	buffer.instanceCount = params.instanceCount;
+
+	// Unbind everything. Potentially illegal on some implementations
+	glBindVertexArray(0);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void deleteInstancedBuffer3D(InstancedBuffer3D& buffer) {
+	glDeleteBuffers(buffer.BufferAttribCount, buffer.vbos);
+	glDeleteVertexArrays(1, &buffer.vao);
+	memset(buffer.vbos, 0, sizeof(buffer.vbos));
+	buffer.vao = 0;
+}
+
+void createStreamBuffer(StreamBuffer& stream, GLsizeiptr regionSize) {
+	assert(stream.buffer == 0); // trying to create a buffer already initialized
+
+	// Regions start on an offset usable by glBindBufferRange
+	glGetIntegerv(GL_SHADER_STORAGE_BUFFER_OFFSET_ALIGNMENT, &stream.offsetAlignment);
+	regionSize = (regionSize + stream.offsetAlignment - 1) / stream.offsetAlignment * stream.offsetAlignment;
+
+	const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+	glGenBuffers(1, &stream.buffer);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, stream.buffer);
+	glBufferStorage(GL_COPY_WRITE_BUFFER, regionSize * STREAM_BUFFER_REGION_COUNT, nullptr, flags);
+	stream.pMapped = (char*)glMapBufferRange(GL_COPY_WRITE_BUFFER, 0, regionSize * STREAM_BUFFER_REGION_COUNT, flags);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+	assert(stream.pMapped);
+
+	stream.regionSize = regionSize;
+	stream.requestedRegionSize = regionSize;
+	stream.region = 0;
+	stream.regionUsed = 0;
+}
+
+void deleteStreamBuffer(StreamBuffer& stream) {
+	for (GLsync& fence : stream.fences) {
+		if (fence) {
+			glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, GL_TIMEOUT_IGNORED);
+			glDeleteSync(fence);
+			fence = 0;
+		}
+	}
+	if (stream.buffer) {
+		glBindBuffer(GL_COPY_WRITE_BUFFER, stream.buffer);
+		glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+		glDeleteBuffers(1, &stream.buffer);
+	}
+	stream.buffer = 0;
+	stream.pMapped = nullptr;
+}
+
+void beginStreamBufferFrame(StreamBuffer& stream) {
+	if (stream.requestedRegionSize > stream.regionSize) {
+		const GLsizeiptr regionSize = stream.requestedRegionSize + stream.requestedRegionSize / 2;
+		deleteStreamBuffer(stream);
+		createStreamBuffer(stream, regionSize);
+	}
+
+	stream.region = (stream.region + 1) % STREAM_BUFFER_REGION_COUNT;
+	stream.regionUsed = 0;
+	GLsync& fence = stream.fences[stream.region];
+	if (fence) {
+		glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, GL_TIMEOUT_IGNORED);
+		glDeleteSync(fence);
+		fence = 0;
+	}
+}
+
+void endStreamBufferFrame(StreamBuffer& stream) {
+	assert(!stream.fences[stream.region]);
+	stream.fences[stream.region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	// Ask for enough room next time
+	stream.requestedRegionSize = glm::max(stream.requestedRegionSize, stream.regionUsed);
+}
+
+void* allocateStreamBuffer(StreamBuffer& stream, GLsizeiptr size, GLintptr& offset) {
+	const GLsizeiptr alignedUsed = (stream.regionUsed + stream.offsetAlignment - 1) / stream.offsetAlignment * stream.offsetAlignment;
+	stream.regionUsed = alignedUsed + size;
+	if (stream.regionUsed > stream.regionSize) {
+		return nullptr;
+	}
+	offset = stream.region * stream.regionSize + alignedUsed;
+	return stream.pMapped + offset;
+}
+
+void createTrailRing(TrailRing& ring, int capacity, int length) {
+	assert(ring.buffer == 0); // trying to create a buffer already initialized
+	assert(capacity > 0 && length >= 2);
+
+	// Only written by buffer copies, never mapped
+	const GLsizeiptr size = GLsizeiptr(capacity) * length * 4 * sizeof(float);
+	glGenBuffers(1, &ring.buffer);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, ring.buffer);
+	glBufferStorage(GL_COPY_WRITE_BUFFER, size, nullptr, 0);
+	glClearBufferData(GL_COPY_WRITE_BUFFER, GL_RGBA32F, GL_RGBA, GL_FLOAT, nullptr);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+	ring.capacity = capacity;
+	ring.length = length;
+	clearTrailRing(ring);
+}
+
+void deleteTrailRing(TrailRing& ring) {
+	glDeleteBuffers(1, &ring.buffer);
+	ring.buffer = 0;
+	ring.capacity = 0;
+	ring.length = 0;
+	clearTrailRing(ring);
+}
+
+void clearTrailRing(TrailRing& ring) {
+	ring.head = 0;
+	ring.frameCount = 0;
+}
+
 void createBuffer2D(Buffer2D& buffer, const CreateBuffer2DParams& params) {
 	glGenVertexArrays(1, &buffer.vao);
 	glGenBuffers(buffer.BufferAttribCount, buffer.vbos);
@@ -32,6 +32,86 @@ void createBuffer3D(Buffer3D& buffer, const CreateBuffer3DParams& params);
 
 void deleteBuffer3D(Buffer3D& buffer);
 
+// One mesh drawn once per instance, each instance with its own position,
+// direction and color
+struct InstancedBuffer3D {
+	enum {
+		BufferAttribVertex = 0,
+		BufferAttribNormal,
+		BufferAttribInstanceColor,
+		BufferAttribInstancePosition,
+		BufferAttribInstanceDirection,
+		BufferAttribCount
+	};
+	GLuint vao = 0;
+	GLuint vbos[BufferAttribCount] = {};
+	GLsizei vertexCount = 0;
+	GLsizei instanceCount = 0;
+};
+
+struct CreateInstancedBuffer3DParams {
+	glm::vec3 const* pVertices = nullptr;
+	glm::vec3 const* pNormals = nullptr;
+	GLsizei vertexCount = 0;
+	glm::vec4 const* pInstanceColors = nullptr;
+	glm::vec3 const* pInstancePositions = nullptr;
+	glm::vec3 const* pInstanceDirections = nullptr;
+	GLsizei instanceCount = 0;
+};
+
+void createInstancedBuffer3D(InstancedBuffer3D& buffer, const CreateInstancedBuffer3DParams& params);
+
+void deleteInstancedBuffer3D(InstancedBuffer3D& buffer);
+
+// Persistently mapped buffer split in STREAM_BUFFER_REGION_COUNT regions used
+// round robin, one per frame. A region is only rewritten once the GPU has
+// passed the fence placed at the end of the frame that last used it.
+constexpr int STREAM_BUFFER_REGION_COUNT = 3;
+
+struct StreamBuffer {
+	GLuint buffer = 0;
+	char* pMapped = nullptr;
+	GLsizeiptr regionSize = 0;
+	GLint offsetAlignment = 1;
+	int region = 0;
+	GLsizeiptr regionUsed = 0;
+	GLsync fences[STREAM_BUFFER_REGION_COUNT] = {};
+	// Largest frame requested so far, the buffer grows to it on the next frame
+	GLsizeiptr requestedRegionSize = 0;
+};
+
+void createStreamBuffer(StreamBuffer& stream, GLsizeiptr regionSize);
+
+void deleteStreamBuffer(StreamBuffer& stream);
+
+// Waits until the next region is free, growing the buffer if a previous
+// frame ran out of space
+void beginStreamBufferFrame(StreamBuffer& stream);
+
+void endStreamBufferFrame(StreamBuffer& stream);
+
+// Returns where to write size bytes, or nullptr when the region is full.
+// offset is relative to the start of the buffer.
+void* allocateStreamBuffer(StreamBuffer& stream, GLsizeiptr size, GLintptr& offset);
+
+// The last length frames of up to capacity points, kept on the GPU only.
+// Frame slot s holds the vec4s [s * capacity, (s + 1) * capacity): xyz the
+// position, w the bits of the point id, 0 for never written.
+struct TrailRing {
+	GLuint buffer = 0;
+	int capacity = 0;
+	int length = 0;
+	int head = 0; // slot of the newest frame
+	int frameCount = 0; // slots written since the last clear, up to length
+};
+
+void createTrailRing(TrailRing& ring, int capacity, int length);
+
+void deleteTrailRing(TrailRing& ring);
+
+// Forgets the history, the buffer is kept
+void clearTrailRing(TrailRing& ring);
+
 struct Buffer2D {
 	enum {
 		BufferAttribVertex = 0,
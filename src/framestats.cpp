@@ -0,0 +1,105 @@
+#include "framestats.h"
+
+#define GLFW_INCLUDE_NONE
+#include <GLFW/glfw3.h>
+
+#include <stdio.h>
+#include <algorithm>
+#include <chrono>
+#include <thread>
+
+namespace {
+	enum {
+		FrameFlagHitch = 1 << 0,
+		FrameFlagVsyncMiss = 1 << 1,
+	};
+
+	float percentile(float* pSorted, int count, float ratio) {
+		const int index = std::min(int(ratio * count), count - 1);
+		std::nth_element(pSorted, pSorted + index, pSorted + count);
+		return pSorted[index];
+	}
+}
+
+void addFrameTime(FrameStats& stats, float frameMs) {
+	stats.ringMs[stats.ringHead] = frameMs;
+	stats.ringHead = (stats.ringHead + 1) % FRAME_STATS_RING_SIZE;
+	stats.ringCount = std::min(stats.ringCount + 1, FRAME_STATS_RING_SIZE);
+
+	unsigned char flags = 0;
+	if (frameMs > stats.budgetMs) {
+		flags |= FrameFlagHitch;
+		++stats.hitchCount;
+	}
+	// With vsync on, a frame lasts a whole number of refresh periods: anything
+	// clearly past the expected count means a presentation was missed
+	if (stats.swapInterval > 0 && stats.refreshPeriodMs > 0.f) {
+		const float expectedMs = stats.swapInterval * stats.refreshPeriodMs;
+		if (frameMs > expectedMs + 0.5f * stats.refreshPeriodMs) {
+			flags |= FrameFlagVsyncMiss;
+			++stats.vsyncMissCount;
+		}
+	}
+
+	stats.historyMs.push_back(frameMs);
+	stats.historyFlags.push_back(flags);
+}
+
+FramePercentiles computeFramePercentiles(const FrameStats& stats) {
+	FramePercentiles result = {};
+	if (stats.ringCount == 0) {
+		return result;
+	}
+	float sorted[FRAME_STATS_RING_SIZE];
+	const int count = copyFrameTimes(stats, sorted);
+	result.maxMs = *std::max_element(sorted, sorted + count);
+	result.p50Ms = percentile(sorted, count, 0.50f);
+	result.p95Ms = percentile(sorted, count, 0.95f);
+	result.p99Ms = percentile(sorted, count, 0.99f);
+	return result;
+}
+
+int copyFrameTimes(const FrameStats& stats, float* pOut) {
+	const int first = (stats.ringHead - stats.ringCount + FRAME_STATS_RING_SIZE) % FRAME_STATS_RING_SIZE;
+	for (int i = 0; i < stats.ringCount; ++i) {
+		pOut[i] = stats.ringMs[(first + i) % FRAME_STATS_RING_SIZE];
+	}
+	return stats.ringCount;
+}
+
+void computeFrameHistogram(const FrameStats& stats, float maxMs, float (&bins)[FRAME_STATS_HISTOGRAM_BINS]) {
+	std::fill(bins, bins + FRAME_STATS_HISTOGRAM_BINS, 0.f);
+	const float binsPerMs = FRAME_STATS_HISTOGRAM_BINS / maxMs;
+	for (int i = 0; i < stats.ringCount; ++i) {
+		const int bin = std::min(int(stats.ringMs[i] * binsPerMs), FRAME_STATS_HISTOGRAM_BINS - 1);
+		bins[bin] += 1.f;
+	}
+}
+
+bool writeFrameStatsCsv(const FrameStats& stats, char const* path) {
+	FILE* pFile = fopen(path, "w");
+	if (!pFile) {
+		fprintf(stderr, "Failed to open file %s \n", path);
+		return false;
+	}
+	fprintf(pFile, "frame,frame_ms,hitch,vsync_miss\n");
+	for (size_t i = 0; i < stats.historyMs.size(); ++i) {
+		const unsigned char flags = stats.historyFlags[i];
+		fprintf(pFile, "%zu,%.4f,%d,%d\n", i, stats.historyMs[i], (flags & FrameFlagHitch) ? 1 : 0, (flags & FrameFlagVsyncMiss) ? 1 : 0);
+	}
+	fclose(pFile);
+	return true;
+}
+
+void waitUntil(double targetTime) {
+	// The OS scheduler is coarse: only sleep while more than ~2ms remain
+	constexpr double spinThreshold = 0.002;
+	double now = glfwGetTime();
+	while (targetTime - now > spinThreshold) {
+		std::this_thread::sleep_for(std::chrono::duration<double>(targetTime - now - spinThreshold));
+		now = glfwGetTime();
+	}
+	while (glfwGetTime() < targetTime) {
+		std::this_thread::yield();
+	}
+}
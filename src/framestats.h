@@ -0,0 +1,47 @@
+#pragma once
+
+#include <vector>
+
+constexpr int FRAME_STATS_RING_SIZE = 512;
+constexpr int FRAME_STATS_HISTOGRAM_BINS = 50;
+
+struct FrameStats {
+	// Last frame times in milliseconds, ringHead is the next slot written
+	float ringMs[FRAME_STATS_RING_SIZE] = {};
+	int ringHead = 0;
+	int ringCount = 0;
+
+	// Every frame since startup, for the CSV dump
+	std::vector<float> historyMs;
+	std::vector<unsigned char> historyFlags;
+
+	float budgetMs = 1000.f / 60.f; // frames above this are hitches
+	float refreshPeriodMs = 0.f;    // 0 when unknown
+	int swapInterval = 1;           // as last passed to glfwSwapInterval
+
+	unsigned int hitchCount = 0;
+	unsigned int vsyncMissCount = 0;
+};
+
+struct FramePercentiles {
+	float p50Ms;
+	float p95Ms;
+	float p99Ms;
+	float maxMs;
+};
+
+void addFrameTime(FrameStats& stats, float frameMs);
+
+// Over the frames currently in the ring
+FramePercentiles computeFramePercentiles(const FrameStats& stats);
+
+// Ring contents in chronological order, returns the count
+int copyFrameTimes(const FrameStats& stats, float* pOut);
+
+// Distribution of the ring over [0, maxMs], last bin also counts what is above
+void computeFrameHistogram(const FrameStats& stats, float maxMs, float (&bins)[FRAME_STATS_HISTOGRAM_BINS]);
+
+bool writeFrameStatsCsv(const FrameStats& stats, char const* path);
+
+// Sleeps, then spins, until targetTime (glfwGetTime clock)
+void waitUntil(double targetTime);
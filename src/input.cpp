@@ -0,0 +1,228 @@
+#include "input.h"
+
+#include <assert.h>
+#include <string.h>
+
+namespace {
+	constexpr char INPUT_FILE_MAGIC[4] = { 'I', 'N', 'P', '1' };
+
+	void writeEvent(FILE* pFile, const InputEvent& event) {
+		const unsigned char type = (unsigned char)event.type;
+		fwrite(&type, sizeof(type), 1, pFile);
+		switch (event.type) {
+		case eInputEventType::Key:
+		case eInputEventType::MouseButton: {
+			const unsigned short code = (unsigned short)event.code;
+			const unsigned char pressed = event.pressed ? 1 : 0;
+			fwrite(&code, sizeof(code), 1, pFile);
+			fwrite(&pressed, sizeof(pressed), 1, pFile);
+			break;
+		}
+		case eInputEventType::CursorPos:
+		case eInputEventType::Scroll: {
+			const float xy[2] = { (float)event.x, (float)event.y };
+			fwrite(xy, sizeof(xy), 1, pFile);
+			break;
+		}
+		case eInputEventType::FrameEnd:
+			fwrite(&event.x, sizeof(event.x), 1, pFile);
+			break;
+		default:
+			assert(false);
+			break;
+		}
+	}
+
+	void writeCamera(FILE* pFile, const Camera& camera) {
+		const unsigned char type = (unsigned char)eInputEventType::Camera;
+		const float values[7] = { camera.fov, camera.radius, camera.theta, camera.phi, camera.o.x, camera.o.y, camera.o.z };
+		fwrite(&type, sizeof(type), 1, pFile);
+		fwrite(values, sizeof(values), 1, pFile);
+	}
+
+	bool sameCamera(const Camera& a, const Camera& b) {
+		return a.fov == b.fov && a.radius == b.radius && a.theta == b.theta && a.phi == b.phi && a.o == b.o;
+	}
+
+	void applyEvent(InputState& state, const InputEvent& event) {
+		switch (event.type) {
+		case eInputEventType::Key:
+			if (event.code >= 0 && event.code < INPUT_KEY_COUNT) {
+				state.keys[event.code] = event.pressed;
+			}
+			break;
+		case eInputEventType::MouseButton:
+			if (event.code >= 0 && event.code < INPUT_MOUSE_BUTTON_COUNT) {
+				state.mouseButtons[event.code] = event.pressed;
+			}
+			break;
+		case eInputEventType::CursorPos:
+			state.cursorX = event.x;
+			state.cursorY = event.y;
+			break;
+		case eInputEventType::Scroll:
+			state.scrollX += event.x;
+			state.scrollY += event.y;
+			break;
+		default:
+			break;
+		}
+	}
+
+	// Reads events up to and including the next FrameEnd. Returns false at end of file.
+	bool replayFrame(InputRecorder& recorder, InputState& state) {
+		FILE* pFile = recorder.pReplayFile;
+		unsigned char type;
+		while (fread(&type, sizeof(type), 1, pFile) == 1) {
+			InputEvent event = {};
+			event.type = (eInputEventType)type;
+			switch (event.type) {
+			case eInputEventType::Key:
+			case eInputEventType::MouseButton: {
+				unsigned short code;
+				unsigned char pressed;
+				if (fread(&code, sizeof(code), 1, pFile) != 1 || fread(&pressed, sizeof(pressed), 1, pFile) != 1) {
+					return false;
+				}
+				event.code = code;
+				event.pressed = pressed != 0;
+				applyEvent(state, event);
+				break;
+			}
+			case eInputEventType::CursorPos:
+			case eInputEventType::Scroll: {
+				float xy[2];
+				if (fread(xy, sizeof(xy), 1, pFile) != 1) {
+					return false;
+				}
+				event.x = xy[0];
+				event.y = xy[1];
+				applyEvent(state, event);
+				break;
+			}
+			case eInputEventType::Camera: {
+				float values[7];
+				if (fread(values, sizeof(values), 1, pFile) != 1) {
+					return false;
+				}
+				Camera& camera = recorder.replayCamera;
+				camera.fov = values[0];
+				camera.radius = values[1];
+				camera.theta = values[2];
+				camera.phi = values[3];
+				camera.o = glm::vec3(values[4], values[5], values[6]);
+				cameraCompute(camera);
+				recorder.hasReplayCamera = true;
+				break;
+			}
+			case eInputEventType::FrameEnd:
+				return fread(&recorder.replayElapsedTime, sizeof(recorder.replayElapsedTime), 1, pFile) == 1;
+			default:
+				fprintf(stderr, "Corrupted input file (event type %d)\n", type);
+				return false;
+			}
+		}
+		return false;
+	}
+}
+
+bool startInputRecording(InputRecorder& recorder, char const* path, double fixedDeltaTime) {
+	assert(recorder.pRecordFile == nullptr && recorder.pReplayFile == nullptr);
+	recorder.pRecordFile = fopen(path, "wb");
+	if (!recorder.pRecordFile) {
+		fprintf(stderr, "Failed to open file %s \n", path);
+		return false;
+	}
+	fwrite(INPUT_FILE_MAGIC, sizeof(INPUT_FILE_MAGIC), 1, recorder.pRecordFile);
+	fwrite(&fixedDeltaTime, sizeof(fixedDeltaTime), 1, recorder.pRecordFile);
+	recorder.fixedDeltaTime = fixedDeltaTime;
+	recorder.frameCount = 0;
+	// Make sure the initial camera is written with the first frame
+	recorder.lastRecordedCamera.fov = -1.f;
+	return true;
+}
+
+bool startInputReplay(InputRecorder& recorder, char const* path) {
+	assert(recorder.pRecordFile == nullptr && recorder.pReplayFile == nullptr);
+	recorder.pReplayFile = fopen(path, "rb");
+	if (!recorder.pReplayFile) {
+		fprintf(stderr, "Failed to open file %s \n", path);
+		return false;
+	}
+	char magic[sizeof(INPUT_FILE_MAGIC)];
+	if (fread(magic, sizeof(magic), 1, recorder.pReplayFile) != 1 || memcmp(magic, INPUT_FILE_MAGIC, sizeof(magic)) != 0
+		|| fread(&recorder.fixedDeltaTime, sizeof(recorder.fixedDeltaTime), 1, recorder.pReplayFile) != 1) {
+		fprintf(stderr, "%s is not an input recording\n", path);
+		fclose(recorder.pReplayFile);
+		recorder.pReplayFile = nullptr;
+		return false;
+	}
+	recorder.replayFinished = false;
+	recorder.frameCount = 0;
+	return true;
+}
+
+void stopInputRecorder(InputRecorder& recorder) {
+	if (recorder.pRecordFile) {
+		fclose(recorder.pRecordFile);
+		recorder.pRecordFile = nullptr;
+	}
+	if (recorder.pReplayFile) {
+		fclose(recorder.pReplayFile);
+		recorder.pReplayFile = nullptr;
+	}
+}
+
+void pushInputEvent(InputRecorder& recorder, const InputEvent& event) {
+	recorder.pendingEvents.push_back(event);
+}
+
+void beginInputFrame(InputRecorder& recorder, InputState& state) {
+	state.scrollX = 0.0;
+	state.scrollY = 0.0;
+
+	if (recorder.pReplayFile) {
+		// Live input is ignored while replaying
+		recorder.pendingEvents.clear();
+		if (!recorder.replayFinished) {
+			recorder.hasReplayCamera = false;
+			if (replayFrame(recorder, state)) {
+				++recorder.frameCount;
+			}
+			else {
+				recorder.replayFinished = true;
+				fprintf(stdout, "Input replay finished after %u frames\n", recorder.frameCount);
+			}
+		}
+		return;
+	}
+
+	for (const InputEvent& event : recorder.pendingEvents) {
+		applyEvent(state, event);
+		if (recorder.pRecordFile) {
+			writeEvent(recorder.pRecordFile, event);
+		}
+	}
+	recorder.pendingEvents.clear();
+}
+
+void endInputFrame(InputRecorder& recorder, Camera& camera, double elapsedTime) {
+	if (isInputReplaying(recorder)) {
+		if (recorder.hasReplayCamera) {
+			camera = recorder.replayCamera;
+		}
+		return;
+	}
+
+	if (recorder.pRecordFile) {
+		if (!sameCamera(camera, recorder.lastRecordedCamera)) {
+			writeCamera(recorder.pRecordFile, camera);
+			recorder.lastRecordedCamera = camera;
+		}
+		InputEvent frameEnd = {};
+		frameEnd.type = eInputEventType::FrameEnd;
+		frameEnd.x = elapsedTime;
+		writeEvent(recorder.pRecordFile, frameEnd);
+		++recorder.frameCount;
+	}
+}
@@ -0,0 +1,78 @@
+#pragma once
+
+#include "camera.h"
+
+#include <stdio.h>
+#include <vector>
+
+constexpr int INPUT_KEY_COUNT = 512; // > GLFW_KEY_LAST
+constexpr int INPUT_MOUSE_BUTTON_COUNT = 8; // GLFW_MOUSE_BUTTON_LAST + 1
+
+// Input as seen by the viewers for the current frame
+struct InputState {
+	bool keys[INPUT_KEY_COUNT] = {};
+	bool mouseButtons[INPUT_MOUSE_BUTTON_COUNT] = {};
+	double cursorX = 0.0;
+	double cursorY = 0.0;
+	double scrollX = 0.0; // accumulated during the current frame
+	double scrollY = 0.0;
+};
+
+enum class eInputEventType : unsigned char {
+	Key,         // code = key, pressed
+	MouseButton, // code = button, pressed
+	CursorPos,   // x, y
+	Scroll,      // x, y offsets
+	Camera,      // only in files
+	FrameEnd,    // only in files, x = elapsed time
+};
+
+struct InputEvent {
+	eInputEventType type;
+	int code;
+	bool pressed;
+	double x;
+	double y;
+};
+
+// Sits between GLFW and the viewer: live events are queued by the GLFW callbacks
+// and applied once per frame, optionally written to a file. In replay mode the
+// events come from the file instead and live input is ignored.
+//
+// File layout (little endian): "INP1", double fixedDeltaTime, then per frame the
+// input events, an optional camera event and a FrameEnd event holding the
+// elapsed time passed to Viewer::update.
+struct InputRecorder {
+	std::vector<InputEvent> pendingEvents;
+
+	FILE* pRecordFile = nullptr;
+	Camera lastRecordedCamera = {};
+
+	FILE* pReplayFile = nullptr;
+	bool replayFinished = false;
+	bool hasReplayCamera = false;
+	Camera replayCamera = {};
+	double replayElapsedTime = 0.0;
+
+	double fixedDeltaTime = 0.0;
+	unsigned int frameCount = 0;
+};
+
+bool startInputRecording(InputRecorder& recorder, char const* path, double fixedDeltaTime);
+bool startInputReplay(InputRecorder& recorder, char const* path);
+void stopInputRecorder(InputRecorder& recorder);
+
+inline bool isInputReplaying(const InputRecorder& recorder) {
+	return recorder.pReplayFile != nullptr && !recorder.replayFinished;
+}
+
+// Called from the GLFW callbacks
+void pushInputEvent(InputRecorder& recorder, const InputEvent& event);
+
+// Applies this frame's events to the state, either the live ones or the next
+// recorded frame. When replaying, recorder.replayElapsedTime is the elapsed time
+// of the recorded frame.
+void beginInputFrame(InputRecorder& recorder, InputState& state);
+
+// Records the camera and the frame end, or restores the recorded camera.
+void endInputFrame(InputRecorder& recorder, Camera& camera, double elapsedTime);
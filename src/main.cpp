@@ -15,5 +15,6 @@ int main(int argc, char** argv) {
 	//FabrikViewer v;
 	//BounceViewer v;
 	SpiderViewer v;
+	v.parseCommandLine(argc, argv);
 	return v.run();
 }
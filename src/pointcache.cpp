@@ -0,0 +1,507 @@
+#include "pointcache.h"
+
+#include <algorithm>
+#include <assert.h>
+#include <chrono>
+#include <math.h>
+#include <string.h>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace {
+	const char POINT_CACHE_MAGIC[4] = { 'P', 'C', 'H', '1' };
+	const char POINT_CACHE_CHUNK_TAG[4] = { 'P', 'C', 'C', 'K' };
+	const char POINT_CACHE_INDEX_TAG[4] = { 'P', 'C', 'I', 'X' };
+	constexpr int POINT_CACHE_MAX_COMPONENTS = 64;
+	constexpr int32_t QUANTIZED_MAX = 65535;
+	constexpr size_t FILE_HEADER_SIZE = 8;
+	constexpr size_t INDEX_ENTRY_SIZE = 16;
+	constexpr size_t INDEX_TAIL_SIZE = 16;
+
+	uint32_t zigzag(int32_t value) {
+		return (uint32_t(value) << 1) ^ uint32_t(value >> 31);
+	}
+
+	int32_t unzigzag(uint32_t value) {
+		return int32_t(value >> 1) ^ -int32_t(value & 1);
+	}
+
+	void putVarint(std::vector<unsigned char>& out, uint32_t value) {
+		while (value >= 0x80) {
+			out.push_back(static_cast<unsigned char>(value | 0x80));
+			value >>= 7;
+		}
+		out.push_back(static_cast<unsigned char>(value));
+	}
+
+	// The mapped file has no alignment guarantee
+	template <typename T>
+	T load(const unsigned char* p) {
+		T value;
+		memcpy(&value, p, sizeof(T));
+		return value;
+	}
+
+	void writeBytes(PointCacheRecorder& recorder, const void* pData, size_t size) {
+		fwrite(pData, size, 1, recorder.pFile);
+		recorder.fileOffset += size;
+		recorder.writtenBytes += size;
+	}
+
+	// Writer thread
+	void writeChunk(PointCacheRecorder& recorder, const PointCacheChunk& chunk) {
+		const auto encodeStart = std::chrono::steady_clock::now();
+		const int componentCount = recorder.componentCount;
+
+		// Bounds of each component over the chunk
+		std::vector<float> minimums(componentCount, INFINITY);
+		std::vector<float> maximums(componentCount, -INFINITY);
+		int maxPointCount = 0;
+		size_t frameOffset = 0;
+		for (int f = 0; f < chunk.frameCount; ++f) {
+			const int pointCount = static_cast<int>(chunk.pointCounts[f]);
+			maxPointCount = std::max(maxPointCount, pointCount);
+			for (int c = 0; c < componentCount; ++c) {
+				const float* pValues = chunk.values.data() + frameOffset + size_t(c) * pointCount;
+				for (int i = 0; i < pointCount; ++i) {
+					if (isfinite(pValues[i])) {
+						minimums[c] = std::min(minimums[c], pValues[i]);
+						maximums[c] = std::max(maximums[c], pValues[i]);
+					}
+				}
+			}
+			frameOffset += size_t(componentCount) * pointCount;
+		}
+		std::vector<float> steps(componentCount);
+		for (int c = 0; c < componentCount; ++c) {
+			if (!(minimums[c] <= maximums[c])) {
+				minimums[c] = maximums[c] = 0.f;
+			}
+			const float step = (maximums[c] - minimums[c]) / QUANTIZED_MAX;
+			steps[c] = step > 0.f ? step : 1.f;
+		}
+
+		// Quantize, then delta against the previous frame
+		recorder.previousQuantized.assign(size_t(componentCount) * maxPointCount, 0);
+		recorder.payload.clear();
+		int previousPointCount = 0;
+		frameOffset = 0;
+		for (int f = 0; f < chunk.frameCount; ++f) {
+			const int pointCount = static_cast<int>(chunk.pointCounts[f]);
+			for (int c = 0; c < componentCount; ++c) {
+				const float* pValues = chunk.values.data() + frameOffset + size_t(c) * pointCount;
+				int32_t* pPrevious = recorder.previousQuantized.data() + size_t(c) * maxPointCount;
+				const float inverseStep = 1.f / steps[c];
+				for (int i = 0; i < pointCount; ++i) {
+					const float scaled = isfinite(pValues[i]) ? (pValues[i] - minimums[c]) * inverseStep + 0.5f : 0.f;
+					const int32_t quantized = std::min(std::max(static_cast<int32_t>(scaled), 0), QUANTIZED_MAX);
+					const int32_t previous = i < previousPointCount ? pPrevious[i] : 0;
+					putVarint(recorder.payload, zigzag(quantized - previous));
+					pPrevious[i] = quantized;
+				}
+			}
+			previousPointCount = pointCount;
+			frameOffset += size_t(componentCount) * pointCount;
+		}
+
+		const PointCacheIndexEntry entry = { recorder.fileOffset, recorder.writtenFrameCount, static_cast<uint32_t>(chunk.frameCount) };
+		recorder.index.push_back(entry);
+		const uint32_t frameCount = static_cast<uint32_t>(chunk.frameCount);
+		const uint32_t payloadSize = static_cast<uint32_t>(recorder.payload.size());
+		writeBytes(recorder, POINT_CACHE_CHUNK_TAG, sizeof(POINT_CACHE_CHUNK_TAG));
+		writeBytes(recorder, &frameCount, sizeof(frameCount));
+		writeBytes(recorder, minimums.data(), minimums.size() * sizeof(float));
+		writeBytes(recorder, steps.data(), steps.size() * sizeof(float));
+		writeBytes(recorder, chunk.pointCounts.data(), chunk.pointCounts.size() * sizeof(uint32_t));
+		writeBytes(recorder, chunk.times.data(), chunk.times.size() * sizeof(float));
+		writeBytes(recorder, &payloadSize, sizeof(payloadSize));
+		writeBytes(recorder, recorder.payload.data(), recorder.payload.size());
+		recorder.writtenFrameCount += frameCount;
+
+		++recorder.writtenChunkCount;
+		recorder.lastEncodeMs = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - encodeStart).count();
+	}
+
+	void runPointCacheWriter(PointCacheRecorder* pRecorder) {
+		PointCacheRecorder& recorder = *pRecorder;
+		std::unique_lock<std::mutex> lock(recorder.mutex);
+		for (;;) {
+			recorder.wakeCv.wait(lock, [&recorder] { return recorder.quit || !recorder.fullChunks.empty(); });
+			if (recorder.fullChunks.empty()) {
+				return;
+			}
+			PointCacheChunk* pChunk = recorder.fullChunks.front();
+			recorder.fullChunks.erase(recorder.fullChunks.begin());
+			lock.unlock();
+			writeChunk(recorder, *pChunk);
+			// Cleared, the capacity is kept for the next frames
+			pChunk->frameCount = 0;
+			pChunk->values.clear();
+			pChunk->pointCounts.clear();
+			pChunk->times.clear();
+			lock.lock();
+			recorder.freeChunks.push_back(pChunk);
+		}
+	}
+
+	// Where the parts of a chunk are in the mapped file
+	struct ChunkView {
+		uint32_t frameCount;
+		const unsigned char* pMinimums;
+		const unsigned char* pSteps;
+		const unsigned char* pPointCounts;
+		const unsigned char* pTimes;
+		const unsigned char* pPayload;
+		const unsigned char* pPayloadEnd;
+	};
+
+	bool parseChunk(const unsigned char* pData, size_t size, uint64_t offset, int componentCount, ChunkView& view) {
+		if (offset + 8 > size || memcmp(pData + offset, POINT_CACHE_CHUNK_TAG, sizeof(POINT_CACHE_CHUNK_TAG)) != 0) {
+			return false;
+		}
+		view.frameCount = load<uint32_t>(pData + offset + 4);
+		const uint64_t headerSize = 8 + uint64_t(componentCount) * 8 + uint64_t(view.frameCount) * 8 + 4;
+		if (offset + headerSize > size) {
+			return false;
+		}
+		const unsigned char* p = pData + offset + 8;
+		view.pMinimums = p;
+		view.pSteps = view.pMinimums + componentCount * sizeof(float);
+		view.pPointCounts = view.pSteps + componentCount * sizeof(float);
+		view.pTimes = view.pPointCounts + view.frameCount * sizeof(uint32_t);
+		const uint32_t payloadSize = load<uint32_t>(view.pTimes + view.frameCount * sizeof(float));
+		if (offset + headerSize + payloadSize > size) {
+			return false;
+		}
+		view.pPayload = pData + offset + headerSize;
+		view.pPayloadEnd = view.pPayload + payloadSize;
+		return true;
+	}
+
+	bool readIndex(PointCachePlayer& player) {
+		const unsigned char* pTail = player.pData + player.size - INDEX_TAIL_SIZE;
+		if (player.size < FILE_HEADER_SIZE + INDEX_TAIL_SIZE || memcmp(pTail + 12, POINT_CACHE_INDEX_TAG, sizeof(POINT_CACHE_INDEX_TAG)) != 0) {
+			return false;
+		}
+		const uint64_t indexOffset = load<uint64_t>(pTail);
+		const uint32_t chunkCount = load<uint32_t>(pTail + 8);
+		if (indexOffset + uint64_t(chunkCount) * INDEX_ENTRY_SIZE != player.size - INDEX_TAIL_SIZE) {
+			return false;
+		}
+		player.chunks.resize(chunkCount);
+		for (uint32_t i = 0; i < chunkCount; ++i) {
+			const unsigned char* pEntry = player.pData + indexOffset + i * INDEX_ENTRY_SIZE;
+			player.chunks[i] = { load<uint64_t>(pEntry), load<uint32_t>(pEntry + 8), load<uint32_t>(pEntry + 12) };
+		}
+		return true;
+	}
+
+	// For files whose recording was interrupted before the index was written
+	void walkChunks(PointCachePlayer& player) {
+		player.chunks.clear();
+		uint64_t offset = FILE_HEADER_SIZE;
+		uint32_t firstFrame = 0;
+		ChunkView view;
+		while (parseChunk(player.pData, player.size, offset, player.componentCount, view)) {
+			player.chunks.push_back({ offset, firstFrame, view.frameCount });
+			firstFrame += view.frameCount;
+			offset = view.pPayloadEnd - player.pData;
+		}
+	}
+
+	bool beginChunk(PointCachePlayer& player, int chunk) {
+		ChunkView view;
+		if (!parseChunk(player.pData, player.size, player.chunks[chunk].offset, player.componentCount, view)) {
+			return false;
+		}
+		player.maxPointCount = 0;
+		for (uint32_t f = 0; f < view.frameCount; ++f) {
+			player.maxPointCount = std::max(player.maxPointCount, static_cast<int>(load<uint32_t>(view.pPointCounts + f * sizeof(uint32_t))));
+		}
+		player.quantized.assign(size_t(player.componentCount) * player.maxPointCount, 0);
+		player.previousPointCount = 0;
+		player.pCursor = view.pPayload;
+		player.chunk = chunk;
+		player.chunkFrame = -1;
+		return true;
+	}
+
+	bool decodeNextFrame(PointCachePlayer& player) {
+		ChunkView view;
+		if (!parseChunk(player.pData, player.size, player.chunks[player.chunk].offset, player.componentCount, view)
+			|| player.chunkFrame + 1 >= static_cast<int>(view.frameCount)) {
+			return false;
+		}
+		const int frame = player.chunkFrame + 1;
+		const int pointCount = static_cast<int>(load<uint32_t>(view.pPointCounts + frame * sizeof(uint32_t)));
+		player.values.resize(size_t(player.componentCount) * pointCount);
+
+		const unsigned char* pCursor = player.pCursor;
+		for (int c = 0; c < player.componentCount; ++c) {
+			const float minimum = load<float>(view.pMinimums + c * sizeof(float));
+			const float step = load<float>(view.pSteps + c * sizeof(float));
+			int32_t* pPrevious = player.quantized.data() + size_t(c) * player.maxPointCount;
+			float* pValues = player.values.data() + size_t(c) * pointCount;
+			for (int i = 0; i < pointCount; ++i) {
+				uint32_t encoded = 0;
+				int shift = 0;
+				unsigned char byte;
+				do {
+					if (pCursor == view.pPayloadEnd || shift > 28) {
+						return false;
+					}
+					byte = *pCursor++;
+					encoded |= uint32_t(byte & 0x7F) << shift;
+					shift += 7;
+				} while (byte & 0x80);
+				const int32_t quantized = (i < player.previousPointCount ? pPrevious[i] : 0) + unzigzag(encoded);
+				pPrevious[i] = quantized;
+				pValues[i] = minimum + quantized * step;
+			}
+		}
+
+		player.pCursor = pCursor;
+		player.previousPointCount = pointCount;
+		player.pointCount = pointCount;
+		player.time = load<float>(view.pTimes + frame * sizeof(float));
+		player.chunkFrame = frame;
+		return true;
+	}
+
+	bool mapFile(PointCachePlayer& player, char const* path) {
+#ifdef _WIN32
+		HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+		if (file == INVALID_HANDLE_VALUE) {
+			return false;
+		}
+		LARGE_INTEGER fileSize;
+		HANDLE mapping = GetFileSizeEx(file, &fileSize) && fileSize.QuadPart > 0
+			? CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr)
+			: nullptr;
+		const void* pView = mapping ? MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) : nullptr;
+		if (!pView) {
+			if (mapping) {
+				CloseHandle(mapping);
+			}
+			CloseHandle(file);
+			return false;
+		}
+		player.pFileHandle = file;
+		player.pMappingHandle = mapping;
+		player.pData = static_cast<const unsigned char*>(pView);
+		player.size = static_cast<size_t>(fileSize.QuadPart);
+		return true;
+#else
+		const int file = open(path, O_RDONLY);
+		if (file < 0) {
+			return false;
+		}
+		struct stat fileStat;
+		void* pView = fstat(file, &fileStat) == 0 && fileStat.st_size > 0
+			? mmap(nullptr, static_cast<size_t>(fileStat.st_size), PROT_READ, MAP_PRIVATE, file, 0)
+			: MAP_FAILED;
+		// The mapping stays valid once the descriptor is closed
+		close(file);
+		if (pView == MAP_FAILED) {
+			return false;
+		}
+		player.pData = static_cast<const unsigned char*>(pView);
+		player.size = static_cast<size_t>(fileStat.st_size);
+		return true;
+#endif
+	}
+
+	void unmapFile(PointCachePlayer& player) {
+#ifdef _WIN32
+		UnmapViewOfFile(player.pData);
+		CloseHandle(static_cast<HANDLE>(player.pMappingHandle));
+		CloseHandle(static_cast<HANDLE>(player.pFileHandle));
+#else
+		munmap(const_cast<unsigned char*>(player.pData), player.size);
+#endif
+	}
+}
+
+bool startPointCacheRecording(PointCacheRecorder& recorder, char const* path, int componentCount) {
+	assert(recorder.pFile == nullptr);
+	assert(componentCount > 0 && componentCount <= POINT_CACHE_MAX_COMPONENTS);
+	recorder.pFile = fopen(path, "wb");
+	if (!recorder.pFile) {
+		fprintf(stderr, "Failed to open file %s \n", path);
+		return false;
+	}
+	recorder.componentCount = componentCount;
+	recorder.fileOffset = 0;
+	recorder.writtenFrameCount = 0;
+	recorder.index.clear();
+	recorder.recordedFrameCount = 0;
+	recorder.droppedFrameCount = 0;
+	recorder.recordedBytes = 0;
+	recorder.writtenBytes = 0;
+	recorder.writtenChunkCount = 0;
+	recorder.lastEncodeMs = 0.f;
+
+	const uint32_t fileComponentCount = static_cast<uint32_t>(componentCount);
+	writeBytes(recorder, POINT_CACHE_MAGIC, sizeof(POINT_CACHE_MAGIC));
+	writeBytes(recorder, &fileComponentCount, sizeof(fileComponentCount));
+
+	// Chunks of a previous recording are reused
+	recorder.freeChunks.clear();
+	recorder.fullChunks.clear();
+	for (std::unique_ptr<PointCacheChunk>& pChunk : recorder.chunks) {
+		recorder.freeChunks.push_back(pChunk.get());
+	}
+	recorder.pCurrentChunk = nullptr;
+	recorder.quit = false;
+	recorder.writer = std::thread(runPointCacheWriter, &recorder);
+	return true;
+}
+
+void stopPointCacheRecording(PointCacheRecorder& recorder) {
+	if (!recorder.pFile) {
+		return;
+	}
+	{
+		std::lock_guard<std::mutex> lock(recorder.mutex);
+		if (recorder.pCurrentChunk && recorder.pCurrentChunk->frameCount > 0) {
+			recorder.fullChunks.push_back(recorder.pCurrentChunk);
+		}
+		else if (recorder.pCurrentChunk) {
+			recorder.freeChunks.push_back(recorder.pCurrentChunk);
+		}
+		recorder.pCurrentChunk = nullptr;
+		recorder.quit = true;
+	}
+	recorder.wakeCv.notify_all();
+	recorder.writer.join();
+
+	const uint64_t indexOffset = recorder.fileOffset;
+	for (const PointCacheIndexEntry& entry : recorder.index) {
+		writeBytes(recorder, &entry.offset, sizeof(entry.offset));
+		writeBytes(recorder, &entry.firstFrame, sizeof(entry.firstFrame));
+		writeBytes(recorder, &entry.frameCount, sizeof(entry.frameCount));
+	}
+	const uint32_t chunkCount = static_cast<uint32_t>(recorder.index.size());
+	writeBytes(recorder, &indexOffset, sizeof(indexOffset));
+	writeBytes(recorder, &chunkCount, sizeof(chunkCount));
+	writeBytes(recorder, POINT_CACHE_INDEX_TAG, sizeof(POINT_CACHE_INDEX_TAG));
+
+	fclose(recorder.pFile);
+	recorder.pFile = nullptr;
+}
+
+bool recordPointCacheFrame(PointCacheRecorder& recorder, float const* const* pComponents, int stride, int pointCount, float time) {
+	if (!recorder.pFile) {
+		return false;
+	}
+	if (!recorder.pCurrentChunk) {
+		std::lock_guard<std::mutex> lock(recorder.mutex);
+		if (!recorder.freeChunks.empty()) {
+			recorder.pCurrentChunk = recorder.freeChunks.back();
+			recorder.freeChunks.pop_back();
+		}
+		else if (static_cast<int>(recorder.chunks.size()) < recorder.maxChunkCount) {
+			recorder.chunks.emplace_back(new PointCacheChunk());
+			recorder.pCurrentChunk = recorder.chunks.back().get();
+		}
+		else {
+			++recorder.droppedFrameCount;
+			return false;
+		}
+	}
+
+	PointCacheChunk& chunk = *recorder.pCurrentChunk;
+	const size_t frameOffset = chunk.values.size();
+	chunk.values.resize(frameOffset + size_t(recorder.componentCount) * pointCount);
+	for (int c = 0; c < recorder.componentCount; ++c) {
+		float* pDestination = chunk.values.data() + frameOffset + size_t(c) * pointCount;
+		const float* pSource = pComponents[c];
+		for (int i = 0; i < pointCount; ++i) {
+			pDestination[i] = pSource[size_t(i) * stride];
+		}
+	}
+	chunk.pointCounts.push_back(static_cast<uint32_t>(pointCount));
+	chunk.times.push_back(time);
+	++chunk.frameCount;
+	++recorder.recordedFrameCount;
+	recorder.recordedBytes += uint64_t(recorder.componentCount) * pointCount * sizeof(float);
+
+	if (chunk.frameCount >= recorder.framesPerChunk) {
+		{
+			std::lock_guard<std::mutex> lock(recorder.mutex);
+			recorder.fullChunks.push_back(recorder.pCurrentChunk);
+		}
+		recorder.wakeCv.notify_one();
+		recorder.pCurrentChunk = nullptr;
+	}
+	return true;
+}
+
+bool openPointCache(PointCachePlayer& player, char const* path) {
+	assert(player.pData == nullptr);
+	if (!mapFile(player, path)) {
+		fprintf(stderr, "Failed to open file %s \n", path);
+		return false;
+	}
+	if (player.size < FILE_HEADER_SIZE || memcmp(player.pData, POINT_CACHE_MAGIC, sizeof(POINT_CACHE_MAGIC)) != 0
+		|| load<uint32_t>(player.pData + 4) == 0 || load<uint32_t>(player.pData + 4) > POINT_CACHE_MAX_COMPONENTS) {
+		fprintf(stderr, "%s is not a point cache\n", path);
+		closePointCache(player);
+		return false;
+	}
+	player.componentCount = static_cast<int>(load<uint32_t>(player.pData + 4));
+	if (!readIndex(player)) {
+		walkChunks(player);
+	}
+	player.frameCount = 0;
+	for (const PointCacheIndexEntry& entry : player.chunks) {
+		player.frameCount += entry.frameCount;
+	}
+	return true;
+}
+
+void closePointCache(PointCachePlayer& player) {
+	if (player.pData) {
+		unmapFile(player);
+	}
+	player = PointCachePlayer();
+}
+
+bool readPointCacheFrame(PointCachePlayer& player, int frame) {
+	if (!player.pData || frame < 0 || frame >= player.frameCount) {
+		return false;
+	}
+	if (frame == player.frame) {
+		return true;
+	}
+	const auto it = std::upper_bound(player.chunks.begin(), player.chunks.end(), uint32_t(frame),
+		[](uint32_t value, const PointCacheIndexEntry& entry) { return value < entry.firstFrame; });
+	const int chunk = static_cast<int>(it - player.chunks.begin()) - 1;
+	const int chunkFrame = frame - static_cast<int>(player.chunks[chunk].firstFrame);
+	// Going back within a chunk restarts from its first frame
+	if (chunk != player.chunk || chunkFrame <= player.chunkFrame) {
+		if (!beginChunk(player, chunk)) {
+			fprintf(stderr, "Corrupted point cache (chunk %d)\n", chunk);
+			return false;
+		}
+	}
+	while (player.chunkFrame < chunkFrame) {
+		if (!decodeNextFrame(player)) {
+			fprintf(stderr, "Corrupted point cache (chunk %d)\n", chunk);
+			player.chunk = -1;
+			player.frame = -1;
+			return false;
+		}
+	}
+	player.frame = frame;
+	return true;
+}
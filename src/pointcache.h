@@ -0,0 +1,135 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Point cache: per frame, pointCount points of componentCount floats (a
+// position, a velocity...), the count may change between frames.
+//
+// File layout (little endian): "PCH1", uint32 componentCount, then chunks of
+// up to framesPerChunk frames, each decodable on its own:
+//   "PCCK", uint32 frameCount, float min[componentCount],
+//   float step[componentCount], uint32 pointCount[frameCount],
+//   float time[frameCount], uint32 payloadSize, payload
+// Values are quantized to 16 bits over [min, min + 65535 * step] of their
+// component in the chunk. The payload holds, frame after frame and component
+// after component, the difference of each quantized value with the same point
+// in the previous frame (0 for the first frame or a new point), zigzag and
+// LEB128 encoded. The file ends with the chunk index:
+//   { uint64 offset, uint32 firstFrame, uint32 frameCount }[chunkCount],
+//   uint64 indexOffset, uint32 chunkCount, "PCIX"
+// A file without index (recording interrupted) is read by walking the chunks.
+
+struct PointCacheChunk {
+	int frameCount = 0;
+	std::vector<float> values; // per frame, one block of pointCount values per component
+	std::vector<uint32_t> pointCounts;
+	std::vector<float> times;
+};
+
+struct PointCacheIndexEntry {
+	uint64_t offset;
+	uint32_t firstFrame;
+	uint32_t frameCount;
+};
+
+// Frames are copied into a chunk by the caller, full chunks are encoded and
+// written by a background thread. A fixed set of chunks is recycled; when the
+// writer falls behind and none is free, frames are dropped rather than waited for.
+struct PointCacheRecorder {
+	FILE* pFile = nullptr;
+	int componentCount = 0;
+	int framesPerChunk = 64;
+	int maxChunkCount = 4;
+
+	std::vector<std::unique_ptr<PointCacheChunk>> chunks;
+	PointCacheChunk* pCurrentChunk = nullptr; // caller thread only
+	std::mutex mutex;
+	std::condition_variable wakeCv;
+	std::vector<PointCacheChunk*> fullChunks; // oldest first
+	std::vector<PointCacheChunk*> freeChunks;
+	bool quit = false;
+	std::thread writer;
+
+	// Writer thread only
+	std::vector<PointCacheIndexEntry> index;
+	uint64_t fileOffset = 0;
+	uint32_t writtenFrameCount = 0;
+	std::vector<int32_t> previousQuantized;
+	std::vector<unsigned char> payload;
+
+	// Stats
+	int recordedFrameCount = 0;
+	int droppedFrameCount = 0;
+	uint64_t recordedBytes = 0; // as floats
+	std::atomic<uint64_t> writtenBytes{ 0 };
+	std::atomic<int> writtenChunkCount{ 0 };
+	std::atomic<float> lastEncodeMs{ 0.f };
+};
+
+bool startPointCacheRecording(PointCacheRecorder& recorder, char const* path, int componentCount);
+
+// Flushes the current chunk, waits for the writer and writes the index
+void stopPointCacheRecording(PointCacheRecorder& recorder);
+
+inline bool isPointCacheRecording(const PointCacheRecorder& recorder) {
+	return recorder.pFile != nullptr;
+}
+
+// Component c of point i is pComponents[c][i * stride]. Never waits for the
+// writer, returns false when the frame was dropped.
+bool recordPointCacheFrame(PointCacheRecorder& recorder, float const* const* pComponents, int stride, int pointCount, float time);
+
+// Memory mapped point cache, decoded one frame at a time. Frames are decoded
+// forward from the start of their chunk, so playing in order costs one frame
+// of decoding per frame.
+struct PointCachePlayer {
+	const unsigned char* pData = nullptr;
+	size_t size = 0;
+	void* pFileHandle = nullptr; // Windows only
+	void* pMappingHandle = nullptr; // Windows only
+
+	int componentCount = 0;
+	int frameCount = 0;
+	std::vector<PointCacheIndexEntry> chunks;
+
+	// Decoder state
+	int chunk = -1;
+	int chunkFrame = -1; // last decoded frame within the chunk
+	const unsigned char* pCursor = nullptr;
+	int maxPointCount = 0; // over the chunk
+	int previousPointCount = 0;
+	std::vector<int32_t> quantized; // componentCount blocks of maxPointCount
+
+	// Last decoded frame, one block of pointCount values per component
+	int frame = -1;
+	int pointCount = 0;
+	float time = 0.f;
+	std::vector<float> values;
+
+	// Playback, driven by the viewer
+	int playFrame = 0;
+	bool paused = false;
+};
+
+bool openPointCache(PointCachePlayer& player, char const* path);
+
+void closePointCache(PointCachePlayer& player);
+
+inline bool isPointCacheOpen(const PointCachePlayer& player) {
+	return player.pData != nullptr;
+}
+
+// Decodes frame into player.values, returns false on a corrupted file or a
+// frame out of range
+bool readPointCacheFrame(PointCachePlayer& player, int frame);
+
+inline float const* getPointCacheComponent(const PointCachePlayer& player, int component) {
+	return player.values.data() + component * player.pointCount;
+}
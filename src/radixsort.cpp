@@ -0,0 +1,57 @@
+#include "radixsort.h"
+
+#include <string.h>
+
+namespace {
+	constexpr int RADIX_BITS = 8;
+	constexpr uint32_t RADIX_SIZE = 1u << RADIX_BITS;
+	constexpr int RADIX_PASS_COUNT = 32 / RADIX_BITS;
+
+	uint32_t flipFloatBits(float key) {
+		uint32_t bits;
+		memcpy(&bits, &key, sizeof(bits));
+		const uint32_t mask = uint32_t(int32_t(bits) >> 31) | 0x80000000u;
+		return bits ^ mask;
+	}
+}
+
+void radixSortFloatKeys(float const* keys, uint32_t count, RadixSortScratch& scratch) {
+	scratch.keys.resize(count);
+	scratch.swapKeys.resize(count);
+	scratch.order.resize(count);
+	scratch.swapOrder.resize(count);
+
+	// Histograms of every pass in a single read of the keys
+	uint32_t histograms[RADIX_PASS_COUNT][RADIX_SIZE] = {};
+	for (uint32_t i = 0; i < count; ++i) {
+		const uint32_t key = flipFloatBits(keys[i]);
+		scratch.keys[i] = key;
+		scratch.order[i] = i;
+		for (int pass = 0; pass < RADIX_PASS_COUNT; ++pass) {
+			++histograms[pass][(key >> (pass * RADIX_BITS)) & (RADIX_SIZE - 1)];
+		}
+	}
+
+	for (int pass = 0; pass < RADIX_PASS_COUNT; ++pass) {
+		const int shift = pass * RADIX_BITS;
+		uint32_t* histogram = histograms[pass];
+		if (count == 0 || histogram[(scratch.keys[0] >> shift) & (RADIX_SIZE - 1)] == count) {
+			continue;
+		}
+		// Exclusive prefix sum, then scatter with each bucket start as its cursor
+		uint32_t sum = 0;
+		for (uint32_t digit = 0; digit < RADIX_SIZE; ++digit) {
+			const uint32_t digitCount = histogram[digit];
+			histogram[digit] = sum;
+			sum += digitCount;
+		}
+		for (uint32_t i = 0; i < count; ++i) {
+			const uint32_t key = scratch.keys[i];
+			const uint32_t destination = histogram[(key >> shift) & (RADIX_SIZE - 1)]++;
+			scratch.swapKeys[destination] = key;
+			scratch.swapOrder[destination] = scratch.order[i];
+		}
+		scratch.keys.swap(scratch.swapKeys);
+		scratch.order.swap(scratch.swapOrder);
+	}
+}
@@ -0,0 +1,19 @@
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+
+// Buffers reused from one sort to the next
+struct RadixSortScratch {
+	std::vector<uint32_t> keys;
+	std::vector<uint32_t> swapKeys;
+	std::vector<uint32_t> order;
+	std::vector<uint32_t> swapOrder;
+};
+
+// Stable LSD radix sort of float keys, ascending. The key bits are flipped so
+// that they compare as unsigned integers (negative keys fully inverted,
+// positive ones with their sign bit set), then sorted 8 bits at a time; passes
+// where every key has the same digit are skipped. On return scratch.order
+// holds the indices of the keys in sorted order.
+void radixSortFloatKeys(float const* keys, uint32_t count, RadixSortScratch& scratch);
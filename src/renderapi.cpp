@@ -462,6 +462,174 @@ void RenderApi3D::horizontalPlane(const glm::vec3& center, const glm::vec2& size
 
 }
 
+void RenderApi3D::orientedGlyphs(glm::vec3 const* positions, glm::vec3 const* directions, glm::vec4 const* colors, unsigned int count, float size, glm::mat4 const* pModel) const {
+	if (count == 0) {
+		return;
+	}
+
+	// Unit pyramid along +Z, centered on the origin, flat shaded
+	const glm::vec3 tip = { 0.f, 0.f, 0.5f };
+	const glm::vec3 base[] = {
+		glm::vec3(-0.2f, -0.2f, -0.5f),
+		glm::vec3(0.2f, -0.2f, -0.5f),
+		glm::vec3(0.2f, 0.2f, -0.5f),
+		glm::vec3(-0.2f, 0.2f, -0.5f),
+	};
+	glm::vec3 vertices[18];
+	glm::vec3 normals[18];
+	int iVertex = 0;
+	for (int i = 0; i < 4; ++i) {
+		vertices[iVertex++] = base[i];
+		vertices[iVertex++] = base[(i + 1) % 4];
+		vertices[iVertex++] = tip;
+	}
+	vertices[iVertex++] = base[0];
+	vertices[iVertex++] = base[2];
+	vertices[iVertex++] = base[1];
+	vertices[iVertex++] = base[0];
+	vertices[iVertex++] = base[3];
+	vertices[iVertex++] = base[2];
+	for (int i = 0; i < iVertex; i += 3) {
+		const glm::vec3 normal = glm::normalize(glm::cross(vertices[i + 1] - vertices[i], vertices[i + 2] - vertices[i]));
+		normals[i] = normals[i + 1] = normals[i + 2] = normal;
+	}
+
+	const ShaderProgram3D_instanced& shader = pRenderEngine->shader3D_instanced;
+	glm::mat4 model = pModel ? *pModel : glm::identity<glm::mat4>();
+	glProgramUniformMatrix4fv(shader.programId, shader.modelLocation, 1, 0, glm::value_ptr(model));
+	glProgramUniform1f(shader.programId, shader.glyphScaleLocation, size);
+
+	InstancedBuffer3D instancedBuffer;
+	CreateInstancedBuffer3DParams createParams;
+	createParams.pVertices = vertices;
+	createParams.pNormals = normals;
+	createParams.vertexCount = COUNTOF(vertices);
+	createParams.pInstanceColors = colors;
+	createParams.pInstancePositions = positions;
+	createParams.pInstanceDirections = directions;
+	createParams.instanceCount = count;
+	createInstancedBuffer3D(instancedBuffer, createParams);
+
+	glUseProgram(shader.programId);
+	glBindVertexArray(instancedBuffer.vao);
+	glDrawArraysInstanced(GL_TRIANGLES, 0, instancedBuffer.vertexCount, instancedBuffer.instanceCount);
+	glBindVertexArray(0);
+	glUseProgram(pShader3D->programId);
+
+	deleteInstancedBuffer3D(instancedBuffer);
+}
+
+void RenderApi3D::trails(TrailRing& ring, float const* x, float const* y, float const* z, uint32_t const* ids, unsigned int count, int length, const glm::vec4& color) const {
+	if (count == 0 || length < 2) {
+		return;
+	}
+	if (ring.length != length || int(count) > ring.capacity) {
+		const int capacity = glm::max(int(count + count / 2), ring.capacity);
+		deleteTrailRing(ring);
+		createTrailRing(ring, capacity, length);
+	}
+
+	// The only CPU write: interleave this frame's points in the stream buffer,
+	// the GPU copies them into the ring slot
+	StreamBuffer& stream = pRenderEngine->streamBuffer;
+	const GLsizeiptr frameSize = GLsizeiptr(count) * 4 * sizeof(float);
+	GLintptr offset;
+	float* pDestination = (float*)allocateStreamBuffer(stream, frameSize, offset);
+	if (pDestination) {
+		for (unsigned int i = 0; i < count; ++i) {
+			pDestination[4 * i + 0] = x[i];
+			pDestination[4 * i + 1] = y[i];
+			pDestination[4 * i + 2] = z[i];
+			memcpy(&pDestination[4 * i + 3], &ids[i], sizeof(float));
+		}
+		ring.head = ring.frameCount == 0 ? 0 : (ring.head + 1) % ring.length;
+		ring.frameCount = glm::min(ring.frameCount + 1, ring.length);
+		glBindBuffer(GL_COPY_READ_BUFFER, stream.buffer);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, ring.buffer);
+		glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, offset, GLintptr(ring.head) * ring.capacity * 4 * sizeof(float), frameSize);
+		glBindBuffer(GL_COPY_READ_BUFFER, 0);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+	}
+	// else the stream buffer grows for the next frame, the history is drawn as is
+	if (ring.frameCount < 2) {
+		return;
+	}
+
+	const ShaderProgram3D_trails& shader = pRenderEngine->shader3D_trails;
+	glProgramUniform1i(shader.programId, shader.capacityLocation, ring.capacity);
+	glProgramUniform1i(shader.programId, shader.lengthLocation, ring.length);
+	glProgramUniform1i(shader.programId, shader.headLocation, ring.head);
+	glProgramUniform1i(shader.programId, shader.frameCountLocation, ring.frameCount);
+	glProgramUniform4fv(shader.programId, shader.trailColorLocation, 1, glm::value_ptr(color));
+
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 9, ring.buffer);
+	glUseProgram(shader.programId);
+	glBindVertexArray(pRenderEngine->emptyVao);
+	// One line per pair of consecutive frames
+	glDrawArrays(GL_LINES, 0, 2 * (ring.length - 1) * count);
+	glBindVertexArray(0);
+	glUseProgram(pShader3D->programId);
+}
+
+void RenderApi3D::translucentSphere(const glm::vec3& center, float radius, const glm::vec4& color) const {
+	TranslucentQueue& queue = pRenderEngine->translucentQueue;
+	queue.spheres.emplace_back(center, radius);
+	queue.colors.push_back(color);
+}
+
+void RenderApi3D::drawTranslucent(const glm::mat4& view) const {
+	constexpr int TRANSLUCENT_SPHERE_SLICES = 12;
+	constexpr int TRANSLUCENT_SPHERE_STACKS = 6;
+
+	TranslucentQueue& queue = pRenderEngine->translucentQueue;
+	const unsigned int count = static_cast<unsigned int>(queue.spheres.size());
+	if (count == 0) {
+		return;
+	}
+
+	// The view looks down -z: ascending z is farthest first
+	queue.depths.resize(count);
+	for (unsigned int i = 0; i < count; ++i) {
+		const glm::vec4& sphere = queue.spheres[i];
+		queue.depths[i] = view[0][2] * sphere.x + view[1][2] * sphere.y + view[2][2] * sphere.z + view[3][2];
+	}
+	radixSortFloatKeys(queue.depths.data(), count, queue.sort);
+
+	StreamBuffer& stream = pRenderEngine->streamBuffer;
+	const GLsizeiptr size = GLsizeiptr(count) * 2 * sizeof(glm::vec4);
+	GLintptr offset;
+	glm::vec4* pDestination = (glm::vec4*)allocateStreamBuffer(stream, size, offset);
+	if (pDestination) {
+		for (unsigned int i = 0; i < count; ++i) {
+			const uint32_t sphere = queue.sort.order[i];
+			pDestination[2 * i + 0] = queue.spheres[sphere];
+			pDestination[2 * i + 1] = queue.colors[sphere];
+		}
+		glBindBufferRange(GL_SHADER_STORAGE_BUFFER, 10, stream.buffer, offset, size);
+
+		const ShaderProgram3D_spheres& shader = pRenderEngine->shader3D_spheres;
+		glProgramUniform1i(shader.programId, shader.slicesLocation, TRANSLUCENT_SPHERE_SLICES);
+		glProgramUniform1i(shader.programId, shader.stacksLocation, TRANSLUCENT_SPHERE_STACKS);
+
+		// Instances are blended in order; culling keeps the far side of each
+		// sphere from being blended over its near side
+		glDepthMask(GL_FALSE);
+		glEnable(GL_CULL_FACE);
+		glCullFace(GL_BACK);
+		glUseProgram(shader.programId);
+		glBindVertexArray(pRenderEngine->emptyVao);
+		glDrawArraysInstanced(GL_TRIANGLES, 0, 6 * TRANSLUCENT_SPHERE_SLICES * TRANSLUCENT_SPHERE_STACKS, count);
+		glBindVertexArray(0);
+		glDisable(GL_CULL_FACE);
+		glDepthMask(GL_TRUE);
+		glUseProgram(pShader3D->programId);
+	}
+	// else they are skipped this frame, the stream buffer grows for the next one
+
+	queue.spheres.clear();
+	queue.colors.clear();
+}
+
 void RenderApi2D::buffer(const Buffer2D& buffer, eDrawMode drawMode) const {
 	assert(buffer.vao); // did you call createDrawBuffer2D ?
 	glBindVertexArray(buffer.vao);
@@ -640,4 +808,39 @@ void RenderApi2D::arrow(const glm::vec2& from, const glm::vec2& to, float thickn
 	buffer(buffer2D, eDrawMode::Triangles);
 
 	deleteBuffer2D(buffer2D);
-}
\ No newline at end of file
+}
+
+void RenderApi2D::boids(float const* x, float const* y, float const* vx, float const* vy, int const* neighborCount, unsigned int count,
+	float thickness, float hatRatio, const glm::vec4& minNeighborColor, const glm::vec4& maxNeighborColor, int maxNeighborForColor) const {
+	if (count == 0) {
+		return;
+	}
+
+	StreamBuffer& stream = pRenderEngine->streamBuffer;
+	void const* arrays[] = { x, y, vx, vy, neighborCount };
+	static_assert(sizeof(float) == sizeof(int), "all arrays have the same stride");
+	const GLsizeiptr arraySize = count * sizeof(float);
+	for (unsigned int i = 0; i < COUNTOF(arrays); ++i) {
+		GLintptr offset;
+		void* pDestination = allocateStreamBuffer(stream, arraySize, offset);
+		if (!pDestination) {
+			// The buffer grows for the next frame
+			return;
+		}
+		memcpy(pDestination, arrays[i], arraySize);
+		glBindBufferRange(GL_SHADER_STORAGE_BUFFER, 4 + i, stream.buffer, offset, arraySize);
+	}
+
+	const ShaderProgram2D_boids& shader = pRenderEngine->shader2D_boids;
+	glProgramUniform1f(shader.programId, shader.thicknessLocation, thickness);
+	glProgramUniform1f(shader.programId, shader.hatRatioLocation, hatRatio);
+	glProgramUniform4fv(shader.programId, shader.minNeighborColorLocation, 1, glm::value_ptr(minNeighborColor));
+	glProgramUniform4fv(shader.programId, shader.maxNeighborColorLocation, 1, glm::value_ptr(maxNeighborColor));
+	glProgramUniform1f(shader.programId, shader.maxNeighborForColorLocation, float(maxNeighborForColor));
+
+	glUseProgram(shader.programId);
+	glBindVertexArray(pRenderEngine->emptyVao);
+	glDrawArrays(GL_TRIANGLES, 0, 9 * count);
+	glBindVertexArray(0);
+	glUseProgram(pRenderEngine->shader2D.programId);
+}
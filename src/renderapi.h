@@ -2,11 +2,13 @@
 
 #include <glad.h>
 #include <glm/fwd.hpp>
+#include <stdint.h>
 
 struct Buffer3D;
 struct Buffer2D;
 struct RenderEngine;
 struct ShaderProgram3D;
+struct TrailRing;
 
 enum class eDrawMode : GLenum {
 	Triangles = GL_TRIANGLES,
@@ -34,6 +36,26 @@ struct RenderApi3D {
 	void bone(const glm::vec3& childRelativePosition, const glm::vec4& color, const glm::quat& parentAbsoluteRotation, const glm::vec3& parentAbsolutePosition) const;
 	
 	void horizontalPlane(const glm::vec3& center, const glm::vec2& size, unsigned int SideSubdivision, const glm::vec4& color) const;
+
+	// One lit pyramid per instance pointing along directions[i], in a single
+	// instanced draw. Directions need not be normalized. pModel applies to the
+	// positions only, size is the glyph length in world units.
+	void orientedGlyphs(glm::vec3 const* positions, glm::vec3 const* directions, glm::vec4 const* colors, unsigned int count, float size, glm::mat4 const* pModel) const;
+
+	// Appends this frame's points to the ring, then draws the trail of each
+	// point over the last ring length frames, fading from color to transparent,
+	// in a single draw whose vertices are pulled from the ring. ids tell points
+	// apart across frames: a trail starts where its slot got another id. The
+	// ring is recreated, and so cleared, when length changes or count outgrows it.
+	void trails(TrailRing& ring, float const* x, float const* y, float const* z, uint32_t const* ids, unsigned int count, int length, const glm::vec4& color) const;
+
+	// Only queued: translucent spheres are drawn once the 3D callbacks return,
+	// after all opaque draws, sorted back to front by the view depth of their
+	// center and without depth writes, in a single instanced draw.
+	void translucentSphere(const glm::vec3& center, float radius, const glm::vec4& color) const;
+
+	// Sorts, draws and clears the translucent queue. Called by the render engine.
+	void drawTranslucent(const glm::mat4& view) const;
 };
 
 struct RenderApi2D {
@@ -51,4 +73,10 @@ struct RenderApi2D {
 	void circleContour(const glm::vec2& center, float radius, unsigned int subdivisions, const glm::vec4& color) const;
 
 	void arrow(const glm::vec2& from, const glm::vec2& to, float thickness, float hatRatio /*between 0 and 1*/, const glm::vec4& color) const;
+
+	// Same as calling arrow(p, p + normalize(v), ...) for each boid with its
+	// color mixed from the neighbor count, but the arrays are copied as is to
+	// the GPU and the arrows are built by the vertex shader.
+	void boids(float const* x, float const* y, float const* vx, float const* vy, int const* neighborCount, unsigned int count,
+		float thickness, float hatRatio, const glm::vec4& minNeighborColor, const glm::vec4& maxNeighborColor, int maxNeighborForColor) const;
 };
\ No newline at end of file
@@ -14,16 +14,39 @@ bool createRenderEngine(RenderEngine& engine) {
 	if (!createShaderProgram3D_custom(engine.shader3D_custom)) {
 		return false;
 	}
+	if (!createShaderProgram3D_instanced(engine.shader3D_instanced)) {
+		return false;
+	}
+	if (!createShaderProgram3D_trails(engine.shader3D_trails)) {
+		return false;
+	}
+	if (!createShaderProgram3D_spheres(engine.shader3D_spheres)) {
+		return false;
+	}
 	if (!createShaderProgram2D(engine.shader2D)) {
 		return false;
 	}
+	if (!createShaderProgram2D_boids(engine.shader2D_boids)) {
+		return false;
+	}
+	// Kept across shader reloads
+	if (!engine.emptyVao) {
+		glGenVertexArrays(1, &engine.emptyVao);
+	}
+	if (!engine.streamBuffer.buffer) {
+		createStreamBuffer(engine.streamBuffer, 4 * 1024 * 1024);
+	}
 	return true;
 }
 
 bool reloadRenderEngineShaders(RenderEngine& engine) {
 	glDeleteProgram(engine.shader3D.programId);
 	glDeleteProgram(engine.shader3D_custom.programId);
+	glDeleteProgram(engine.shader3D_instanced.programId);
+	glDeleteProgram(engine.shader3D_trails.programId);
+	glDeleteProgram(engine.shader3D_spheres.programId);
 	glDeleteProgram(engine.shader2D.programId);
+	glDeleteProgram(engine.shader2D_boids.programId);
 	return createRenderEngine(engine);
 }
 
@@ -33,6 +56,8 @@ void renderEngineFrame(const RenderEngine& engine, const RenderParams& params) {
 	}
 	glViewport(0, 0, params.viewportWidth, params.viewportHeight);
 
+	beginStreamBufferFrame(engine.streamBuffer);
+
 	// Clear the front buffer
 	glClearColor(params.backgroundColor.r, params.backgroundColor.g, params.backgroundColor.b, params.backgroundColor.a);
 	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
@@ -75,6 +100,22 @@ void renderEngineFrame(const RenderEngine& engine, const RenderParams& params) {
 
 		const ShaderProgram3D& shader3D = engine.shader3D;
 
+		// Used by RenderApi3D::orientedGlyphs from the 3d callback
+		const ShaderProgram3D_instanced& shader3D_instanced = engine.shader3D_instanced;
+		glProgramUniformMatrix4fv(shader3D_instanced.programId, shader3D_instanced.viewLocation, 1, 0, glm::value_ptr(view));
+		glProgramUniformMatrix4fv(shader3D_instanced.programId, shader3D_instanced.projectionLocation, 1, 0, glm::value_ptr(projection));
+
+		// Used by RenderApi3D::trails, unlit
+		const ShaderProgram3D_trails& shader3D_trails = engine.shader3D_trails;
+		glProgramUniformMatrix4fv(shader3D_trails.programId, shader3D_trails.viewLocation, 1, 0, glm::value_ptr(view));
+		glProgramUniformMatrix4fv(shader3D_trails.programId, shader3D_trails.projectionLocation, 1, 0, glm::value_ptr(projection));
+		glProgramUniform1i(shader3D_trails.programId, shader3D_trails.lightingEnabledLocation, 0);
+
+		// Used by RenderApi3D::drawTranslucent once the 3d callbacks are done
+		const ShaderProgram3D_spheres& shader3D_spheres = engine.shader3D_spheres;
+		glProgramUniformMatrix4fv(shader3D_spheres.programId, shader3D_spheres.viewLocation, 1, 0, glm::value_ptr(view));
+		glProgramUniformMatrix4fv(shader3D_spheres.programId, shader3D_spheres.projectionLocation, 1, 0, glm::value_ptr(projection));
+
 		glUseProgram(shader3D.programId);
 
 		glProgramUniformMatrix4fv(shader3D.programId, shader3D.viewLocation, 1, 0, glm::value_ptr(view));
@@ -87,6 +128,20 @@ void renderEngineFrame(const RenderEngine& engine, const RenderParams& params) {
 		glProgramUniform1f(shader3D.programId, shader3D.specularLocation, params.specular);
 		glProgramUniform1f(shader3D.programId, shader3D.specularPowLocation, params.specularPow);
 
+		glProgramUniform3fv(shader3D_instanced.programId, shader3D_instanced.lightDirLocation, 1, glm::value_ptr(lightViewSpaceVec3));
+		glProgramUniform1f(shader3D_instanced.programId, shader3D_instanced.lightStrengthLocation, params.lightStrength);
+		glProgramUniform1f(shader3D_instanced.programId, shader3D_instanced.ambientLocation, params.lightAmbient);
+		glProgramUniform1f(shader3D_instanced.programId, shader3D_instanced.specularLocation, params.specular);
+		glProgramUniform1f(shader3D_instanced.programId, shader3D_instanced.specularPowLocation, params.specularPow);
+		glProgramUniform1i(shader3D_instanced.programId, shader3D_instanced.lightingEnabledLocation, 1);
+
+		glProgramUniform3fv(shader3D_spheres.programId, shader3D_spheres.lightDirLocation, 1, glm::value_ptr(lightViewSpaceVec3));
+		glProgramUniform1f(shader3D_spheres.programId, shader3D_spheres.lightStrengthLocation, params.lightStrength);
+		glProgramUniform1f(shader3D_spheres.programId, shader3D_spheres.ambientLocation, params.lightAmbient);
+		glProgramUniform1f(shader3D_spheres.programId, shader3D_spheres.specularLocation, params.specular);
+		glProgramUniform1f(shader3D_spheres.programId, shader3D_spheres.specularPowLocation, params.specularPow);
+		glProgramUniform1i(shader3D_spheres.programId, shader3D_spheres.lightingEnabledLocation, 1);
+
 		RenderApi3D api3D;
 		api3D.pShader3D = &shader3D;
 		api3D.pRenderEngine = &engine;
@@ -116,6 +171,9 @@ void renderEngineFrame(const RenderEngine& engine, const RenderParams& params) {
 		params.render3DCustomCallback(api3D, params.pRender3DCustomCallbackUserData);
 		glDeleteBuffers(1, &ssbo);
 		glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+		// Translucent draws of both callbacks, over everything opaque
+		api3D.drawTranslucent(view);
 	}
 
 	// 2d
@@ -131,12 +189,15 @@ void renderEngineFrame(const RenderEngine& engine, const RenderParams& params) {
 			float(params.viewportHeight),
 		};
 		glProgramUniform2fv(shader2D.programId, shader2D.viewportSizeLocation, 1, glm::value_ptr(viewportSize));
+		glProgramUniform2fv(engine.shader2D_boids.programId, engine.shader2D_boids.viewportSizeLocation, 1, glm::value_ptr(viewportSize));
 
 		RenderApi2D api2D;
 		api2D.pRenderEngine = &engine;
 		params.render2DCallback(api2D, params.pRender3DCallbackUserData);
 	}
 
+	endStreamBufferFrame(engine.streamBuffer);
+
 	// restore gl state
 	if (bEnableBlend) {
 		glEnable(GL_BLEND);
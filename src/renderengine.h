@@ -3,10 +3,13 @@
 #include <glad.h>
 
 #include "shader.h"
+#include "drawbuffer.h"
+#include "radixsort.h"
 
 #include <glm/mat4x4.hpp>
 #include <glm/vec3.hpp>
 #include <glm/vec4.hpp>
+#include <vector>
 
 struct RenderApi3D;
 struct RenderApi2D;
@@ -15,10 +18,29 @@ struct RenderParams;
 struct Buffer3D;
 struct Buffer2D;
 
+// Filled by RenderApi3D::translucentSphere during the 3D callbacks, drawn and
+// cleared once they return
+struct TranslucentQueue {
+	std::vector<glm::vec4> spheres; // xyz center, w radius
+	std::vector<glm::vec4> colors;
+	std::vector<float> depths; // view space z of the centers, sort keys
+	RadixSortScratch sort;
+};
+
 struct RenderEngine {
 	ShaderProgram3D shader3D;
 	ShaderProgram3D_custom shader3D_custom;
+	ShaderProgram3D_instanced shader3D_instanced;
+	ShaderProgram3D_trails shader3D_trails;
+	ShaderProgram3D_spheres shader3D_spheres;
 	ShaderProgram2D shader2D;
+	ShaderProgram2D_boids shader2D_boids;
+
+	// For draws that pull their vertices from storage buffers
+	GLuint emptyVao = 0;
+	// Per frame data written by the render apis, which only see a const engine
+	mutable StreamBuffer streamBuffer;
+	mutable TranslucentQueue translucentQueue;
 };
 
 bool createRenderEngine(RenderEngine& engine);
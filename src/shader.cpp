@@ -165,6 +165,65 @@ bool createShaderProgram3D_custom(ShaderProgram3D_custom& program) {
 	return true;
 }
 
+void	 ShaderProgram3D_instanced::LoadLocation() {
+	ShaderProgram3D::LoadLocation();
+	glyphScaleLocation = glGetUniformLocation(programId, "GlyphScale");
+}
+
+bool createShaderProgram3D_instanced(ShaderProgram3D_instanced& program) {
+	CreateShaderProgramParams params;
+	params.szVertFilePath = SHADER_PATH "shader_3d_instanced.vert";
+	params.szFragFilePath = SHADER_PATH "shader_3d.frag";
+	if (!createShaderProgram(program, params)) {
+		assert(false);
+		return false;
+	}
+	// Upload uniforms
+	program.LoadLocation();
+	return true;
+}
+
+void	 ShaderProgram3D_trails::LoadLocation() {
+	ShaderProgram3D::LoadLocation();
+	capacityLocation = glGetUniformLocation(programId, "Capacity");
+	lengthLocation = glGetUniformLocation(programId, "Length");
+	headLocation = glGetUniformLocation(programId, "Head");
+	frameCountLocation = glGetUniformLocation(programId, "FrameCount");
+	trailColorLocation = glGetUniformLocation(programId, "TrailColor");
+}
+
+bool createShaderProgram3D_trails(ShaderProgram3D_trails& program) {
+	CreateShaderProgramParams params;
+	params.szVertFilePath = SHADER_PATH "shader_3d_trails.vert";
+	params.szFragFilePath = SHADER_PATH "shader_3d.frag";
+	if (!createShaderProgram(program, params)) {
+		assert(false);
+		return false;
+	}
+	// Upload uniforms
+	program.LoadLocation();
+	return true;
+}
+
+void	 ShaderProgram3D_spheres::LoadLocation() {
+	ShaderProgram3D::LoadLocation();
+	slicesLocation = glGetUniformLocation(programId, "Slices");
+	stacksLocation = glGetUniformLocation(programId, "Stacks");
+}
+
+bool createShaderProgram3D_spheres(ShaderProgram3D_spheres& program) {
+	CreateShaderProgramParams params;
+	params.szVertFilePath = SHADER_PATH "shader_3d_spheres.vert";
+	params.szFragFilePath = SHADER_PATH "shader_3d.frag";
+	if (!createShaderProgram(program, params)) {
+		assert(false);
+		return false;
+	}
+	// Upload uniforms
+	program.LoadLocation();
+	return true;
+}
+
 bool createShaderProgram2D(ShaderProgram2D& program) {
 	CreateShaderProgramParams params;
 	params.szVertFilePath = SHADER_PATH "shader_2d.vert";
@@ -178,3 +237,22 @@ bool createShaderProgram2D(ShaderProgram2D& program) {
 
 	return true;
 }
+
+bool createShaderProgram2D_boids(ShaderProgram2D_boids& program) {
+	CreateShaderProgramParams params;
+	params.szVertFilePath = SHADER_PATH "shader_2d_boids.vert";
+	params.szFragFilePath = SHADER_PATH "shader_2d.frag";
+	if (!createShaderProgram(program, params)) {
+		assert(false);
+		return false;
+	}
+
+	program.viewportSizeLocation = glGetUniformLocation(program.programId, "ViewportSize");
+	program.thicknessLocation = glGetUniformLocation(program.programId, "Thickness");
+	program.hatRatioLocation = glGetUniformLocation(program.programId, "HatRatio");
+	program.minNeighborColorLocation = glGetUniformLocation(program.programId, "MinNeighborColor");
+	program.maxNeighborColorLocation = glGetUniformLocation(program.programId, "MaxNeighborColor");
+	program.maxNeighborForColorLocation = glGetUniformLocation(program.programId, "MaxNeighborForColor");
+
+	return true;
+}
@@ -38,9 +38,45 @@ struct ShaderProgram3D_custom : ShaderProgram3D {
 
 bool createShaderProgram3D_custom(ShaderProgram3D_custom& program);
 
+struct ShaderProgram3D_instanced : ShaderProgram3D {
+	GLuint glyphScaleLocation;
+	void	 LoadLocation();
+};
+
+bool createShaderProgram3D_instanced(ShaderProgram3D_instanced& program);
+
+struct ShaderProgram3D_trails : ShaderProgram3D {
+	GLuint capacityLocation;
+	GLuint lengthLocation;
+	GLuint headLocation;
+	GLuint frameCountLocation;
+	GLuint trailColorLocation;
+	void	 LoadLocation();
+};
+
+bool createShaderProgram3D_trails(ShaderProgram3D_trails& program);
+
+struct ShaderProgram3D_spheres : ShaderProgram3D {
+	GLuint slicesLocation;
+	GLuint stacksLocation;
+	void	 LoadLocation();
+};
+
+bool createShaderProgram3D_spheres(ShaderProgram3D_spheres& program);
+
 struct ShaderProgram2D : ShaderProgram {
 	GLuint viewportSizeLocation;
 };
 
 bool createShaderProgram2D(ShaderProgram2D& program);
 
+struct ShaderProgram2D_boids : ShaderProgram2D {
+	GLuint thicknessLocation;
+	GLuint hatRatioLocation;
+	GLuint minNeighborColorLocation;
+	GLuint maxNeighborColorLocation;
+	GLuint maxNeighborForColorLocation;
+};
+
+bool createShaderProgram2D_boids(ShaderProgram2D_boids& program);
+
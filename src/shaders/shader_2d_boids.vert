@@ -0,0 +1,56 @@
+#version 430 core
+
+// Expands each boid into the 9 vertices of RenderApi2D::arrow, reading the
+// simulation arrays directly: boid = gl_VertexID / 9
+
+uniform vec2 ViewportSize;
+uniform float Thickness;
+uniform float HatRatio;
+uniform vec4 MinNeighborColor;
+uniform vec4 MaxNeighborColor;
+uniform float MaxNeighborForColor;
+
+layout(std430, binding = 4) readonly buffer BoidX { float X[]; };
+layout(std430, binding = 5) readonly buffer BoidY { float Y[]; };
+layout(std430, binding = 6) readonly buffer BoidVX { float VX[]; };
+layout(std430, binding = 7) readonly buffer BoidVY { float VY[]; };
+layout(std430, binding = 8) readonly buffer BoidNeighborCount { int NeighborCount[]; };
+
+out block
+{
+	vec4 Color;
+} Out;
+
+void main()
+{
+	int boid = gl_VertexID / 9;
+	int corner = gl_VertexID - boid * 9;
+
+	vec2 from = vec2(X[boid], Y[boid]);
+	vec2 velocity = vec2(VX[boid], VY[boid]);
+	float speed = length(velocity);
+	vec2 dir = speed > 0.0 ? velocity / speed : vec2(1.0, 0.0);
+	vec2 to = from + dir;
+	vec2 ortho = vec2(-dir.y, dir.x);
+	// Unit length arrow, as drawn by the boids viewer
+	vec2 body = dir * (1.0 - HatRatio);
+
+	vec2 position;
+	switch (corner) {
+	case 0: position = from - 0.5 * Thickness * ortho; break;
+	case 1: position = from + 0.5 * Thickness * ortho; break;
+	case 2: position = from + body + 0.5 * Thickness * ortho; break;
+	case 3: position = from + body + 0.5 * Thickness * ortho; break;
+	case 4: position = from + body - 0.5 * Thickness * ortho; break;
+	case 5: position = from - 0.5 * Thickness * ortho; break;
+	case 6: position = from + body - Thickness * ortho; break;
+	case 7: position = from + body + Thickness * ortho; break;
+	default: position = to; break;
+	}
+
+	vec2 ndcPos = (position / ViewportSize) * 2.0 - 1.0;
+	gl_Position = vec4(ndcPos, 0.0, 1.0);
+
+	float t = MaxNeighborForColor > 0.0 ? min(float(NeighborCount[boid]) / MaxNeighborForColor, 1.0) : 1.0;
+	Out.Color = mix(MinNeighborColor, MaxNeighborColor, t);
+}
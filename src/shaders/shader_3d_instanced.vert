@@ -0,0 +1,46 @@
+#version 410 core
+
+#define BufferAttribVertex 0
+#define BufferAttribNormal 1
+#define BufferAttribInstanceColor 2
+#define BufferAttribInstancePosition 3
+#define BufferAttribInstanceDirection 4
+
+uniform mat4 Model;
+uniform mat4 View;
+uniform mat4 Projection;
+uniform float GlyphScale;
+
+layout(location = BufferAttribVertex) in vec3 Position;
+layout(location = BufferAttribNormal) in vec3 Normal;
+layout(location = BufferAttribInstanceColor) in vec4 InstanceColor;
+layout(location = BufferAttribInstancePosition) in vec3 InstancePosition;
+layout(location = BufferAttribInstanceDirection) in vec3 InstanceDirection;
+
+out block
+{
+	vec4 Color;
+	vec3 CameraSpacePosition;
+	vec3 CameraSpaceNormal;
+} Out;
+
+void main()
+{
+	// Basis with the glyph +Z axis along the instance direction
+	float directionLength = length(InstanceDirection);
+	vec3 forward = directionLength > 0.0 ? InstanceDirection / directionLength : vec3(0.0, 0.0, 1.0);
+	vec3 helper = abs(forward.y) < 0.99 ? vec3(0.0, 1.0, 0.0) : vec3(1.0, 0.0, 0.0);
+	vec3 side = normalize(cross(helper, forward));
+	vec3 up = cross(forward, side);
+	mat3 orientation = mat3(side, up, forward);
+
+	// The model matrix only places the glyph, it does not stretch it
+	vec4 center = View * Model * vec4(InstancePosition, 1.0);
+	vec3 cameraSpaceOffset = mat3(View) * (orientation * Position * GlyphScale);
+	vec4 p = vec4(center.xyz + cameraSpaceOffset, 1.0);
+
+	gl_Position = Projection * p;
+	Out.Color = InstanceColor;
+	Out.CameraSpacePosition = p.xyz;
+	Out.CameraSpaceNormal = mat3(View) * (orientation * Normal);
+}
@@ -0,0 +1,41 @@
+#version 430 core
+
+// One sphere per instance, in the order of the translucent queue: Slices x
+// Stacks quads of two triangles, quad = gl_VertexID / 6
+
+uniform mat4 View;
+uniform mat4 Projection;
+uniform int Slices;
+uniform int Stacks;
+
+// Two vec4 per sphere: xyz the center and w the radius, then the color
+layout(std430, binding = 10) readonly buffer TranslucentSpheres { vec4 Spheres[]; };
+
+out block
+{
+	vec4 Color;
+	vec3 CameraSpacePosition;
+	vec3 CameraSpaceNormal;
+} Out;
+
+const vec2 QuadCorners[6] = vec2[6](vec2(0.0, 0.0), vec2(1.0, 0.0), vec2(1.0, 1.0), vec2(0.0, 0.0), vec2(1.0, 1.0), vec2(0.0, 1.0));
+
+void main()
+{
+	int quad = gl_VertexID / 6;
+	vec2 corner = QuadCorners[gl_VertexID - quad * 6];
+	int stack = quad / Slices;
+	int slice = quad - stack * Slices;
+
+	// Counter clockwise seen from outside, back faces are culled
+	float polar = (float(stack) + corner.y) / float(Stacks) * 3.14159265;
+	float azimuth = (float(slice) + corner.x) / float(Slices) * 6.28318531;
+	vec3 normal = vec3(sin(polar) * cos(azimuth), cos(polar), sin(polar) * sin(azimuth));
+
+	vec4 sphere = Spheres[2 * gl_InstanceID];
+	vec4 p = View * vec4(sphere.xyz + sphere.w * normal, 1.0);
+	gl_Position = Projection * p;
+	Out.Color = Spheres[2 * gl_InstanceID + 1];
+	Out.CameraSpacePosition = p.xyz;
+	Out.CameraSpaceNormal = mat3(View) * normal;
+}
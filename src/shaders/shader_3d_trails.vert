@@ -0,0 +1,52 @@
+#version 430 core
+
+// Expands each point into the Length - 1 lines joining its positions in
+// consecutive frames of the trail ring: point = gl_VertexID / (2 * (Length - 1))
+
+uniform mat4 View;
+uniform mat4 Projection;
+uniform int Capacity;
+uniform int Length;
+uniform int Head;
+uniform int FrameCount;
+uniform vec4 TrailColor;
+
+layout(std430, binding = 9) readonly buffer TrailRing { vec4 Points[]; };
+
+out block
+{
+	vec4 Color;
+	vec3 CameraSpacePosition;
+	vec3 CameraSpaceNormal;
+} Out;
+
+vec4 pointAtAge(int point, int age)
+{
+	int slot = (Head - age + Length) % Length;
+	return Points[slot * Capacity + point];
+}
+
+void main()
+{
+	int verticesPerTrail = 2 * (Length - 1);
+	int point = gl_VertexID / verticesPerTrail;
+	int vertex = gl_VertexID - point * verticesPerTrail;
+	int segment = vertex / 2;
+	// Frames ago, 0 is the newest
+	int age = segment + (vertex & 1);
+
+	vec4 newest = pointAtAge(point, 0);
+	vec4 oldest = pointAtAge(point, segment + 1);
+	// A slot only ever holds one run of frames per point, so the segment
+	// belongs to this point when its older end does
+	bool visible = segment + 1 < FrameCount && floatBitsToUint(oldest.w) == floatBitsToUint(newest.w);
+
+	vec3 position = visible ? pointAtAge(point, age).xyz : newest.xyz;
+	vec4 p = View * vec4(position, 1.0);
+	gl_Position = Projection * p;
+
+	float fade = 1.0 - float(age) / float(Length - 1);
+	Out.Color = vec4(TrailColor.rgb, visible ? TrailColor.a * fade : 0.0);
+	Out.CameraSpacePosition = p.xyz;
+	Out.CameraSpaceNormal = vec3(0.0, 0.0, 1.0);
+}
@@ -0,0 +1,98 @@
+#include "threadpool.h"
+
+#include <algorithm>
+#include <assert.h>
+
+namespace {
+	void runChunks(ThreadPool& pool) {
+		for (;;) {
+			const int chunk = pool.nextChunk.fetch_add(1, std::memory_order_relaxed);
+			if (chunk >= pool.chunkCount) {
+				return;
+			}
+			const int begin = chunk * pool.chunkSize;
+			const int end = std::min(begin + pool.chunkSize, pool.itemCount);
+			(*pool.pJob)(begin, end);
+		}
+	}
+
+	// seenGeneration is read at spawn time, so that a job posted before the
+	// thread first takes the lock is not missed
+	void threadPoolWorkerLoop(ThreadPool& pool, unsigned int seenGeneration) {
+		std::unique_lock<std::mutex> lock(pool.mutex);
+		for (;;) {
+			pool.wakeCv.wait(lock, [&] { return pool.quit || pool.generation != seenGeneration; });
+			if (pool.quit) {
+				return;
+			}
+			seenGeneration = pool.generation;
+			lock.unlock();
+			runChunks(pool);
+			lock.lock();
+			if (--pool.pendingWorkers == 0) {
+				pool.doneCv.notify_one();
+			}
+		}
+	}
+}
+
+void startThreadPool(ThreadPool& pool, int threadCount) {
+	assert(pool.threads.empty());
+	if (threadCount <= 0) {
+		threadCount = std::max(1, static_cast<int>(std::thread::hardware_concurrency()));
+	}
+	pool.quit = false;
+	for (int i = 1; i < threadCount; ++i) {
+		pool.threads.emplace_back(threadPoolWorkerLoop, std::ref(pool), pool.generation);
+	}
+}
+
+void stopThreadPool(ThreadPool& pool) {
+	{
+		std::lock_guard<std::mutex> lock(pool.mutex);
+		pool.quit = true;
+		pool.wakeCv.notify_all();
+	}
+	for (std::thread& thread : pool.threads) {
+		thread.join();
+	}
+	pool.threads.clear();
+}
+
+int threadPoolSize(const ThreadPool& pool) {
+	return static_cast<int>(pool.threads.size()) + 1;
+}
+
+void parallelFor(ThreadPool& pool, int itemCount, int chunkSize, const std::function<void(int begin, int end)>& job) {
+	assert(chunkSize > 0);
+	if (itemCount <= 0) {
+		return;
+	}
+	const int chunkCount = (itemCount + chunkSize - 1) / chunkSize;
+	if (pool.threads.empty() || chunkCount == 1) {
+		for (int begin = 0; begin < itemCount; begin += chunkSize) {
+			job(begin, std::min(begin + chunkSize, itemCount));
+		}
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(pool.mutex);
+		assert(pool.pendingWorkers == 0);
+		pool.pJob = &job;
+		pool.itemCount = itemCount;
+		pool.chunkSize = chunkSize;
+		pool.chunkCount = chunkCount;
+		pool.nextChunk.store(0, std::memory_order_relaxed);
+		// Every worker checks in, even when there is no chunk left for it
+		pool.pendingWorkers = static_cast<int>(pool.threads.size());
+		++pool.generation;
+	}
+	pool.wakeCv.notify_all();
+
+	runChunks(pool);
+
+	std::unique_lock<std::mutex> lock(pool.mutex);
+	pool.doneCv.wait(lock, [&pool] { return pool.pendingWorkers == 0; });
+	pool.pJob = nullptr;
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed set of worker threads running parallelFor jobs. The calling thread
+// takes part in every job, so a pool of size 1 has no worker thread at all.
+struct ThreadPool {
+	std::vector<std::thread> threads;
+	std::mutex mutex;
+	std::condition_variable wakeCv;
+	std::condition_variable doneCv;
+	unsigned int generation = 0;
+	bool quit = false;
+
+	// Current job, valid while pendingWorkers > 0
+	const std::function<void(int, int)>* pJob = nullptr;
+	int itemCount = 0;
+	int chunkSize = 1;
+	int chunkCount = 0;
+	std::atomic<int> nextChunk{ 0 };
+	int pendingWorkers = 0;
+};
+
+// threadCount includes the calling thread, 0 = one per hardware thread
+void startThreadPool(ThreadPool& pool, int threadCount);
+
+void stopThreadPool(ThreadPool& pool);
+
+int threadPoolSize(const ThreadPool& pool);
+
+// Calls job(begin, end) over [0, itemCount) in chunks of chunkSize items and
+// returns once every chunk is done. Chunk boundaries only depend on
+// itemCount and chunkSize, never on the thread count. Not reentrant: job
+// must not call parallelFor on the same pool.
+void parallelFor(ThreadPool& pool, int itemCount, int chunkSize, const std::function<void(int begin, int end)>& job);
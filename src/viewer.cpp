@@ -8,6 +8,9 @@
 #include "camera.h"
 
 #include <time.h>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
 
 #include <GLFW/glfw3.h>
 #include <glad.h>
@@ -110,6 +113,64 @@ namespace {
 		const Viewer& viewer = *reinterpret_cast<Viewer const*>(pUserData);
 		viewer.render2D(api);
 	}
+
+	// Runs Viewer::simulate on its own thread, one step per kick.
+	struct SimulationWorker {
+		std::thread thread;
+		std::mutex mutex;
+		std::condition_variable cv;
+		Viewer* pViewer = nullptr;
+		double elapsedTime = 0.0;
+		bool busy = false;
+		bool quit = false;
+	};
+
+	void simulationWorkerLoop(SimulationWorker& worker) {
+		std::unique_lock<std::mutex> lock(worker.mutex);
+		for (;;) {
+			worker.cv.wait(lock, [&worker] { return worker.busy || worker.quit; });
+			if (worker.quit) {
+				return;
+			}
+			const double elapsedTime = worker.elapsedTime;
+			lock.unlock();
+			worker.pViewer->simulate(elapsedTime);
+			lock.lock();
+			worker.busy = false;
+			worker.cv.notify_all();
+		}
+	}
+
+	void kickSimulationWorker(SimulationWorker& worker, Viewer& viewer, double elapsedTime) {
+		if (!worker.thread.joinable()) {
+			worker.pViewer = &viewer;
+			worker.quit = false;
+			worker.thread = std::thread(simulationWorkerLoop, std::ref(worker));
+		}
+		std::lock_guard<std::mutex> lock(worker.mutex);
+		assert(!worker.busy);
+		worker.elapsedTime = elapsedTime;
+		worker.busy = true;
+		worker.cv.notify_all();
+	}
+
+	// Blocks until the last kicked step is done. No-op when idle.
+	void waitSimulationWorker(SimulationWorker& worker) {
+		std::unique_lock<std::mutex> lock(worker.mutex);
+		worker.cv.wait(lock, [&worker] { return !worker.busy; });
+	}
+
+	void stopSimulationWorker(SimulationWorker& worker) {
+		if (!worker.thread.joinable()) {
+			return;
+		}
+		{
+			std::lock_guard<std::mutex> lock(worker.mutex);
+			worker.quit = true;
+			worker.cv.notify_all();
+		}
+		worker.thread.join();
+	}
 }
 
 Viewer::Viewer(char const* initialWindowName, int initialViewportWidth, int initialViewportHeight) {
@@ -134,13 +195,191 @@ Viewer::Viewer(char const* initialWindowName, int initialViewportWidth, int init
 
 	pCustomShaderData = nullptr;
 	CustomShaderDataSize = 0;
+
+	pipelined = false;
+
+	inputRecordPath = nullptr;
+	inputReplayPath = nullptr;
+	fixedDeltaTime = 0.0;
+
+	swapInterval = 1;
+	frameLimiterFps = 0.f;
+	frameStatsCsvPath = "frame_stats.csv";
+
+	threadCount = 0;
+
+	strncpy(pointCachePath, "points.pcache", COUNTOF(pointCachePath));
+}
+
+void Viewer::parseCommandLine(int argc, char** argv) {
+	for (int i = 1; i < argc; ++i) {
+		const bool hasValue = i + 1 < argc;
+		if (hasValue && strcmp(argv[i], "--record") == 0) {
+			inputRecordPath = argv[++i];
+		}
+		else if (hasValue && strcmp(argv[i], "--replay") == 0) {
+			inputReplayPath = argv[++i];
+		}
+		else if (hasValue && strcmp(argv[i], "--fixed-dt") == 0) {
+			fixedDeltaTime = atof(argv[++i]);
+		}
+		else if (hasValue && strcmp(argv[i], "--frame-stats") == 0) {
+			frameStatsCsvPath = argv[++i];
+		}
+		else if (hasValue && strcmp(argv[i], "--threads") == 0) {
+			threadCount = atoi(argv[++i]);
+		}
+		else {
+			fprintf(stderr, "Ignoring command line argument %s\n", argv[i]);
+		}
+	}
+}
+
+bool Viewer::isKeyPressed(int key) const {
+	assert(key >= 0 && key < INPUT_KEY_COUNT);
+	return input.keys[key];
+}
+
+bool Viewer::isMouseButtonPressed(int button) const {
+	assert(button >= 0 && button < INPUT_MOUSE_BUTTON_COUNT);
+	return input.mouseButtons[button];
+}
+
+void Viewer::getCursorPos(double& x, double& y) const {
+	x = input.cursorX;
+	y = input.cursorY;
+}
+
+void Viewer::drawPointCacheGUI(int componentCount) {
+	if (!ImGui::CollapsingHeader("Point Cache")) {
+		return;
+	}
+	const bool busy = isPointCacheRecording(pointCacheRecorder) || isPointCacheOpen(pointCachePlayer);
+	ImGui::InputText("File", pointCachePath, COUNTOF(pointCachePath), busy ? ImGuiInputTextFlags_ReadOnly : 0);
+
+	if (isPointCacheRecording(pointCacheRecorder)) {
+		if (ImGui::Button("Stop Recording")) {
+			stopPointCacheRecording(pointCacheRecorder);
+		}
+	}
+	else if (!isPointCacheOpen(pointCachePlayer) && ImGui::Button("Record")) {
+		startPointCacheRecording(pointCacheRecorder, pointCachePath, componentCount);
+	}
+	if (pointCacheRecorder.recordedFrameCount > 0) {
+		const uint64_t writtenBytes = pointCacheRecorder.writtenBytes;
+		ImGui::Text("%d frames, %d dropped, %d chunks written", pointCacheRecorder.recordedFrameCount,
+			pointCacheRecorder.droppedFrameCount, int(pointCacheRecorder.writtenChunkCount));
+		ImGui::Text("%.1f MB written, ratio %.2f, last chunk %.2f ms", writtenBytes / (1024.f * 1024.f),
+			writtenBytes > 0 ? float(double(pointCacheRecorder.recordedBytes) / double(writtenBytes)) : 0.f,
+			float(pointCacheRecorder.lastEncodeMs));
+	}
+
+	if (isPointCacheOpen(pointCachePlayer)) {
+		if (ImGui::Button("Close Playback")) {
+			closePointCache(pointCachePlayer);
+			return;
+		}
+		ImGui::SameLine();
+		ImGui::Checkbox("Pause", &pointCachePlayer.paused);
+		ImGui::SliderInt("Frame", &pointCachePlayer.playFrame, 0, glm::max(pointCachePlayer.frameCount - 1, 0));
+		ImGui::Text("%d points, t = %.3f s", pointCachePlayer.pointCount, pointCachePlayer.time);
+	}
+	else if (!isPointCacheRecording(pointCacheRecorder) && ImGui::Button("Play")) {
+		if (openPointCache(pointCachePlayer, pointCachePath) && pointCachePlayer.componentCount != componentCount) {
+			fprintf(stderr, "%s holds %d components per point, expected %d\n", pointCachePath, pointCachePlayer.componentCount, componentCount);
+			closePointCache(pointCachePlayer);
+		}
+	}
+}
+
+bool Viewer::nextPointCacheFrame() {
+	if (!isPointCacheOpen(pointCachePlayer) || pointCachePlayer.frameCount == 0) {
+		return false;
+	}
+	PointCachePlayer& player = pointCachePlayer;
+	player.playFrame = glm::clamp(player.playFrame, 0, player.frameCount - 1);
+	if (!readPointCacheFrame(player, player.playFrame)) {
+		closePointCache(player);
+		return false;
+	}
+	if (!player.paused) {
+		player.playFrame = (player.playFrame + 1) % player.frameCount;
+	}
+	return true;
 }
 
 namespace {
+	// GLFW callbacks only queue events, they are applied at the start of the next frame
 	void windowScrollCallback(GLFWwindow* window, double xoffset, double yoffset) {
 		Viewer* pViewer = reinterpret_cast<Viewer*>(glfwGetWindowUserPointer(window));
 		assert(pViewer);
-		cameraZoom(pViewer->camera, float(-yoffset) * GUIStates::MOUSE_ZOOM_SCROLL_SPEED);
+		pushInputEvent(pViewer->inputRecorder, { eInputEventType::Scroll, 0, false, xoffset, yoffset });
+	}
+
+	void windowKeyCallback(GLFWwindow* window, int key, int scancode, int action, int mods) {
+		Viewer* pViewer = reinterpret_cast<Viewer*>(glfwGetWindowUserPointer(window));
+		assert(pViewer);
+		if (key == GLFW_KEY_UNKNOWN || action == GLFW_REPEAT) {
+			return;
+		}
+		pushInputEvent(pViewer->inputRecorder, { eInputEventType::Key, key, action == GLFW_PRESS, 0.0, 0.0 });
+	}
+
+	void windowMouseButtonCallback(GLFWwindow* window, int button, int action, int mods) {
+		Viewer* pViewer = reinterpret_cast<Viewer*>(glfwGetWindowUserPointer(window));
+		assert(pViewer);
+		pushInputEvent(pViewer->inputRecorder, { eInputEventType::MouseButton, button, action == GLFW_PRESS, 0.0, 0.0 });
+	}
+
+	void windowCursorPosCallback(GLFWwindow* window, double x, double y) {
+		Viewer* pViewer = reinterpret_cast<Viewer*>(glfwGetWindowUserPointer(window));
+		assert(pViewer);
+		pushInputEvent(pViewer->inputRecorder, { eInputEventType::CursorPos, 0, false, x, y });
+	}
+
+	void drawInstrumentationWindow(Viewer& viewer) {
+		FrameStats& stats = viewer.frameStats;
+
+		ImGui::SetNextWindowCollapsed(true, ImGuiCond_FirstUseEver);
+		ImGui::Begin("Instrumentation");
+
+		ImGui::SliderInt("Swap Interval", &viewer.swapInterval, 0, 4);
+		ImGui::SliderFloat("Frame Limiter (fps, 0 = off)", &viewer.frameLimiterFps, 0.f, 240.f);
+		ImGui::SliderFloat("Frame Budget (ms)", &stats.budgetMs, 1.f, 100.f);
+
+		const FramePercentiles percentiles = computeFramePercentiles(stats);
+		ImGui::Text("p50 %.2f ms  p95 %.2f ms  p99 %.2f ms  max %.2f ms", percentiles.p50Ms, percentiles.p95Ms, percentiles.p99Ms, percentiles.maxMs);
+		ImGui::Text("Hitches over budget: %u", stats.hitchCount);
+		if (stats.refreshPeriodMs > 0.f) {
+			ImGui::Text("Vsync misses: %u (refresh %.2f ms)", stats.vsyncMissCount, stats.refreshPeriodMs);
+		}
+		if (ImGui::Button("Reset Counters")) {
+			stats.hitchCount = 0;
+			stats.vsyncMissCount = 0;
+		}
+
+		float frameTimes[FRAME_STATS_RING_SIZE];
+		const int frameCount = copyFrameTimes(stats, frameTimes);
+		const float scaleMax = glm::max(2.f * stats.budgetMs, percentiles.maxMs);
+		ImGui::PlotLines("Frame Times", frameTimes, frameCount, 0, nullptr, 0.f, scaleMax, ImVec2(0, 80));
+
+		float bins[FRAME_STATS_HISTOGRAM_BINS];
+		computeFrameHistogram(stats, 2.f * stats.budgetMs, bins);
+		ImGui::PlotHistogram("Latency Histogram", bins, FRAME_STATS_HISTOGRAM_BINS, 0, "0 .. 2x budget", 0.f, FLT_MAX, ImVec2(0, 80));
+
+		// The simulation worker is idle here, so the pool can be restarted
+		ImGui::Separator();
+		int threadCount = threadPoolSize(viewer.threadPool);
+		if (ImGui::SliderInt("Worker Threads", &threadCount, 1, glm::max(1, int(std::thread::hardware_concurrency())))) {
+			stopThreadPool(viewer.threadPool);
+			startThreadPool(viewer.threadPool, threadCount);
+			viewer.threadCount = threadCount;
+		}
+
+		ImGui::Separator();
+		viewer.drawInstrumentationGUI();
+
+		ImGui::End();
 	}
 }
 
@@ -193,11 +432,24 @@ int /*exit code*/ Viewer::run() {
 		ERROR("Failed to initialize OpenGL context.");
 	}
 
+	int appliedSwapInterval = swapInterval;
+	glfwSwapInterval(appliedSwapInterval);
+	frameStats.swapInterval = appliedSwapInterval;
+	if (const GLFWvidmode* pVideoMode = glfwGetVideoMode(glfwGetPrimaryMonitor())) {
+		frameStats.refreshPeriodMs = 1000.f / float(pVideoMode->refreshRate);
+		// Leave some room for the usual jitter around the refresh period
+		frameStats.budgetMs = 1.25f * frameStats.refreshPeriodMs;
+	}
+
 	// Ensure we can capture the escape key being pressed below
 	glfwSetInputMode(window, GLFW_STICKY_KEYS, GL_TRUE);
 
 	glfwSetWindowUserPointer(window, this);
+	// Installed before ImGui, which chains to them
 	glfwSetScrollCallback(window, windowScrollCallback);
+	glfwSetKeyCallback(window, windowKeyCallback);
+	glfwSetMouseButtonCallback(window, windowMouseButtonCallback);
+	glfwSetCursorPosCallback(window, windowCursorPosCallback);
 
 	//-- Debg callback
 	glEnable(GL_DEBUG_OUTPUT);
@@ -228,6 +480,8 @@ int /*exit code*/ Viewer::run() {
 		ERROR("Failed to create render engine");
 	}
 
+	startThreadPool(threadPool, threadCount);
+
 	// call virtual method
 	init();
 
@@ -235,7 +489,25 @@ int /*exit code*/ Viewer::run() {
 		ERROR("OpenGL Error before launching main loop");
 	}
 
+	if (inputReplayPath && !startInputReplay(inputRecorder, inputReplayPath)) {
+		ERROR("Failed to start input replay");
+	}
+	if (inputRecordPath && !inputReplayPath && !startInputRecording(inputRecorder, inputRecordPath, fixedDeltaTime)) {
+		ERROR("Failed to start input recording");
+	}
+
+	// The cursor callback only fires on movement
+	{
+		double cursorX, cursorY;
+		glfwGetCursorPos(window, &cursorX, &cursorY);
+		pushInputEvent(inputRecorder, { eInputEventType::CursorPos, 0, false, cursorX, cursorY });
+	}
+
+	SimulationWorker simulationWorker;
+
 	const clock_t startTime = clock();
+	unsigned int frameIndex = 0;
+	double previousFrameEnd = glfwGetTime();
 
 	// Loop until the user closes the window
 	while (!glfwWindowShouldClose(window) && (glfwGetKey(window, GLFW_KEY_ESCAPE) != GLFW_PRESS)) {
@@ -243,29 +515,30 @@ int /*exit code*/ Viewer::run() {
 
 		// Poll for and process events
 		glfwPollEvents();
+		beginInputFrame(inputRecorder, input);
 
 		glfwGetFramebufferSize(window, &viewportWidth, &viewportHeight);
 
 		// Mouse states
-		int leftButton = glfwGetMouseButton(window, GLFW_MOUSE_BUTTON_LEFT);
-		int rightButton = glfwGetMouseButton(window, GLFW_MOUSE_BUTTON_RIGHT);
-		int middleButton = glfwGetMouseButton(window, GLFW_MOUSE_BUTTON_MIDDLE);
+		const bool leftButton = isMouseButtonPressed(GLFW_MOUSE_BUTTON_LEFT);
+		const bool rightButton = isMouseButtonPressed(GLFW_MOUSE_BUTTON_RIGHT);
+		const bool middleButton = isMouseButtonPressed(GLFW_MOUSE_BUTTON_MIDDLE);
 
-		if (leftButton == GLFW_PRESS) {
+		if (leftButton) {
 			guiStates.turnLock = true;
 		}
 		else {
 			guiStates.turnLock = false;
 		}
 
-		if (rightButton == GLFW_PRESS) {
+		if (rightButton) {
 			guiStates.zoomLock = true;
 		}
 		else {
 			guiStates.zoomLock = false;
 		}
 
-		if (middleButton == GLFW_PRESS) {
+		if (middleButton) {
 			guiStates.panLock = true;
 		}
 		else {
@@ -273,18 +546,19 @@ int /*exit code*/ Viewer::run() {
 		}
 
 		// Camera movements
-		int leftAltPressed = glfwGetKey(window, GLFW_KEY_LEFT_ALT);
-		int rightAltPressed = glfwGetKey(window, GLFW_KEY_RIGHT_ALT);
-		int f7Pressed = glfwGetKey(window, GLFW_KEY_F7);
-
-		const bool altPressed = leftAltPressed == GLFW_PRESS || rightAltPressed == GLFW_PRESS;
+		const bool altPressed = isKeyPressed(GLFW_KEY_LEFT_ALT) || isKeyPressed(GLFW_KEY_RIGHT_ALT);
+		const bool f7Pressed = isKeyPressed(GLFW_KEY_F7);
 
 		double mousex_d, mousey_d;
-		glfwGetCursorPos(window, &mousex_d, &mousey_d);
+		getCursorPos(mousex_d, mousey_d);
 		int mousex = (int)mousex_d;
 		int mousey = (int)mousey_d;
 
-		if (!altPressed && (leftButton == GLFW_PRESS || rightButton == GLFW_PRESS || middleButton == GLFW_PRESS)) {
+		if (input.scrollY != 0.0) {
+			cameraZoom(camera, float(-input.scrollY) * GUIStates::MOUSE_ZOOM_SCROLL_SPEED);
+		}
+
+		if (!altPressed && (leftButton || rightButton || middleButton)) {
 			guiStates.lockPositionX = mousex;
 			guiStates.lockPositionY = mousey;
 		}
@@ -315,9 +589,48 @@ int /*exit code*/ Viewer::run() {
 			reloadRenderEngineShaders(renderEngine);
 		}
 
-		const clock_t currentTime = clock();
-		const double elapsedTime = (currentTime - startTime) / double(CLOCKS_PER_SEC);
+		double elapsedTime;
+		if (isInputReplaying(inputRecorder)) {
+			elapsedTime = inputRecorder.replayElapsedTime;
+		}
+		else if (fixedDeltaTime > 0.0) {
+			elapsedTime = frameIndex * fixedDeltaTime;
+		}
+		else {
+			const clock_t currentTime = clock();
+			elapsedTime = (currentTime - startTime) / double(CLOCKS_PER_SEC);
+		}
+		++frameIndex;
+
+		// From here until the next kick, the worker is idle: update() and the GUI
+		// may freely touch simulation state.
+		waitSimulationWorker(simulationWorker);
+
 		update(elapsedTime);
+		if (!pipelined) {
+			simulate(elapsedTime);
+		}
+		publishSnapshot();
+
+		// Start the Dear ImGui frame
+		ImGui_ImplOpenGL3_NewFrame();
+		ImGui_ImplGlfw_NewFrame();
+		ImGui::NewFrame();
+
+		drawGUI();
+		drawInstrumentationWindow(*this);
+
+		ImGui::Render();
+
+		endInputFrame(inputRecorder, camera, elapsedTime);
+		if (inputRecorder.replayFinished) {
+			glfwSetWindowShouldClose(window, GLFW_TRUE);
+		}
+
+		// Simulate the next frame while this one is rendered from the snapshot
+		if (pipelined) {
+			kickSimulationWorker(simulationWorker, *this, elapsedTime);
+		}
 
 		RenderParams renderParams;
 		renderParams.render3DCallback = render3DCallback;
@@ -352,15 +665,7 @@ int /*exit code*/ Viewer::run() {
 
 		renderEngineFrame(renderEngine, renderParams);
 
-		// Start the Dear ImGui frame
-		ImGui_ImplOpenGL3_NewFrame();
-		ImGui_ImplGlfw_NewFrame();
-		ImGui::NewFrame();
-
-		drawGUI();
-
 		// Rendering
-		ImGui::Render();
 		glViewport(0, 0, viewportWidth, viewportHeight);
 		//glClear(GL_COLOR_BUFFER_BIT);
 		ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
@@ -368,6 +673,19 @@ int /*exit code*/ Viewer::run() {
 		// Swap front and back buffers
 		glfwSwapBuffers(window);
 
+		if (frameLimiterFps > 0.f) {
+			waitUntil(previousFrameEnd + 1.0 / frameLimiterFps);
+		}
+		const double frameEnd = glfwGetTime();
+		addFrameTime(frameStats, float(1000.0 * (frameEnd - previousFrameEnd)));
+		previousFrameEnd = frameEnd;
+
+		if (swapInterval != appliedSwapInterval) {
+			appliedSwapInterval = swapInterval;
+			glfwSwapInterval(appliedSwapInterval);
+			frameStats.swapInterval = appliedSwapInterval;
+		}
+
 		if (checkOpenGlError()) {
 			assert(false);
 		}
@@ -380,6 +698,18 @@ int /*exit code*/ Viewer::run() {
 		glfwSetWindowTitle(window, windowNameEx);
 	}
 
+	waitSimulationWorker(simulationWorker);
+	stopSimulationWorker(simulationWorker);
+	stopThreadPool(threadPool);
+
+	stopInputRecorder(inputRecorder);
+	stopPointCacheRecording(pointCacheRecorder);
+	closePointCache(pointCachePlayer);
+
+	if (frameStatsCsvPath) {
+		writeFrameStatsCsv(frameStats, frameStatsCsvPath);
+	}
+
 	// Cleanup
 	ImGui_ImplOpenGL3_Shutdown();
 	ImGui_ImplGlfw_Shutdown();
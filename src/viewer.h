@@ -1,6 +1,10 @@
 #pragma once
 
 #include "camera.h"
+#include "input.h"
+#include "framestats.h"
+#include "threadpool.h"
+#include "pointcache.h"
 #include <glm/vec4.hpp>
 
 struct RenderApi3D;
@@ -30,11 +34,55 @@ struct Viewer {
 	void* pCustomShaderData;
 	int CustomShaderDataSize;
 
+	// When set, simulate() for the next frame runs on a worker thread while
+	// the main thread renders the snapshot published for the current frame.
+	bool pipelined;
+
+	// Input for the current frame, live or replayed. Read it through the
+	// helpers below rather than querying GLFW directly.
+	InputState input;
+	InputRecorder inputRecorder;
+
+	// Set from the command line (see parseCommandLine)
+	char const* inputRecordPath;
+	char const* inputReplayPath;
+	double fixedDeltaTime; // 0 = real time
+
+	// Frame pacing, shown in the Instrumentation window
+	FrameStats frameStats;
+	int swapInterval;              // 0 = vsync off
+	float frameLimiterFps;         // 0 = no limiter
+	char const* frameStatsCsvPath; // written on exit, nullptr = disabled
+
+	// Shared by the viewers for data parallel work. Only use it from
+	// simulate(), or from update() / drawGUI() while not pipelined.
+	ThreadPool threadPool;
+	int threadCount; // including the calling thread, 0 = one per hardware thread
+
+	// Simulation output recorded to / played back from disk, see drawPointCacheGUI
+	PointCacheRecorder pointCacheRecorder;
+	PointCachePlayer pointCachePlayer;
+	char pointCachePath[256];
 
 	Viewer(char const* initialWindowName, int initialViewportWidth, int initialViewportHeight);
 
+	// --record <file> | --replay <file> | --fixed-dt <seconds> | --frame-stats <csv file> | --threads <count>
+	void parseCommandLine(int argc, char** argv);
+
 	int /*exit code*/ run();
 
+	bool isKeyPressed(int key) const;
+	bool isMouseButtonPressed(int button) const;
+	void getCursorPos(double& x, double& y) const;
+
+	// Record / playback controls for a viewer caching componentCount floats per point
+	void drawPointCacheGUI(int componentCount);
+
+	// While a point cache is open: decodes the current playback frame into
+	// pointCachePlayer and advances unless paused. The viewer then renders the
+	// cached points instead of simulating.
+	bool nextPointCacheFrame();
+
 	// -----------------------------------
 	// override the following functions
 	// to create your own viewer
@@ -44,6 +92,15 @@ struct Viewer {
 
 	virtual void update(double elapsedTime) = 0;
 
+	// Advances the simulation. When pipelined, this runs on a worker thread:
+	// no GL or GLFW calls, and no access to the render snapshot.
+	virtual void simulate(double elapsedTime) {}
+
+	// Copies the simulation state read by render3D / render2D into the render
+	// snapshot. Called on the main thread while simulate() is idle; the
+	// snapshot is read-only until the next call.
+	virtual void publishSnapshot() {}
+
 	virtual void render3D_custom(const RenderApi3D& api) const = 0;
 
 	virtual void render3D(const RenderApi3D& api) const = 0;
@@ -52,4 +109,7 @@ struct Viewer {
 
 	virtual void drawGUI() = 0;
 
+	// Viewer specific timings, drawn inside the Instrumentation window
+	virtual void drawInstrumentationGUI() {}
+
 };
\ No newline at end of file